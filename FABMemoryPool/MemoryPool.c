@@ -14,6 +14,24 @@
 
 #include "MemoryPool.h"
 
+/**
+ * @brief Get alignment of chunks in pool, it is the smallest power of two not smaller than the biggest
+ * chunk, so that every block in a chunk have the same high bits of address as the chunk.
+ *
+ * @param uChunkSize Size of the biggest chunk in pool, including chunk information.
+ * @return Alignment of chunks in pool.
+ */
+inline size_t GetChunkAlignment(size_t uChunkSize)
+{
+	size_t uAlign = sizeof(void *);
+	while (uAlign < uChunkSize)
+	{
+		uAlign <<= 1;
+	}
+
+	return uAlign;
+}
+
 /**
  * @brief Create memory pool, when no room in pool, it will grow more automatically.
  *
@@ -29,43 +47,182 @@
  * _uGrowChunkBlocks sets to number of maximum memory block using when running.
  * @return Created memory pool, NULL if failed to allocate memory from system.
  */
-MemoryPool_t *CreateMemoryPool(unsigned short _uBlockSize, unsigned short _uFirstChunkBlocks,
-		                       unsigned short _uGrowChunkBlocks)
+MemoryPool_t *CreateMemoryPool(BlockIndex_t _uBlockSize, BlockIndex_t _uFirstChunkBlocks,
+		                       BlockIndex_t _uGrowChunkBlocks)
+{
+	MemoryPoolConfig_t config;
+	InitMemoryPoolConfig(&config, _uBlockSize, _uFirstChunkBlocks, _uGrowChunkBlocks);
+
+	return CreateMemoryPoolWithConfig(&config);
+}
+
+/**
+ * @brief Fill options to create memory pool with default value, it grows [_uGrowChunkBlocks] every time
+ * as CreateMemoryPool() does.
+ *
+ * @param pConfig Options to fill.
+ * @param _uBlockSize, _uFirstChunkBlocks, _uGrowChunkBlocks Same as CreateMemoryPool().
+ */
+void InitMemoryPoolConfig(MemoryPoolConfig_t *pConfig, BlockIndex_t _uBlockSize,
+		                  BlockIndex_t _uFirstChunkBlocks, BlockIndex_t _uGrowChunkBlocks)
+{
+	pConfig->uBlockSize = _uBlockSize;
+	pConfig->uBlockAlign = sizeof(BlockIndex_t);
+	pConfig->uFirstChunkBlocks = _uFirstChunkBlocks;
+	pConfig->uGrowChunkBlocks = _uGrowChunkBlocks;
+	pConfig->eGrowPolicy = GROW_FIXED;
+	pConfig->fGrowFactor = 2.0f;
+	pConfig->uMaxChunkBlocks = (_uGrowChunkBlocks > (MAX_BLOCK_INDEX >> DEFAULT_MAX_CHUNK_SHIFT))
+			? MAX_BLOCK_INDEX : (BlockIndex_t)(_uGrowChunkBlocks << DEFAULT_MAX_CHUNK_SHIFT);
+	pConfig->pGrowCallback = NULL;
+	pConfig->pGrowArg = NULL;
+	pConfig->uKeepEmptyChunks = 1;
+	pConfig->uReleaseDelayMs = 0;
+	pConfig->bRemoteFree = 0;
+}
+
+/**
+ * @brief Create memory pool by options, so that it can grow by different policy.
+ *
+ *   With GROW_GEOMETRIC, new chunk have (fGrowFactor - 1) times of blocks already in pool, at least
+ * uGrowChunkBlocks and at most uMaxChunkBlocks, so number of chunks is logarithmic in peak using blocks.
+ *
+ * @param pConfig Options of pool, initialized by InitMemoryPoolConfig().
+ * @return Created memory pool, NULL if failed to allocate memory from system.
+ */
+MemoryPool_t *CreateMemoryPoolWithConfig(const MemoryPoolConfig_t *pConfig)
 {
+	assert((GROW_CALLBACK != pConfig->eGrowPolicy) || (NULL != pConfig->pGrowCallback));
+
+	// Index saved in idle block needs to be aligned, so blocks are aligned to sizeof(BlockIndex_t) at least,
+	// blocks freed by other threads are linked by pointer, so they are aligned to it.
+	BlockIndex_t uMinSize = pConfig->bRemoteFree ? sizeof(void *) : sizeof(BlockIndex_t);
+	BlockIndex_t uBlockAlign = pConfig->uBlockAlign;
+	uBlockAlign = (uBlockAlign > uMinSize) ? uBlockAlign : uMinSize;
+	if (0 != (uBlockAlign & (uBlockAlign - 1)))
+	{
+		PrintWarning("Alignment of block must be power of two.");
+		return NULL;
+	}
+
 	MemoryPool_t *pPool = (MemoryPool_t *)malloc(sizeof(MemoryPool_t));
 	if (NULL == pPool)
 	{
 		return NULL;
 	}
 
-	// Because needs sizeof(unsigned short) bytes to save index, so that ensure that bigger than this bytes.
-	_uBlockSize = (_uBlockSize > sizeof(unsigned short)) ? _uBlockSize : sizeof(unsigned short);
+	// Because needs sizeof(BlockIndex_t) bytes to save index, so that ensure that bigger than this bytes,
+	// and round up to multiple of alignment, so that every block following each other is aligned.
+	BlockIndex_t _uBlockSize = pConfig->uBlockSize;
+	_uBlockSize = (_uBlockSize > uMinSize) ? _uBlockSize : uMinSize;
+	_uBlockSize = (_uBlockSize + uBlockAlign - 1) & ~(uBlockAlign - 1);
 	pPool->uBlockSize = _uBlockSize;
-	pPool->pFirstChunk = NULL;
-	pPool->uFirstChunkBlocks = _uFirstChunkBlocks;
-	pPool->uGrowChunkBlocks = _uGrowChunkBlocks;
+	pPool->uBlockAlign = uBlockAlign;
+
+	// Chunk information is padded to alignment of block, so that the first block is aligned.
+	pPool->uBlockOffset = (sizeof(MemoryChunk_t) + uBlockAlign - 1) & ~((size_t)uBlockAlign - 1);
+	pPool->pPartialChunk = NULL;
+	pPool->pFullChunk = NULL;
+	pPool->pEmptyChunk = NULL;
+	pPool->uFirstChunkBlocks = pConfig->uFirstChunkBlocks;
+	pPool->uGrowChunkBlocks = pConfig->uGrowChunkBlocks;
+	pPool->eGrowPolicy = pConfig->eGrowPolicy;
+	pPool->fGrowFactor = pConfig->fGrowFactor;
+	pPool->pGrowCallback = pConfig->pGrowCallback;
+	pPool->pGrowArg = pConfig->pGrowArg;
+	pPool->uChunks = 0;
+	pPool->uTotalBlocks = 0;
+	pPool->uKeepEmptyChunks = pConfig->uKeepEmptyChunks;
+	pPool->uReleaseDelayMs = pConfig->uReleaseDelayMs;
+	pPool->uEmptyChunks = 0;
+	pPool->pLastEmptyChunk = NULL;
+	pPool->bRemoteFree = pConfig->bRemoteFree;
+	pPool->owner = pthread_self();
+	pPool->pRemoteFree = NULL;
+	pPool->uRemoteFrees = 0;
+
+	// New chunk never have more blocks than this, even it grows geometrically. It is lowered so that chunk
+	// fits in MAX_CHUNK_ALIGN, but not below first chunk and uGrowChunkBlocks given by user.
+	BlockIndex_t uMaxChunkBlocks = pPool->uGrowChunkBlocks;
+	if ((GROW_FIXED != pPool->eGrowPolicy) && (pConfig->uMaxChunkBlocks > uMaxChunkBlocks))
+	{
+		size_t uAlignBlocks = (MAX_CHUNK_ALIGN > pPool->uBlockOffset)
+				? (MAX_CHUNK_ALIGN - pPool->uBlockOffset) / _uBlockSize : 0;
+		uAlignBlocks = (uAlignBlocks > pPool->uFirstChunkBlocks) ? uAlignBlocks : pPool->uFirstChunkBlocks;
+		uAlignBlocks = (uAlignBlocks > uMaxChunkBlocks) ? uAlignBlocks : uMaxChunkBlocks;
+		uMaxChunkBlocks = (pConfig->uMaxChunkBlocks > uAlignBlocks) ? (BlockIndex_t)uAlignBlocks
+				                                                    : pConfig->uMaxChunkBlocks;
+	}
+	if ((GROW_GEOMETRIC == pPool->eGrowPolicy) && (0 != pPool->uGrowChunkBlocks)
+			&& (uMaxChunkBlocks <= pPool->uGrowChunkBlocks))
+	{
+		PrintWarning("GROW_GEOMETRIC can't make chunk bigger than uGrowChunkBlocks, it grows as GROW_FIXED.");
+	}
+	pPool->uMaxChunkBlocks = uMaxChunkBlocks;
+
+	// Align every chunk to a power of two not smaller than the biggest chunk, so Free() can find the chunk.
+	uMaxChunkBlocks = (pPool->uFirstChunkBlocks > uMaxChunkBlocks) ? pPool->uFirstChunkBlocks : uMaxChunkBlocks;
+	pPool->uChunkAlign = GetChunkAlignment(pPool->uBlockOffset + (size_t)uMaxChunkBlocks * _uBlockSize);
 
 	return pPool;
 }
 
 /**
- * @brief Destroy memory pool.
+ * @brief Release all chunks in a chunk list to system.
  *
- *   Make sure all memory block allocated from pool won't use again, it will release all blocks to system.
- * @param pPool Which pool to destroy.
+ * @param pChunk The first chunk of list.
  */
-void DestroyMemoryPool(MemoryPool_t **pPool)
+inline void ReleaseChunkList(MemoryChunk_t *pChunk)
 {
-	MemoryChunk_t *pCurrChunk = (*pPool)->pFirstChunk;
 	MemoryChunk_t *pPreChunk = NULL;
 
-	// Destroy all chunks.
-	while(NULL != pCurrChunk)
+	while(NULL != pChunk)
 	{
-		pPreChunk = pCurrChunk;
-		pCurrChunk = pCurrChunk->pNextChunk;
+		pPreChunk = pChunk;
+		pChunk = pChunk->pNextChunk;
 		free(pPreChunk);
 	}
+}
+
+/**
+ * @brief Insert a chunk at the beginning of a chunk list.
+ *
+ * @param ppList Address of the first chunk pointer of list.
+ * @param pChunk Which chunk to insert.
+ */
+inline void LinkChunk(MemoryChunk_t **ppList, MemoryChunk_t *pChunk)
+{
+	pChunk->pPreChunk = NULL;
+	pChunk->pNextChunk = *ppList;
+	(NULL != *ppList) ? ((*ppList)->pPreChunk = pChunk) : 0;
+	*ppList = pChunk;
+}
+
+/**
+ * @brief Remove a chunk from the chunk list it is in.
+ *
+ * @param ppList Address of the first chunk pointer of list.
+ * @param pChunk Which chunk to remove.
+ */
+inline void UnlinkChunk(MemoryChunk_t **ppList, MemoryChunk_t *pChunk)
+{
+	(NULL != pChunk->pPreChunk) ? (pChunk->pPreChunk->pNextChunk = pChunk->pNextChunk)
+			                    : (*ppList = pChunk->pNextChunk);
+	(NULL != pChunk->pNextChunk) ? (pChunk->pNextChunk->pPreChunk = pChunk->pPreChunk) : 0;
+}
+
+/**
+ * @brief Destroy memory pool.
+ *
+ *   Make sure all memory block allocated from pool won't use again, it will release all blocks to system.
+ * @param pPool Which pool to destroy.
+ */
+void DestroyMemoryPool(MemoryPool_t **pPool)
+{
+	// Destroy all chunks.
+	ReleaseChunkList((*pPool)->pPartialChunk);
+	ReleaseChunkList((*pPool)->pFullChunk);
+	ReleaseChunkList((*pPool)->pEmptyChunk);
 
 	free(*pPool);
 	(*pPool) = NULL;
@@ -74,26 +231,31 @@ void DestroyMemoryPool(MemoryPool_t **pPool)
 /**
  * @brief Get the address of first block in chunk.
  *
- *   In this memory pool, block is following chunk structure.
+ *   In this memory pool, block is following chunk structure, which is padded to alignment of block.
+ * @param pPool The chunk in which pool.
  * @param pChunk Get first block from which chunk.
  */
-inline void *GetFirstBlockFromChunk(MemoryChunk_t *pChunk)
+inline void *GetFirstBlockFromChunk(MemoryPool_t *pPool, MemoryChunk_t *pChunk)
 {
-	return ((void *)pChunk + sizeof(MemoryChunk_t));
+	return ((void *)pChunk + pPool->uBlockOffset);
 }
 
 /**
  * @brief When user first allocate memory from pool, or all blocks in pool is used out, needs to create
  * a new chunk, so that memory pool have more blocks to gave to user.
  *
+ *   Chunk is allocated at address aligned to [uChunkAlign] of pool, so Free() can find it by block address.
+ * Only chunk information is initialized, it costs the same no matter how many blocks in chunk.
+ *
+ * @param pPool Which pool the chunk belongs to.
  * @param uBlocks Number of blocks this chunks contains.
- * @param uBlockSize Size of blocks in this chunk.
  * @return Created and initialized chunk.
  */
-inline MemoryChunk_t *AllocateNewChunkInit(unsigned short uBlocks, unsigned short uBlockSize)
+inline MemoryChunk_t *AllocateNewChunkInit(MemoryPool_t *pPool, BlockIndex_t uBlocks)
 {
-	MemoryChunk_t *pChunk = (MemoryChunk_t *)malloc(sizeof(MemoryChunk_t) + uBlocks * uBlockSize);
-	if (NULL == pChunk)
+	MemoryChunk_t *pChunk = NULL;
+	size_t uChunkSize = pPool->uBlockOffset + (size_t)uBlocks * pPool->uBlockSize;
+	if (0 != posix_memalign((void **)&pChunk, pPool->uChunkAlign, uChunkSize))
 	{
 		return NULL;
 	}
@@ -101,16 +263,112 @@ inline MemoryChunk_t *AllocateNewChunkInit(unsigned short uBlocks, unsigned shor
 	pChunk->uBlocksAvailable_ = uBlocks;
 	pChunk->uFirstAvailable_ = 0;
 	pChunk->uBlocks = uBlocks;
+	pChunk->pPool = pPool;
 	pChunk->pNextChunk = NULL;
+	pChunk->pPreChunk = NULL;
+
+	// Needn't create idle index, blocks are taken one by one from uFirstNeverUsed_ when index reaches it,
+	// so that memory of blocks won't be touched until they are used.
+	pChunk->uFirstNeverUsed_ = 0;
+	pChunk->uEmptySince_ = 0;
+
+	++ pPool->uChunks;
+	pPool->uTotalBlocks += uBlocks;
+
+	return pChunk;
+}
+
+/**
+ * @brief Get number of blocks of the new chunk when all blocks in pool used out, decided by grow policy.
+ *
+ * @param pPool Which pool needs to grow.
+ * @return Number of blocks of new chunk, 0 if forbidden to grow.
+ */
+inline BlockIndex_t GetGrowChunkBlocks(MemoryPool_t *pPool)
+{
+	size_t uBlocks = pPool->uGrowChunkBlocks;
 
-	// Initialize this chunk, create idle index.
-	void *pBlock = GetFirstBlockFromChunk(pChunk);
-	for (int i = 0; i != uBlocks; pBlock += uBlockSize)
+	switch (pPool->eGrowPolicy)
 	{
-		*(unsigned short *)pBlock = ++i;
+	case GROW_GEOMETRIC:
+		// Make pool fGrowFactor times bigger, but not less than uGrowChunkBlocks, 0 still forbidden to grow.
+		if (0 != uBlocks)
+		{
+			size_t uGeometric = (size_t)(pPool->uTotalBlocks * (pPool->fGrowFactor - 1));
+			uBlocks = (uGeometric > uBlocks) ? uGeometric : uBlocks;
+		}
+		break;
+	case GROW_CALLBACK:
+		uBlocks = pPool->pGrowCallback(pPool, pPool->pGrowArg);
+		break;
+	default:
+		break;
 	}
 
-	return pChunk;
+	return (BlockIndex_t)((uBlocks > pPool->uMaxChunkBlocks) ? pPool->uMaxChunkBlocks : uBlocks);
+}
+
+/**
+ * @brief Get the chunk to allocate blocks from, it is the first partial chunk. If there is no partial
+ * chunk, an empty chunk or a new chunk is moved to partial chunk list.
+ *
+ * @param pPool Get chunk from which pool.
+ * @return Chunk which has available blocks, NULL if pool can't grow.
+ */
+inline MemoryChunk_t *GetAvailableChunk(MemoryPool_t *pPool)
+{
+	MemoryChunk_t *pAvailableChunk = pPool->pPartialChunk;
+
+	// Give back blocks freed by other threads when a batch of them is queued, or when no partial chunk is
+	// left, they may make chunks partial. They are counted before pushed, so count is 0 only if none queued.
+	unsigned int uRemoteFrees = __atomic_load_n(&pPool->uRemoteFrees, __ATOMIC_RELAXED);
+	if ((uRemoteFrees >= REMOTE_FREE_BATCH) || ((NULL == pAvailableChunk) && (0 != uRemoteFrees)))
+	{
+		ReclaimRemoteFree(pPool);
+		pAvailableChunk = pPool->pPartialChunk;
+	}
+
+	// No partial chunk, use an empty chunk, if there is no empty chunk either, create a new chunk.
+	if (NULL == pAvailableChunk)
+	{
+		pAvailableChunk = pPool->pEmptyChunk;
+		if (NULL != pAvailableChunk)
+		{
+			UnlinkChunk(&pPool->pEmptyChunk, pAvailableChunk);
+			(pAvailableChunk == pPool->pLastEmptyChunk) ? (pPool->pLastEmptyChunk = NULL) : 0;
+			-- pPool->uEmptyChunks;
+		}
+		else
+		{
+			// If no chunk in pool, create the first chunk, or all chunks are full, needs to grow.
+			BlockIndex_t uBlocks = 0;
+			if ((NULL == pPool->pFullChunk) && (0 != pPool->uFirstChunkBlocks))
+			{
+				uBlocks = pPool->uFirstChunkBlocks;
+			}
+			else
+			{
+				uBlocks = GetGrowChunkBlocks(pPool);
+			}
+
+			// Check if forbidden to extend memory pool, if so, return NULL.
+			if (!uBlocks)
+			{
+				PrintWarning("No blocks in pool and not allowed to automatically grow.");
+				return NULL;
+			}
+
+			pAvailableChunk = AllocateNewChunkInit(pPool, uBlocks);
+			if (NULL == pAvailableChunk)
+			{
+				PrintError("Allocate memory from system to extend pool failed.");
+				return NULL;
+			}
+		}
+		LinkChunk(&pPool->pPartialChunk, pAvailableChunk);
+	}
+
+	return pAvailableChunk;
 }
 
 /**
@@ -123,57 +381,88 @@ inline MemoryChunk_t *AllocateNewChunkInit(unsigned short uBlocks, unsigned shor
 void *Malloc(MemoryPool_t *pPool)
 {
 	void *pBlock = NULL;
-	MemoryChunk_t *pAvailableChunk = pPool->pFirstChunk;
-
-	// If no chunk in pool, create it.
+	MemoryChunk_t *pAvailableChunk = GetAvailableChunk(pPool);
 	if (NULL == pAvailableChunk)
 	{
-		pPool->pFirstChunk = AllocateNewChunkInit(pPool->uFirstChunkBlocks, pPool->uBlockSize);
-		pAvailableChunk = pPool->pFirstChunk;
+		return NULL;
 	}
 
-	// Find a chunk which have available blocks.
-	while(pAvailableChunk && !pAvailableChunk->uBlocksAvailable_)
+	// Return the first available block of chunk and update index, if it is never used, it doesn't save
+	// index, the next available block is the one following it.
+	pBlock = GetFirstBlockFromChunk(pPool, pAvailableChunk);
+	pBlock += (size_t)pAvailableChunk->uFirstAvailable_ * pPool->uBlockSize;
+	if (pAvailableChunk->uFirstAvailable_ == pAvailableChunk->uFirstNeverUsed_)
 	{
-		pAvailableChunk = pAvailableChunk->pNextChunk;
+		pAvailableChunk->uFirstAvailable_ = ++ pAvailableChunk->uFirstNeverUsed_;
 	}
+	else
+	{
+		pAvailableChunk->uFirstAvailable_ = *(BlockIndex_t *)pBlock;
+	}
+	-- pAvailableChunk->uBlocksAvailable_;
 
-	// Found such a chunk have available blocks, return this block and update index.
-	if (NULL != pAvailableChunk)
+	// If chunk is used out, move it to full chunk list.
+	if (0 == pAvailableChunk->uBlocksAvailable_)
 	{
-		pBlock = GetFirstBlockFromChunk(pAvailableChunk);
-		pBlock += pAvailableChunk->uFirstAvailable_ * pPool->uBlockSize;
-		pAvailableChunk->uFirstAvailable_ = *(unsigned short *)pBlock;
-		-- pAvailableChunk->uBlocksAvailable_;
+		UnlinkChunk(&pPool->pPartialChunk, pAvailableChunk);
+		LinkChunk(&pPool->pFullChunk, pAvailableChunk);
 	}
-	else
+
+	return pBlock;
+}
+
+/**
+ * @brief Allocate many memory blocks from pool at once, blocks are taken from a chunk in one pass, and
+ * chunk lists are updated once for every chunk instead of once for every block.
+ *
+ * @param pPool Get memory blocks from which pool.
+ * @param pPtrs Where to save addresses of allocated memory blocks.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if pool can't grow any more.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	unsigned int uGot = 0;
+	MemoryChunk_t *pChunk = NULL;
+
+	while (uGot < uCount)
 	{
-		// All chunk is full, needs to create a new chunk.
-		// Check if forbidden to extend memory pool, if so, return NULL.
-		if (!pPool->uGrowChunkBlocks)
+		pChunk = GetAvailableChunk(pPool);
+		if (NULL == pChunk)
 		{
-			PrintWarning("No blocks in pool and not allowed to automatically grow.");
-			return NULL;
+			break;
 		}
 
-		// Create a new chunk, and return it's first block.
-		pAvailableChunk = AllocateNewChunkInit(pPool->uGrowChunkBlocks, pPool->uBlockSize);
-		if (NULL == pAvailableChunk)
+		void *pFirstBlock = GetFirstBlockFromChunk(pPool, pChunk);
+		BlockIndex_t uIndex = pChunk->uFirstAvailable_;
+		BlockIndex_t uTake = ((uCount - uGot) < pChunk->uBlocksAvailable_) ? (BlockIndex_t)(uCount - uGot)
+		                                                                     : pChunk->uBlocksAvailable_;
+		pChunk->uBlocksAvailable_ -= uTake;
+
+		// Blocks given back before are linked by index, the list ends at the first never used block.
+		for (; (0 != uTake) && (uIndex != pChunk->uFirstNeverUsed_); -- uTake)
 		{
-			PrintError("Allocate memory from system to extend pool failed.");
-			return NULL;
+			pPtrs[uGot] = pFirstBlock + (size_t)uIndex * pPool->uBlockSize;
+			uIndex = *(BlockIndex_t *)pPtrs[uGot ++];
+		}
+
+		// Never used blocks follow each other, take the rest from them.
+		for (; 0 != uTake; -- uTake)
+		{
+			pPtrs[uGot ++] = pFirstBlock + (size_t)(uIndex ++) * pPool->uBlockSize;
+		}
+		(uIndex > pChunk->uFirstNeverUsed_) ? (pChunk->uFirstNeverUsed_ = uIndex) : 0;
+		pChunk->uFirstAvailable_ = uIndex;
+
+		// If chunk is used out, move it to full chunk list.
+		if (0 == pChunk->uBlocksAvailable_)
+		{
+			UnlinkChunk(&pPool->pPartialChunk, pChunk);
+			LinkChunk(&pPool->pFullChunk, pChunk);
 		}
-		// Insert this chunk at the beginning of list, because it have many available blocks.
-		pAvailableChunk->pNextChunk = pPool->pFirstChunk;
-		pPool->pFirstChunk = pAvailableChunk;
-
-		// Return first block, update chunk index.
-		pBlock = GetFirstBlockFromChunk(pAvailableChunk);
-		pAvailableChunk->uFirstAvailable_ = *(unsigned short *)pBlock;
-		-- pAvailableChunk->uBlocksAvailable_;
 	}
 
-	return pBlock;
+	return uGot;
 }
 
 /**
@@ -185,7 +474,7 @@ void *Malloc(MemoryPool_t *pPool)
  */
 inline void *GetEndOfChunk(MemoryPool_t *pPool, MemoryChunk_t *pChunk)
 {
-	return ((void *)GetFirstBlockFromChunk(pChunk) + pChunk->uBlocks * pPool->uBlockSize);
+	return ((void *)GetFirstBlockFromChunk(pPool, pChunk) + (size_t)pChunk->uBlocks * pPool->uBlockSize);
 }
 
 /**
@@ -199,12 +488,36 @@ inline void *GetEndOfChunk(MemoryPool_t *pPool, MemoryChunk_t *pChunk)
 inline char CheckInChunk(MemoryPool_t *pPool, MemoryChunk_t *pChunk, void *pPtr)
 {
 	char result = 1;
-	result &= ((unsigned long)pPtr >= (unsigned long)GetFirstBlockFromChunk(pChunk));
+	result &= ((unsigned long)pPtr >= (unsigned long)GetFirstBlockFromChunk(pPool, pChunk));
 	result &= ((unsigned long)pPtr < (unsigned long)GetEndOfChunk(pPool, pChunk));
 
 	return result;
 }
 
+/**
+ * @brief Get the chunk which a block is in, chunks are aligned to [uChunkAlign] and no bigger than it,
+ * so clear the low bits of block address is the address of chunk.
+ *
+ * @param pPool The block in which pool.
+ * @param pPtr Address of block.
+ * @return Chunk the block may be in, use CheckInChunk() to make sure of it.
+ */
+inline MemoryChunk_t *GetChunkOfBlock(MemoryPool_t *pPool, void *pPtr)
+{
+	return (MemoryChunk_t *)((unsigned long)pPtr & ~(pPool->uChunkAlign - 1));
+}
+
+/**
+ * @brief Get current time of a monotonic clock in milliseconds, to know how long a chunk is empty.
+ */
+inline uint64 GetTickMs()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
 /**
  * @brief Check all blocks in chunk is available.
  *
@@ -218,64 +531,306 @@ inline char CheckChunkEmpty(MemoryChunk_t *pChunk)
 }
 
 /**
- * @brief Check a chunk is full or not, if full, there is no block is available.
+ * @brief Move a chunk whose blocks are all available to the beginning of empty chunk list, if there are
+ * too many empty chunks, release chunks which are empty for long time to system.
  *
- * @param pChunk Which chunk you want to check.
- * @return If chunk not full, there is available blocks, 1 will be returned, or 0 will be returned.
+ * @param pPool The chunk in which pool.
+ * @param pChunk Chunk just became empty, it is in partial chunk list.
  */
-inline char CheckChunkNotFull(MemoryChunk_t *pChunk)
+inline void RecycleEmptyChunk(MemoryPool_t *pPool, MemoryChunk_t *pChunk)
 {
-	return ((NULL != pChunk) && (0 != pChunk->uBlocksAvailable_));
+	UnlinkChunk(&pPool->pPartialChunk, pChunk);
+	pChunk->uEmptySince_ = (0 != pPool->uReleaseDelayMs) ? GetTickMs() : 0;
+	LinkChunk(&pPool->pEmptyChunk, pChunk);
+	(NULL == pPool->pLastEmptyChunk) ? (pPool->pLastEmptyChunk = pChunk) : 0;
+	++ pPool->uEmptyChunks;
+
+	if (pPool->uEmptyChunks > pPool->uKeepEmptyChunks)
+	{
+		TrimMemoryPool(pPool);
+	}
+}
+
+/**
+ * @brief Check if pool is used by a thread not owning it, so blocks it frees are queued for owner.
+ *
+ * @param pPool Which pool to check.
+ * @return 1 if blocks freed by this thread are queued, 0 if they are given back to chunks directly.
+ */
+inline char IsRemoteThread(MemoryPool_t *pPool)
+{
+	return pPool->bRemoteFree && !pthread_equal(pthread_self(), pPool->owner);
+}
+
+/**
+ * @brief Check if a chunk is in a chunk list.
+ *
+ * @param pList First chunk of list.
+ * @param pChunk Chunk to find.
+ * @return 1 if chunk is in list, 0 if not.
+ */
+inline char FindChunkInList(MemoryChunk_t *pList, MemoryChunk_t *pChunk)
+{
+	while ((NULL != pList) && (pList != pChunk))
+	{
+		pList = pList->pNextChunk;
+	}
+
+	return (NULL != pList);
+}
+
+/**
+ * @brief Check a block given back is in a chunk of pool. With CHECK_FOREIGN_BLOCK, chunk lists of pool are
+ * searched for the chunk first, so that information of chunk is read only if it is a chunk of pool.
+ *
+ * @param pPool Block is given back to which pool.
+ * @param pChunk Chunk the block is masked to.
+ * @param pPtr Address of block.
+ * @return 1 if block is in a chunk of pool, 0 if not.
+ */
+inline char CheckBlockOfPool(MemoryPool_t *pPool, MemoryChunk_t *pChunk, void *pPtr)
+{
+#ifdef CHECK_FOREIGN_BLOCK
+	// Only owner changes chunk lists, block freed by other thread is checked when owner gives it back.
+	if (IsRemoteThread(pPool))
+	{
+		return 1;
+	}
+	if (!FindChunkInList(pPool->pPartialChunk, pChunk) && !FindChunkInList(pPool->pFullChunk, pChunk)
+			&& !FindChunkInList(pPool->pEmptyChunk, pChunk))
+	{
+		return 0;
+	}
+#endif
+	return (pPool == pChunk->pPool) && CheckInChunk(pPool, pChunk, pPtr);
+}
+
+/**
+ * @brief Push blocks linked by their first pointer to blocks freed by other threads, by compare and swap.
+ * They are counted first, so that owner never takes more blocks than counted.
+ *
+ * @param pPool Which pool the blocks in.
+ * @param pFirst The first block of list.
+ * @param pLast The last block of list, the old list is linked after it.
+ * @param uCount Number of blocks in list.
+ */
+inline void PushRemoteFree(MemoryPool_t *pPool, void *pFirst, void *pLast, unsigned int uCount)
+{
+	__atomic_add_fetch(&pPool->uRemoteFrees, uCount, __ATOMIC_RELAXED);
+	void *pHead = __atomic_load_n(&pPool->pRemoteFree, __ATOMIC_RELAXED);
+	do
+	{
+		*(void **)pLast = pHead;
+	}while (!__atomic_compare_exchange_n(&pPool->pRemoteFree, &pHead, pFirst, 1,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
 }
 
 /**
  * @brief Back a memory block to memory pool, if all blocks in a chunk is available, then move it to the
- * first chunk in pool, if the second chunk not full, then release the first chunk to system.
+ * empty chunk list, if there are more than uKeepEmptyChunks empty chunks, then release the chunks which
+ * are empty for longer than uReleaseDelayMs to system. With bRemoteFree, block freed by other thread is
+ * queued for owner without lock.
  *
  * @param pPool Back the memory block to which pool.
  * @param pPtr Which memory block to give back.
  */
 void Free(MemoryPool_t *pPool, void *pPtr)
 {
-	MemoryChunk_t *pChunk = pPool->pFirstChunk;
-	MemoryChunk_t *pPreChunk = NULL;
+	// Chunks are aligned, the block is in the chunk at the aligned address below it.
+	MemoryChunk_t *pChunk = GetChunkOfBlock(pPool, pPtr);
 
-	// Check the block in which chunk.
-	while(pChunk && !CheckInChunk(pPool, pChunk, pPtr))
+	// If memory block not belongs to any chunk of this pool.
+	if (!CheckBlockOfPool(pPool, pChunk, pPtr))
 	{
-		pPreChunk = pChunk;
-		pChunk = pChunk->pNextChunk;
+		PrintWarning("Not found this memory block in pool.");
+		return;
 	}
 
-	// If memory block not belongs to any chunk.
-	if (NULL == pChunk)
+	// Block freed by other thread is queued, owner gives it back to chunk later.
+	if (IsRemoteThread(pPool))
 	{
-		PrintWarning("Not found this memory block in pool.");
+		PushRemoteFree(pPool, pPtr, pPtr, 1);
 		return;
 	}
 
+	// If chunk was full, it will have an available block, move it to partial chunk list.
+	if (0 == pChunk->uBlocksAvailable_)
+	{
+		UnlinkChunk(&pPool->pFullChunk, pChunk);
+		LinkChunk(&pPool->pPartialChunk, pChunk);
+	}
+
 	// Back the memory block to pool.
 	++ pChunk->uBlocksAvailable_;
-	*(unsigned short *)pPtr = pChunk->uFirstAvailable_;
-	pChunk->uFirstAvailable_ = (unsigned short)
-			(((unsigned long)pPtr - (unsigned long)GetFirstBlockFromChunk(pChunk)) / pPool->uBlockSize);
+	*(BlockIndex_t *)pPtr = pChunk->uFirstAvailable_;
+	pChunk->uFirstAvailable_ = (BlockIndex_t)
+			(((unsigned long)pPtr - (unsigned long)GetFirstBlockFromChunk(pPool, pChunk)) / pPool->uBlockSize);
 
-	// Check if chunk is empty, all blocks is available in it, move it to the first chunk, if the second
-	// chunk is not full, then release this chunk to system.
+	// Check if chunk is empty, all blocks is available in it, recycle it.
 	if (CheckChunkEmpty(pChunk))
 	{
-		if (pChunk != pPool->pFirstChunk)
+		RecycleEmptyChunk(pPool, pChunk);
+	}
+}
+
+/**
+ * @brief Give back many memory blocks to their chunks. Blocks following each other in the same chunk are
+ * linked to the chunk in one pass, and chunk lists are updated once for them instead of once for every
+ * block.
+ *
+ * @param pPool Back the memory blocks to which pool.
+ * @param pPtrs Addresses of memory blocks to give back.
+ * @param uCount Number of memory blocks to give back.
+ */
+void BackBlocksToChunks(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	unsigned int i = 0;
+	MemoryChunk_t *pChunk = NULL;
+
+	while (i < uCount)
+	{
+		// If memory block not belongs to any chunk of this pool.
+		pChunk = GetChunkOfBlock(pPool, pPtrs[i]);
+		if (!CheckBlockOfPool(pPool, pChunk, pPtrs[i]))
+		{
+			PrintWarning("Not found this memory block in pool.");
+			++ i;
+			continue;
+		}
+
+		// Link all following blocks of this chunk to its available list.
+		void *pFirstBlock = GetFirstBlockFromChunk(pPool, pChunk);
+		BlockIndex_t uFirstAvailable = pChunk->uFirstAvailable_;
+		BlockIndex_t uBack = 0;
+		for (; (i < uCount) && (GetChunkOfBlock(pPool, pPtrs[i]) == pChunk); ++ i)
+		{
+			if (!CheckInChunk(pPool, pChunk, pPtrs[i]))
+			{
+				PrintWarning("Not found this memory block in pool.");
+				continue;
+			}
+			*(BlockIndex_t *)pPtrs[i] = uFirstAvailable;
+			uFirstAvailable = (BlockIndex_t)
+					(((unsigned long)pPtrs[i] - (unsigned long)pFirstBlock) / pPool->uBlockSize);
+			++ uBack;
+		}
+		if (0 == uBack)
+		{
+			continue;
+		}
+
+		// If chunk was full, it will have available blocks, move it to partial chunk list.
+		if (0 == pChunk->uBlocksAvailable_)
 		{
-			pPreChunk->pNextChunk = pChunk->pNextChunk;
-			pChunk->pNextChunk = pPool->pFirstChunk;
-			pPool->pFirstChunk = pChunk;
+			UnlinkChunk(&pPool->pFullChunk, pChunk);
+			LinkChunk(&pPool->pPartialChunk, pChunk);
 		}
-		if (CheckChunkNotFull(pPool->pFirstChunk->pNextChunk))
+		pChunk->uFirstAvailable_ = uFirstAvailable;
+		pChunk->uBlocksAvailable_ += uBack;
+
+		if (CheckChunkEmpty(pChunk))
 		{
-			pPool->pFirstChunk = pChunk->pNextChunk;
-			free(pChunk);
+			RecycleEmptyChunk(pPool, pChunk);
 		}
 	}
 }
 
+/**
+ * @brief Give back many memory blocks to pool at once. Blocks following each other in the same chunk are
+ * linked to the chunk in one pass, and chunk lists are updated once for them instead of once for every
+ * block, so give back blocks grouped by chunk, such as in the order MallocBatch() allocated them. With
+ * bRemoteFree, blocks freed by other thread are linked together and queued for owner at once.
+ *
+ * @param pPool Back the memory blocks to which pool.
+ * @param pPtrs Addresses of memory blocks to give back.
+ * @param uCount Number of memory blocks to give back.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	if (!IsRemoteThread(pPool))
+	{
+		BackBlocksToChunks(pPool, pPtrs, uCount);
+		return;
+	}
+
+	// Link blocks of this pool together, and queue them by one compare and swap.
+	void *pFirst = NULL;
+	void *pLast = NULL;
+	unsigned int uQueued = 0;
+	MemoryChunk_t *pChunk = NULL;
+	for (unsigned int i=0; i<uCount; ++ i)
+	{
+		pChunk = GetChunkOfBlock(pPool, pPtrs[i]);
+		if (!CheckBlockOfPool(pPool, pChunk, pPtrs[i]))
+		{
+			PrintWarning("Not found this memory block in pool.");
+			continue;
+		}
+		(NULL == pLast) ? (pLast = pPtrs[i]) : (*(void **)pPtrs[i] = pFirst);
+		pFirst = pPtrs[i];
+		++ uQueued;
+	}
+	(NULL != pFirst) ? PushRemoteFree(pPool, pFirst, pLast, uQueued) : (void)0;
+}
+
+/**
+ * @brief Give back blocks freed by other threads to their chunks, only owner of pool can call it. Malloc()
+ * does this when REMOTE_FREE_BATCH blocks are queued or no partial chunk is left, call it to give them back
+ * at once, such as before trimming.
+ *
+ * @param pPool Which pool to reclaim.
+ */
+void ReclaimRemoteFree(MemoryPool_t *pPool)
+{
+	void *pPtrs[REMOTE_FREE_BATCH];
+	unsigned int uCount = 0;
+	unsigned int uReclaimed = 0;
+
+	// Take the whole list at once, so blocks pushed meanwhile wait for next time, and no ABA problem.
+	void *pBlock = __atomic_exchange_n(&pPool->pRemoteFree, NULL, __ATOMIC_ACQUIRE);
+	while (NULL != pBlock)
+	{
+		pPtrs[uCount ++] = pBlock;
+		pBlock = *(void **)pBlock;
+		if ((REMOTE_FREE_BATCH == uCount) || (NULL == pBlock))
+		{
+			BackBlocksToChunks(pPool, pPtrs, uCount);
+			uReclaimed += uCount;
+			uCount = 0;
+		}
+	}
+	// Blocks pushed meanwhile are counted already, keep their count.
+	__atomic_sub_fetch(&pPool->uRemoteFrees, uReclaimed, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Release empty chunks more than uKeepEmptyChunks to system, if they are empty for longer than
+ * uReleaseDelayMs. Free() does this when a chunk becomes empty, with release delay, call it from time to
+ * time to release chunks which expired after that.
+ *
+ * @param pPool Which pool to trim.
+ */
+void TrimMemoryPool(MemoryPool_t *pPool)
+{
+	uint64 uNow = (0 != pPool->uReleaseDelayMs) ? GetTickMs() : 0;
+	MemoryChunk_t *pChunk = NULL;
+
+	// Chunks empty for the longest time are at the end of list, if it is not expired, neither others.
+	while (pPool->uEmptyChunks > pPool->uKeepEmptyChunks)
+	{
+		pChunk = pPool->pLastEmptyChunk;
+		if (uNow - pChunk->uEmptySince_ < pPool->uReleaseDelayMs)
+		{
+			break;
+		}
+
+		pPool->pLastEmptyChunk = pChunk->pPreChunk;
+		UnlinkChunk(&pPool->pEmptyChunk, pChunk);
+		-- pPool->uEmptyChunks;
+		-- pPool->uChunks;
+		pPool->uTotalBlocks -= pChunk->uBlocks;
+		free(pChunk);
+	}
+}
+
 #endif /* ENABLE_FABMemoryPool */
@@ -0,0 +1,166 @@
+/**
+ * @file   FALMemoryPool/ConcurrentPool.c
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Fixed length, Able to recycle, List style memory pool, shared by threads without lock.
+ *   Create and destroy memory pool. Due to frequent use of ConcurrentMalloc() and ConcurrentFree(), they
+ * are inline and defined in ConcurrentPool.h
+ */
+
+// The following macro designed for test purpose only, delete it when using.
+#include "../MemoryPoolTester.h"
+#ifdef ENABLE_FALMemoryPool
+
+#include "ConcurrentPool.h"
+
+// It is not inlined when built with ThreadSanitizer, so it needs an external definition.
+extern inline Node_t *ReadNextOfTop(Node_t *pNode);
+
+/**
+ * @brief Create a empty pool can be shared by threads.
+ *
+ *   Each block in this pool have minimum size of sizeof(union Node), will up to it if smaller than. Pool
+ * keeps idle blocks of MAX_IDLE_BYTES at most, and MIN_IDLE_CAP blocks at least.
+ *
+ * @param uBlockSize Every memory block have this length, maximum length of string with '\0' can be in.
+ * @return Created memory pool, NULL if failed.
+ */
+ConcurrentPool_t *CreateConcurrentPool(unsigned int uBlockSize)
+{
+	ConcurrentPool_t *pPool = NULL;
+	if (0 != posix_memalign((void **)&pPool, sizeof(Top_t), sizeof(ConcurrentPool_t)))
+	{
+		PrintError("Failed to malloc memory pool from system.");
+		return NULL;
+	}
+	pPool->top.top.pNode = NULL;
+	pPool->top.top.uTag = 0;
+	pPool->uBlockSize = uBlockSize > sizeof(Node_t) ? uBlockSize : sizeof(Node_t);
+	pPool->uPushes = 0;
+	pPool->pRetired = NULL;
+	pPool->uIdleCap = MAX_IDLE_BYTES / pPool->uBlockSize;
+	pPool->uIdleCap = (pPool->uIdleCap < MIN_IDLE_CAP) ? MIN_IDLE_CAP : pPool->uIdleCap;
+
+	return pPool;
+}
+
+/**
+ * @brief Free a list of blocks to system.
+ *
+ * @param pNode First block of list.
+ */
+inline void FreeBlockList(Node_t *pNode)
+{
+	Node_t *pPreNode = NULL;
+	while (NULL != pNode)
+	{
+		pPreNode = pNode;
+		pNode = pNode->pNext;
+		free(pPreNode);
+	}
+}
+
+/**
+ * @brief Destroy a memory pool shared by threads, no thread can use it then.
+ *
+ * @param pPoll when finished, this will be NULL.
+ * @note Make sure every address get from this memory pool is released by ConcurrentFree().
+ */
+void DestroyConcurrentPool(ConcurrentPool_t **pPool)
+{
+	assert(NULL != pPool);
+
+	FreeBlockList((*pPool)->top.top.pNode);
+	FreeBlockList((*pPool)->pRetired);
+	free(*pPool);
+	*pPool = NULL;
+}
+
+/**
+ * @brief Free retired blocks to system, call it when no thread uses pool, such as between phases of work.
+ *
+ * @param pPool Which pool to trim.
+ * @note Threads popping at the same time may read retired blocks, so they must not be freed then.
+ */
+void TrimConcurrentPool(ConcurrentPool_t *pPool)
+{
+	FreeBlockList(__atomic_exchange_n(&(pPool->pRetired), NULL, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief Put a list of blocks back to retired blocks. Its last block is not known, so it becomes the whole
+ * retired list if that is empty, otherwise blocks retired meanwhile, which are few mostly, are taken and
+ * linked before it.
+ *
+ * @param pPool Which pool the blocks retired from.
+ * @param pFirst The first block of list.
+ */
+inline void RetireBlockList(ConcurrentPool_t *pPool, Node_t *pFirst)
+{
+	Node_t *pRetired = NULL;
+	Node_t *pLast = NULL;
+	while ((NULL != pFirst) && !__atomic_compare_exchange_n(&(pPool->pRetired), &pRetired, pFirst, 0,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	{
+		pRetired = __atomic_exchange_n(&(pPool->pRetired), NULL, __ATOMIC_ACQUIRE);
+		if (NULL != pRetired)
+		{
+			pLast = pRetired;
+			while (NULL != pLast->pNext)
+			{
+				pLast = pLast->pNext;
+			}
+			pLast->pNext = pFirst;
+			pFirst = pRetired;
+		}
+		pRetired = NULL;
+	}
+}
+
+/**
+ * @brief Get a retired block when stack is empty, and push up to uIdleCap of other retired blocks to stack.
+ *
+ *   All retired blocks are taken by one exchange, so no other thread reads their pNext, and no ABA problem.
+ *
+ * @param pPool Which pool to get from.
+ * @return A retired block, NULL if there is none.
+ */
+void *ReuseRetiredBlocks(ConcurrentPool_t *pPool)
+{
+	Node_t *pNode = __atomic_exchange_n(&(pPool->pRetired), NULL, __ATOMIC_ACQUIRE);
+	if (NULL == pNode)
+	{
+		return NULL;
+	}
+	if (NULL == pNode->pNext)
+	{
+		return &(pNode->data);
+	}
+
+	// Blocks up to uIdleCap after the first one go to stack, if they can be counted, others are retired.
+	Node_t *pFirst = pNode->pNext;
+	Node_t *pLast = pFirst;
+	unsigned int uCount = 1;
+	unsigned int uIdleCap = __atomic_load_n(&(pPool->uIdleCap), __ATOMIC_RELAXED);
+	for (; (uCount < uIdleCap) && (NULL != pLast->pNext); ++ uCount)
+	{
+		pLast = pLast->pNext;
+	}
+	if (CountPushes(pPool, uCount))
+	{
+		Node_t *pRest = pLast->pNext;
+		PushToTop(pPool, pFirst, pLast);
+		RetireBlockList(pPool, pRest);
+	}
+	else
+	{
+		RetireBlockList(pPool, pFirst);
+	}
+
+	return &(pNode->data);
+}
+
+#endif /* ENABLE_FALMemoryPool */
@@ -0,0 +1,258 @@
+/**
+ * @file   FALMemoryPool/ConcurrentPool.h
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Fixed length, Able to recycle, List style memory pool, shared by threads without lock.
+ *
+ *   Idle blocks make up a stack the same as FAL memory pool, but its top is changed by one compare and swap
+ * of two words, pointer of top and a tag, 16 bytes on 64 bits systems and 8 bytes on 32 bits ones. Every
+ * pop adds one to the tag, so if top block was taken and given back by other threads between reading it
+ * and swapping, swap fails though top is the same block again. On x86_64 it is cmpxchg16b, build with
+ * -mcx16, other systems use __atomic builtin if they don't have it, link with -latomic.
+ *
+ *   Tag is number of pops, so ConcurrentMalloc() takes a block by the swap only. ConcurrentFree() counts
+ * pushes in uPushes by atomic add before pushing, idle blocks are uPushes minus tag, if it is more than
+ * uIdleCap, block is not pushed. So pool keeps uIdleCap idle blocks at most in stack. uIdleCap doesn't
+ * adapt as FAL memory pool does, blocks using of all threads are not counted.
+ *
+ *   A thread popping reads pNext of top block, which another thread may have popped just now, swap fails
+ * then since tag changed, so the value read is not used, but the block must still be readable. So blocks
+ * are never freed to system while threads use pool, blocks given back more than uIdleCap are pushed to
+ * pRetired. When stack is empty, ConcurrentMalloc() takes them all by one exchange, uses the first one and
+ * pushes up to uIdleCap of others to stack, so they are used again before allocating from system. They
+ * are freed by TrimConcurrentPool() when no thread uses pool, or by DestroyConcurrentPool().
+ */
+
+#ifndef CONCURRENTPOOL_H_
+#define CONCURRENTPOOL_H_
+
+#include "MemoryPool.h"
+
+/**
+ * @brief Word of pointer and tag, so that they are swapped together, tag has the same bits as pointer.
+ */
+#if __SIZEOF_POINTER__ == 4
+typedef uint64 TopWord_t;
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+#define SYNC_SWAP_TOP_WORD
+#endif
+#else
+typedef unsigned __int128 TopWord_t;
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+#define SYNC_SWAP_TOP_WORD
+#endif
+#endif
+
+/**
+ * @brief Top of idle block stack, pointer and tag are swapped together.
+ */
+typedef union Top
+{
+	struct
+	{
+		Node_t *pNode;          ///< Top block of stack, NULL if no idle block.
+		unsigned long uTag;     ///< Number of pops, so that a block popped and pushed again is found.
+	}top;
+	TopWord_t uWord;            ///< Pointer and tag as a word, to compare and swap.
+}__attribute__((aligned(sizeof(TopWord_t)))) Top_t;
+
+/**
+ * @brief Information about a memory pool shared by threads.
+ */
+typedef struct ConcurrentHead
+{
+	Top_t top;                  ///< Top of idle block stack.
+	unsigned int uBlockSize;    ///< Every memory block have this length, maximum length of string with '\0'.
+	unsigned int uIdleCap;      ///< Number of idle blocks to keep in stack, more are retired, can be changed.
+	unsigned long uPushes;      ///< Number of pushes, idle blocks are it minus tag of top.
+	Node_t *pRetired;           ///< Blocks given back more than uIdleCap, used again when stack is empty.
+}ConcurrentPool_t;
+
+/**
+ * @brief Compare and swap top of stack, pointer and tag together.
+ *
+ * @param pTop Top of stack.
+ * @param oldTop Top expected.
+ * @param newTop Top to set.
+ * @return 1 if swapped, 0 if top is not the expected one.
+ */
+inline char CompareAndSwapTop(Top_t *pTop, Top_t oldTop, Top_t newTop)
+{
+#ifdef SYNC_SWAP_TOP_WORD
+	return __sync_bool_compare_and_swap(&(pTop->uWord), oldTop.uWord, newTop.uWord);
+#else
+	return __atomic_compare_exchange_n(&(pTop->uWord), &(oldTop.uWord), newTop.uWord, 0, __ATOMIC_SEQ_CST,
+			__ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Read next block of top block, which may be popped by another thread and written by its new owner
+ * meanwhile. It is a race ThreadSanitizer reports, but value read is only used if swap finds the block is
+ * still top, and block is never freed while pool is used, so the read is hidden from it, not to bury real
+ * races.
+ *
+ * @param pNode Top block read.
+ * @return Next block of it, maybe wrong if it was popped.
+ */
+#ifdef __SANITIZE_THREAD__
+__attribute__((no_sanitize_thread))
+#endif
+inline Node_t *ReadNextOfTop(Node_t *pNode)
+{
+	return __atomic_load_n(&(pNode->pNext), __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Create a empty pool can be shared by threads.
+ *
+ *   Each block in this pool have minimum size of sizeof(union Node), will up to it if smaller than. Pool
+ * keeps idle blocks of MAX_IDLE_BYTES at most, and MIN_IDLE_CAP blocks at least.
+ *
+ * @param uBlockSize Every memory block have this length, maximum length of string with '\0' can be in.
+ * @return Created memory pool, NULL if failed.
+ */
+ConcurrentPool_t *CreateConcurrentPool(unsigned int uBlockSize);
+
+/**
+ * @brief Destroy a memory pool shared by threads, no thread can use it then.
+ *
+ * @param pPool when finished, this will be NULL.
+ * @note Make sure every address get from this memory pool is released by ConcurrentFree().
+ */
+void DestroyConcurrentPool(ConcurrentPool_t **pPool);
+
+/**
+ * @brief Free retired blocks to system, call it when no thread uses pool, such as between phases of work.
+ *
+ * @param pPool Which pool to trim.
+ * @note Threads popping at the same time may read retired blocks, so they must not be freed then.
+ */
+void TrimConcurrentPool(ConcurrentPool_t *pPool);
+
+/**
+ * @brief Get a retired block when stack is empty, and push up to uIdleCap of other retired blocks to stack.
+ *
+ * @param pPool Which pool to get from.
+ * @return A retired block, NULL if there is none.
+ */
+void *ReuseRetiredBlocks(ConcurrentPool_t *pPool);
+
+/**
+ * @brief Get a block from memory pool, it can be called by threads at the same time.
+ *
+ *   Top block is popped by one compare and swap if no other thread changes stack at the same time.
+ *
+ * @param pPool Which pool to get from.
+ * @return Address of not used memory block, NULL if failed.
+ */
+inline void *ConcurrentMalloc(ConcurrentPool_t *pPool)
+{
+	assert(NULL != pPool);
+	Top_t oldTop, newTop;
+
+	// Tag is read first, if top is changed before its pointer is read, swap fails.
+	oldTop.top.uTag = __atomic_load_n(&(pPool->top.top.uTag), __ATOMIC_ACQUIRE);
+	oldTop.top.pNode = __atomic_load_n(&(pPool->top.top.pNode), __ATOMIC_ACQUIRE);
+	while (NULL != oldTop.top.pNode)
+	{
+		newTop.top.pNode = ReadNextOfTop(oldTop.top.pNode);
+		newTop.top.uTag = oldTop.top.uTag + 1;
+		if (CompareAndSwapTop(&(pPool->top), oldTop, newTop))
+		{
+			return &(oldTop.top.pNode->data);
+		}
+		oldTop.top.uTag = __atomic_load_n(&(pPool->top.top.uTag), __ATOMIC_ACQUIRE);
+		oldTop.top.pNode = __atomic_load_n(&(pPool->top.top.pNode), __ATOMIC_ACQUIRE);
+	}
+
+	void *pPtr = ReuseRetiredBlocks(pPool);
+	pPtr = (NULL != pPtr) ? pPtr : malloc(pPool->uBlockSize);
+	if (NULL == pPtr)
+	{
+		PrintError("Failed to malloc memory from system.");
+		return NULL;
+	}
+
+	return pPtr;
+}
+
+/**
+ * @brief Push a list of blocks to stack, tag is not changed, a block popped again is found by tag of pop.
+ *
+ * @param pPool Which pool to push to.
+ * @param pFirst The first block of list.
+ * @param pLast The last block of list, top is linked after it.
+ */
+inline void PushToTop(ConcurrentPool_t *pPool, Node_t *pFirst, Node_t *pLast)
+{
+	Top_t oldTop, newTop;
+
+	newTop.top.pNode = pFirst;
+	do
+	{
+		oldTop.top.uTag = __atomic_load_n(&(pPool->top.top.uTag), __ATOMIC_ACQUIRE);
+		oldTop.top.pNode = __atomic_load_n(&(pPool->top.top.pNode), __ATOMIC_ACQUIRE);
+		__atomic_store_n(&(pLast->pNext), oldTop.top.pNode, __ATOMIC_RELAXED);
+		newTop.top.uTag = oldTop.top.uTag;
+	}while (!CompareAndSwapTop(&(pPool->top), oldTop, newTop));
+}
+
+/**
+ * @brief Count blocks to push to stack, if idle blocks would be more than uIdleCap, they are not counted.
+ *
+ *   Tag read may be old, which only makes it count more idle blocks. Every pushing counted sees all those
+ * counted before it, so blocks in stack are not more than uIdleCap.
+ *
+ * @param pPool Which pool to push to.
+ * @param uCount Number of blocks to push.
+ * @return 1 if counted and they can be pushed, 0 if not.
+ */
+inline char CountPushes(ConcurrentPool_t *pPool, unsigned int uCount)
+{
+	unsigned long uPushes = __atomic_add_fetch(&(pPool->uPushes), uCount, __ATOMIC_RELAXED);
+	if (uPushes - __atomic_load_n(&(pPool->top.top.uTag), __ATOMIC_RELAXED)
+			> __atomic_load_n(&(pPool->uIdleCap), __ATOMIC_RELAXED))
+	{
+		__atomic_sub_fetch(&(pPool->uPushes), uCount, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Back a memory block to pool, it can be called by threads at the same time.
+ *
+ * @param pPool Which pool to back.
+ * @param pPtr Address of memory block.
+ * @note Make sure memory pool didn't been destroy, if already, it will free this block to system.
+ */
+inline void ConcurrentFree(ConcurrentPool_t *pPool, void *pPtr)
+{
+	Node_t *pFreeNode = (Node_t *)pPtr;
+
+	if (NULL == pPool)
+	{
+		PrintWarning("A ptr will be freed but memory pool already been destroy.");
+		free(pPtr);
+		return;
+	}
+
+	// Blocks more than uIdleCap are retired, threads popping may be reading them.
+	if (!CountPushes(pPool, 1))
+	{
+		do
+		{
+			pFreeNode->pNext = __atomic_load_n(&(pPool->pRetired), __ATOMIC_RELAXED);
+		}while (!__atomic_compare_exchange_n(&(pPool->pRetired), &(pFreeNode->pNext), pFreeNode, 1,
+				__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+		return;
+	}
+	PushToTop(pPool, pFreeNode, pFreeNode);
+}
+
+#endif /* CONCURRENTPOOL_H_ */
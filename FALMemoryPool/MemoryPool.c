@@ -6,8 +6,8 @@
  * @email  WangLiangCN@live.com
  *
  * @brief  Fixed length, Able to recycle, List style memory pool.
- *   Create and destroy memory pool, due to frequent use of Malloc() and Free(), so make it
- * inline and defined in MemoryPool.h
+ *   Create and destroy memory pool, and batch Malloc/Free. Due to frequent use of Malloc() and Free(), they
+ * are inline and defined in MemoryPool.h
  */
 
 // The following macro designed for test purpose only, delete it when using.
@@ -30,6 +30,15 @@ MemoryPool_t *CreateMemoryPool(unsigned int uBlockSize)
 	pHead->uBlockSize = uBlockSize > sizeof(Node_t) ? uBlockSize : sizeof(Node_t);
 	pHead->pFirstAvailable = NULL;
 	pHead->uAvailableNum = 0;
+	pHead->uUsing = 0;
+	pHead->uLowWater = 0;
+	pHead->uHighWater = 0;
+	pHead->uOps = 0;
+	pHead->uMaxIdleBytes = MAX_IDLE_BYTES;
+
+	// Idle blocks are not more than uMaxIdleBytes from the beginning, as AdaptIdleCap() keeps them.
+	size_t uMaxCap = pHead->uMaxIdleBytes / pHead->uBlockSize;
+	pHead->uIdleCap = (MIN_IDLE_CAP > uMaxCap) ? (unsigned int)uMaxCap : MIN_IDLE_CAP;
 
 	return pHead;
 }
@@ -57,4 +66,116 @@ void DestroyMemoryPool(MemoryPool_t **pPool)
 	*pPool = NULL;
 }
 
+/**
+ * @brief Adapt uIdleCap to the range blocks using went up and down since last time, or half of it if that
+ * is bigger, then release idle blocks more than it. Pool calls it by itself, call it to adapt at once, such
+ * as after uMaxIdleBytes is changed.
+ *
+ * @param pPool Which pool to adapt.
+ */
+void AdaptIdleCap(MemoryPool_t *pPool)
+{
+	unsigned int uCap = pPool->uHighWater - pPool->uLowWater;
+	size_t uMaxCap = pPool->uMaxIdleBytes / pPool->uBlockSize;
+	uCap = (uCap > pPool->uIdleCap / 2) ? uCap : (pPool->uIdleCap / 2);
+	uCap = (uCap < MIN_IDLE_CAP) ? MIN_IDLE_CAP : uCap;
+	pPool->uIdleCap = (uCap > uMaxCap) ? (unsigned int)uMaxCap : uCap;
+	pPool->uLowWater = pPool->uUsing;
+	pPool->uHighWater = pPool->uUsing;
+	pPool->uOps = 0;
+
+	// Release idle blocks more than new cap.
+	Node_t *pNode = NULL;
+	while (pPool->uAvailableNum > pPool->uIdleCap)
+	{
+		pNode = pPool->pFirstAvailable;
+		pPool->pFirstAvailable = pNode->pNext;
+		-- pPool->uAvailableNum;
+		free(pNode);
+	}
+}
+
+/**
+ * @brief Get many blocks from memory pool at once, idle blocks are taken from list in one pass and pool
+ * is updated once, if not enough, the rest are allocated from system.
+ *
+ * @param pPool Which pool to get from.
+ * @param pPtrs Where to save addresses of got memory blocks.
+ * @param uCount Number of memory blocks want to get.
+ * @return Number of memory blocks got, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	assert(NULL != pPool);
+	unsigned int uGot = 0;
+	Node_t *pNode = pPool->pFirstAvailable;
+
+	for (; (uGot < uCount) && (NULL != pNode); ++ uGot)
+	{
+		pPtrs[uGot] = &(pNode->data);
+		pNode = pNode->pNext;
+	}
+	pPool->pFirstAvailable = pNode;
+	pPool->uAvailableNum -= uGot;
+
+	for (; uGot < uCount; ++ uGot)
+	{
+		pPtrs[uGot] = malloc(pPool->uBlockSize);
+		if (NULL == pPtrs[uGot])
+		{
+			PrintError("Failed to malloc memory from system.");
+			break;
+		}
+	}
+	CountOps(pPool, pPool->uUsing + uGot, uGot);
+
+	return uGot;
+}
+
+/**
+ * @brief Back many memory blocks to pool at once, they are linked together and joined to list once,
+ * blocks more than uIdleCap idle blocks in pool are released to system.
+ *
+ * @param pPool Which pool to back.
+ * @param pPtrs Addresses of memory blocks.
+ * @param uCount Number of memory blocks.
+ * @note Make sure memory pool didn't been destroy, if already, it will free these blocks to system.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	unsigned int i = 0;
+
+	if (NULL == pPool)
+	{
+		PrintWarning("Ptrs will be freed but memory pool already been destroy.");
+		for (; i < uCount; ++ i)
+		{
+			free(pPtrs[i]);
+		}
+		return;
+	}
+
+	// Only keep blocks until there are uIdleCap idle blocks in pool.
+	unsigned int uKeep = (pPool->uAvailableNum < pPool->uIdleCap)
+			? (pPool->uIdleCap - pPool->uAvailableNum) : 0;
+	uKeep = (uKeep < uCount) ? uKeep : uCount;
+
+	Node_t *pFirstNode = pPool->pFirstAvailable;
+	Node_t *pFreeNode = NULL;
+	for (; i < uKeep; ++ i)
+	{
+		pFreeNode = (Node_t *)pPtrs[i];
+		pFreeNode->pNext = pFirstNode;
+		pFirstNode = pFreeNode;
+	}
+	pPool->pFirstAvailable = pFirstNode;
+	pPool->uAvailableNum += uKeep;
+
+	for (; i < uCount; ++ i)
+	{
+		free(pPtrs[i]);
+	}
+	CountOps(pPool, (pPool->uUsing > uCount) ? (pPool->uUsing - uCount) : 0, uCount);
+}
+
 #endif /* ENABLE_FALMemoryPool */
@@ -39,6 +39,13 @@
  *               |       |                       |       |
  *               |       |                       |       |
  *               +-------+                       +-------+
+ *
+ *   Pool keeps at most uIdleCap idle blocks, others given back are freed to system. uIdleCap adapts to how
+ * pool is used. After ADAPT_EVERY_OPS Malloc()/Free(), and twice the most blocks using, so that blocks using
+ * had time to go up and down, it is set to the range blocks using went up and down, so blocks freed and got
+ * again stay in pool, or to half of it if that is bigger, so an idle pool gives back blocks step by step.
+ * It is not smaller than MIN_IDLE_CAP, but idle blocks never take more than uMaxIdleBytes, even if that
+ * is less than MIN_IDLE_CAP blocks.
  */
 
 #ifndef MEMORYPOOL_H_
@@ -47,9 +54,20 @@
 #include "../CProjectDfn.h"
 
 /**
- * @brief Maximum number of idle block in memory pool, if more than these, release them.
+ * @brief Number of idle blocks pool can keep at least, uIdleCap is not smaller than it, unless uMaxIdleBytes
+ * holds less blocks.
+ */
+#define MIN_IDLE_CAP 64
+
+/**
+ * @brief Number of Malloc()/Free() at least between adapting uIdleCap.
  */
-#define RECYCLE_IF_MORETHAN_BLOCKS 64
+#define ADAPT_EVERY_OPS 4096
+
+/**
+ * @brief Default bytes of idle blocks pool keeps at most, uMaxIdleBytes of pool can be changed after created.
+ */
+#define MAX_IDLE_BYTES (4 * 1024 * 1024)
 
 /**
  * @brief To build a available memory list.
@@ -68,6 +86,12 @@ typedef struct Head
 	unsigned int uBlockSize;    ///< Every memory block have this length, maximum length of string with '\0'.
 	unsigned int uAvailableNum; ///< Number of idle blocks in pool.
 	Node_t *pFirstAvailable;    ///< The first available memory block, if NULL, no available block.
+	unsigned int uIdleCap;      ///< Number of idle blocks to keep, if more, release them.
+	unsigned int uUsing;        ///< Number of blocks using.
+	unsigned int uLowWater;     ///< Fewest blocks using since uIdleCap adapted last time.
+	unsigned int uHighWater;    ///< Most blocks using since uIdleCap adapted last time.
+	unsigned int uOps;          ///< Number of Malloc()/Free() since uIdleCap adapted last time.
+	size_t uMaxIdleBytes;       ///< Bytes of idle blocks pool keeps at most, can be changed.
 }Head_t;
 
 /**
@@ -93,6 +117,34 @@ MemoryPool_t *CreateMemoryPool(unsigned int uBlockSize);
  */
 void DestroyMemoryPool(MemoryPool_t **pPool);
 
+/**
+ * @brief Adapt uIdleCap to the range blocks using went up and down since last time, or half of it if that
+ * is bigger, then release idle blocks more than it. Pool calls it by itself, call it to adapt at once, such
+ * as after uMaxIdleBytes is changed.
+ *
+ * @param pPool Which pool to adapt.
+ */
+void AdaptIdleCap(MemoryPool_t *pPool);
+
+/**
+ * @brief Count blocks got or given back by user, adapt uIdleCap if blocks using had time to go up and down.
+ *
+ * @param pPool Which pool to count.
+ * @param uUsing Number of blocks using now.
+ * @param uCount Number of blocks got or given back.
+ */
+inline void CountOps(MemoryPool_t *pPool, unsigned int uUsing, unsigned int uCount)
+{
+	pPool->uUsing = uUsing;
+	(uUsing > pPool->uHighWater) ? (pPool->uHighWater = uUsing) : 0;
+	(uUsing < pPool->uLowWater) ? (pPool->uLowWater = uUsing) : 0;
+	pPool->uOps += uCount;
+	if ((pPool->uOps >= ADAPT_EVERY_OPS) && ((pPool->uOps / 2) >= pPool->uHighWater))
+	{
+		AdaptIdleCap(pPool);
+	}
+}
+
 /**
  * @brief Get a block from memory pool.
  *
@@ -118,8 +170,10 @@ inline void *Malloc(MemoryPool_t *pPool)
 		if (NULL == pPtr)
 		{
 			PrintError("Failed to malloc memory from system.");
+			return NULL;
 		}
 	}
+	CountOps(pPool, pPool->uUsing + 1, 1);
 
 	return pPtr;
 }
@@ -142,15 +196,41 @@ inline void Free(MemoryPool_t *pPool, void *pPtr)
 		return;
 	}
 
-	if ((pPool->uAvailableNum + 1) > RECYCLE_IF_MORETHAN_BLOCKS)
+	if ((pPool->uAvailableNum + 1) > pPool->uIdleCap)
 	{
 		free(pPtr);
-		return;
+	}
+	else
+	{
+		++ pPool->uAvailableNum;
+		pFreeNode->pNext = pPool->pFirstAvailable;
+		pPool->pFirstAvailable = pFreeNode;
 	}
 
-	++ pPool->uAvailableNum;
-	pFreeNode->pNext = pPool->pFirstAvailable;
-	pPool->pFirstAvailable = pFreeNode;
+	// Block got from system by user, not from pool, can be given back too, blocks using don't wrap.
+	CountOps(pPool, (0 != pPool->uUsing) ? (pPool->uUsing - 1) : 0, 1);
 }
 
+/**
+ * @brief Get many blocks from memory pool at once, idle blocks are taken from list in one pass and pool
+ * is updated once, if not enough, the rest are allocated from system.
+ *
+ * @param pPool Which pool to get from.
+ * @param pPtrs Where to save addresses of got memory blocks.
+ * @param uCount Number of memory blocks want to get.
+ * @return Number of memory blocks got, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
+/**
+ * @brief Back many memory blocks to pool at once, they are linked together and joined to list once,
+ * blocks more than uIdleCap idle blocks in pool are released to system.
+ *
+ * @param pPool Which pool to back.
+ * @param pPtrs Addresses of memory blocks.
+ * @param uCount Number of memory blocks.
+ * @note Make sure memory pool didn't been destroy, if already, it will free these blocks to system.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
 #endif /* MEMORYPOOL_H_ */
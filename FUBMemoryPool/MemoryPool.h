@@ -17,12 +17,12 @@
  * +-----------------+   |  |   +-----------------+   |  |   +-----------------+    |
  * |uGrowChunkBlocks |   |  |   |     uBlocks     |   |  |   |     uBlocks     |    |
  * +-----------------+   |  |   +-----------------+   |  |   +-----------------+    |
- * |   pFirstChunk   | ---  |   |    pNextChunk   | ---  |   |    pNextChunk   |  ---
+ * |  pPartialChunk  | ---  |   |    pNextChunk   | ---  |   |    pNextChunk   |  ---
  * +-----------------+      |   +-----------------+      |   +-----------------+
- *                          |   |ThisBlockIsUsingN|      |   |ThisBlockIsUsingN|
- *                          |   +-----------------+      |   +-----------------+
- *                          |   |ThisBlockIsUsingN|      --> |I|   Block[x]    | ---
- *                          |   +-----------------+          +-----------------+   |
+ * |   pFullChunk    |      |   |ThisBlockIsUsingN|      |   |ThisBlockIsUsingN|
+ * +-----------------+      |   +-----------------+      |   +-----------------+
+ * |   pEmptyChunk   |      |   |ThisBlockIsUsingN|      --> |I|   Block[x]    | ---
+ * +-----------------+      |   +-----------------+          +-----------------+   |
  *                          --> |I|   Block[m]    | ---  --> |I|   Block[x+1]  |   |
  *                              +-----------------+   |  |   +-----------------+   |
  *                              |ThisBlockIsUsingN|   |  |   |ThisBlockIsUsingN|   |
@@ -35,6 +35,21 @@
  *                              +-----------------+
  *                              |ThisBlockIsUsingN|
  *                              +-----------------+
+ *
+ * Chunks are kept in three lists as slab allocator does, pPartialChunk lists chunks which have both using
+ * and available blocks, pFullChunk lists chunks without available blocks, and pEmptyChunk lists chunks
+ * whose blocks are all available. A chunk moves between lists when uBlocksAvailable_ reaches 0 or uBlocks,
+ * so Malloc() always gets block from the first partial chunk without searching.
+ *
+ * Every chunk is allocated at an address aligned to uChunkAlign, which is a power of two not smaller than
+ * the biggest chunk of the pool, so the chunk owning a block is found by masking the block address. Small
+ * chunks are aligned as the biggest one too, and reserve up to uChunkAlign of address space each, so chunks
+ * growing by GROW_GEOMETRIC or GROW_CALLBACK are not made bigger than MAX_CHUNK_ALIGN, only first chunk and
+ * uGrowChunkBlocks given by user can be bigger than it.
+ *
+ * Blocks are aligned to uBlockAlign given by MemoryPoolConfig_t: chunk information is padded to it and block
+ * size is rounded up to multiple of it, so with 64 blocks never share cache line, with 4096 every block
+ * starts at a page.
  */
 
 #ifndef MEMORYPOOL_H_
@@ -44,37 +59,134 @@
 #include <limits.h>
 
 /**
- * @brief Max length of string pool can allocate, if bigger than this when creating, down to this size.
+ * @brief Use compact 16 bits chunk layout, chunk information is smaller, but a chunk can't have more than
+ * USHRT_MAX blocks and block size can't be bigger than USHRT_MAX, it is only suitable for small chunks.
+ * If not defined, 32 bits layout is used, so that a chunk can have millions of blocks.
+ */
+//#define COMPACT_CHUNK_LAYOUT
+
+/**
+ * @brief Type of block index, block size and number of blocks, decided by chunk layout.
  */
+#ifdef COMPACT_CHUNK_LAYOUT
+typedef unsigned short BlockIndex_t;
 #ifndef USHRT_MAX
 #define USHRT_MAX 65535
 #endif
-#define MAX_STRING_LEN USHRT_MAX
+#define MAX_BLOCK_INDEX USHRT_MAX
+#else
+typedef unsigned int BlockIndex_t;
+#ifndef UINT_MAX
+#define UINT_MAX 4294967295U
+#endif
+#define MAX_BLOCK_INDEX UINT_MAX
+#endif
+
+/**
+ * @brief Max length of string pool can allocate, if bigger than this when creating, down to this size.
+ */
+#define MAX_STRING_LEN MAX_BLOCK_INDEX
+
+/**
+ * @brief By default, chunks growing by GROW_GEOMETRIC or GROW_CALLBACK have uGrowChunkBlocks shifted left
+ * by this at most, so that number of chunks is logarithmic in peak using blocks until then.
+ */
+#define DEFAULT_MAX_CHUNK_SHIFT 6
+
+/**
+ * @brief Chunks growing by GROW_GEOMETRIC or GROW_CALLBACK are not bigger than this, so that alignment of
+ * chunks, which every chunk reserves, is bounded.
+ */
+#ifndef MAX_CHUNK_ALIGN
+#define MAX_CHUNK_ALIGN (4 * 1024 * 1024)
+#endif
+
+/**
+ * @brief Define it when compiling, such as for debug builds, so that Free() and FreeBatch() search chunk
+ * lists of pool for the chunk a block is masked to before reading it, then a block not got from pool is
+ * only warned. Without it, giving back such a block is undefined behaviour.
+ */
+//#define CHECK_FOREIGN_BLOCK
 
 /**
  * @brief Memory chunk information, a chunk includes many blocks, every allocation operation from memory
  * pool will return a block, many chunks make up a list, when there is no available blocks in all chunk,
  * needs to create a new chunk. In this pool, blocks is following this chunk structure, so we can compute
- * address of first block by address of chunk. The first sizeof(unsigned short) bytes saves the index of
- * next available block index, by index we can compute the address of block.
+ * address of first block by address of chunk. The first sizeof(BlockIndex_t) bytes saves the index of
+ * next available block index, by index we can compute the address of block. Blocks from index
+ * uFirstNeverUsed_ to the end are never used and don't save index, when the idle index reaches
+ * uFirstNeverUsed_, the next available block is the one following it, so new chunk needn't be initialized.
  */
 typedef struct MemoryChunk
 {
-	unsigned short uBlocksAvailable_;  ///< How many blocks available in this chunk.
-	unsigned short uFirstAvailable_;   ///< The index of first available chunk.
-	unsigned short uBlocks;            ///< Total size of blocks in this chunk, related to number of blocks.
+	BlockIndex_t uBlocksAvailable_;    ///< How many blocks available in this chunk.
+	BlockIndex_t uFirstAvailable_;     ///< The index of first available chunk.
+	BlockIndex_t uBlocks;              ///< Total size of blocks in this chunk, related to number of blocks.
+	BlockIndex_t uFirstNeverUsed_;     ///< Index of first block never used, all blocks after it are unused.
+	struct MemoryPool *pPool;          ///< Pool this chunk belongs to, to check block given back by Free().
 	struct MemoryChunk *pNextChunk;    ///< Pointer to next chunk, this make up a chunk list.
+	struct MemoryChunk *pPreChunk;     ///< Pointer to previous chunk, to unlink chunk without search.
 }MemoryChunk_t;
 
+/**
+ * @brief Policy to decide how many blocks a new chunk have when all blocks in pool used out.
+ */
+typedef enum GrowPolicy
+{
+	GROW_FIXED = 0,       ///< Every new chunk have uGrowChunkBlocks blocks.
+	GROW_GEOMETRIC,       ///< Every new chunk makes pool fGrowFactor times bigger, up to uMaxChunkBlocks.
+	GROW_CALLBACK         ///< Number of blocks in new chunk is returned by pGrowCallback, up to uMaxChunkBlocks.
+}GrowPolicy_t;
+
+struct MemoryPool;
+
+/**
+ * @brief User defined callback to decide how many blocks a new chunk have, return 0 to forbidden to grow.
+ *
+ * @param pPool Which pool needs to grow, uChunks and uTotalBlocks tell how big it is now.
+ * @param pArg User argument given when creating pool.
+ */
+typedef BlockIndex_t (*GrowCallback_t)(const struct MemoryPool *pPool, void *pArg);
+
+/**
+ * @brief Options to create memory pool, fill it by InitMemoryPoolConfig() first, then change the options
+ * want to use.
+ */
+typedef struct MemoryPoolConfig
+{
+	BlockIndex_t uBlockSize;           ///< Size of each block in pool.
+	BlockIndex_t uBlockAlign;          ///< Alignment of every block, power of two, such as 16, 64 or 4096.
+	BlockIndex_t uFirstChunkBlocks;    ///< Number of blocks in first chunk.
+	BlockIndex_t uGrowChunkBlocks;     ///< Blocks of new chunk, minimum for GROW_GEOMETRIC, 0 forbidden to grow.
+	GrowPolicy_t eGrowPolicy;          ///< How to decide blocks of new chunk, GROW_FIXED by default.
+	float fGrowFactor;                 ///< For GROW_GEOMETRIC, pool is this times bigger after growing.
+	BlockIndex_t uMaxChunkBlocks;      ///< For GROW_GEOMETRIC and GROW_CALLBACK, maximum blocks of a chunk,
+	                                   ///< lowered to fit in MAX_CHUNK_ALIGN.
+	GrowCallback_t pGrowCallback;      ///< For GROW_CALLBACK, decide blocks of new chunk.
+	void *pGrowArg;                    ///< For GROW_CALLBACK, argument given to pGrowCallback.
+}MemoryPoolConfig_t;
+
 /**
  * @brief Information of memory pool.
  */
 typedef struct MemoryPool
 {
-	unsigned short uBlockSize;         ///< Size of each block in pool.
-	unsigned short uFirstChunkBlocks;  ///< Number of blocks in first chunk.
-	unsigned short uGrowChunkBlocks;   ///< When first chunk is full, extend a new chunk have such blocks.
-	MemoryChunk_t *pFirstChunk;        ///< Pointer to first chunk.
+	BlockIndex_t uBlockSize;           ///< Size of each block in pool, multiple of uBlockAlign.
+	BlockIndex_t uBlockAlign;          ///< Alignment of every block, power of two.
+	size_t uBlockOffset;               ///< Offset of first block in chunk, chunk information is padded to it.
+	BlockIndex_t uFirstChunkBlocks;    ///< Number of blocks in first chunk.
+	BlockIndex_t uGrowChunkBlocks;     ///< When first chunk is full, extend a new chunk have such blocks.
+	GrowPolicy_t eGrowPolicy;          ///< How to decide blocks of new chunk.
+	float fGrowFactor;                 ///< For GROW_GEOMETRIC, pool is this times bigger after growing.
+	BlockIndex_t uMaxChunkBlocks;      ///< For GROW_GEOMETRIC and GROW_CALLBACK, maximum blocks of a chunk.
+	GrowCallback_t pGrowCallback;      ///< For GROW_CALLBACK, decide blocks of new chunk.
+	void *pGrowArg;                    ///< For GROW_CALLBACK, argument given to pGrowCallback.
+	size_t uChunks;                    ///< Number of chunks in pool.
+	size_t uTotalBlocks;               ///< Number of blocks in all chunks.
+	size_t uChunkAlign;                ///< Alignment of every chunk, power of two, bigger than any chunk.
+	MemoryChunk_t *pPartialChunk;      ///< List of chunks have both using and available blocks.
+	MemoryChunk_t *pFullChunk;         ///< List of chunks have no available blocks.
+	MemoryChunk_t *pEmptyChunk;        ///< List of chunks whose blocks are all available.
 }MemoryPool_t;
 
 /**
@@ -92,8 +204,29 @@ typedef struct MemoryPool
  * _uGrowChunkBlocks sets to number of maximum memory block using when running.
  * @return Created memory pool, NULL if failed to allocate memory from system.
  */
-extern MemoryPool_t *CreateMemoryPool(unsigned short _uBlockSize, unsigned short _uFirstChunkBlocks,
-		                       unsigned short _uGrowChunkBlocks);
+extern MemoryPool_t *CreateMemoryPool(BlockIndex_t _uBlockSize, BlockIndex_t _uFirstChunkBlocks,
+		                       BlockIndex_t _uGrowChunkBlocks);
+
+/**
+ * @brief Fill options to create memory pool with default value, it grows [_uGrowChunkBlocks] every time
+ * as CreateMemoryPool() does.
+ *
+ * @param pConfig Options to fill.
+ * @param _uBlockSize, _uFirstChunkBlocks, _uGrowChunkBlocks Same as CreateMemoryPool().
+ */
+extern void InitMemoryPoolConfig(MemoryPoolConfig_t *pConfig, BlockIndex_t _uBlockSize,
+		                         BlockIndex_t _uFirstChunkBlocks, BlockIndex_t _uGrowChunkBlocks);
+
+/**
+ * @brief Create memory pool by options, so that it can grow by different policy.
+ *
+ *   With GROW_GEOMETRIC, new chunk have (fGrowFactor - 1) times of blocks already in pool, at least
+ * uGrowChunkBlocks and at most uMaxChunkBlocks, so number of chunks is logarithmic in peak using blocks.
+ *
+ * @param pConfig Options of pool, initialized by InitMemoryPoolConfig().
+ * @return Created memory pool, NULL if failed to allocate memory from system.
+ */
+extern MemoryPool_t *CreateMemoryPoolWithConfig(const MemoryPoolConfig_t *pConfig);
 
 /**
  * @brief Destroy memory pool.
@@ -114,7 +247,32 @@ extern void *Malloc(MemoryPool_t *pPool);
 
 /**
  * @brief Back a memory block to memory pool.
+ *
+ * @param pPool Back the memory block to which pool.
+ * @param pPtr Which memory block to give back, it must be got from this pool, see CHECK_FOREIGN_BLOCK.
  */
 extern void Free(MemoryPool_t *pPool, void *pPtr);
 
+/**
+ * @brief Allocate many memory blocks from pool at once, blocks are taken from a chunk in one pass, and
+ * chunk lists are updated once for every chunk instead of once for every block.
+ *
+ * @param pPool Get memory blocks from which pool.
+ * @param pPtrs Where to save addresses of allocated memory blocks.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if pool can't grow any more.
+ */
+extern unsigned int MallocBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
+/**
+ * @brief Give back many memory blocks to pool at once. Blocks following each other in the same chunk are
+ * linked to the chunk in one pass, and chunk lists are updated once for them instead of once for every
+ * block, so give back blocks grouped by chunk, such as in the order MallocBatch() allocated them.
+ *
+ * @param pPool Back the memory blocks to which pool.
+ * @param pPtrs Addresses of memory blocks to give back, they must be got from this pool.
+ * @param uCount Number of memory blocks to give back.
+ */
+extern void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
 #endif /* MEMORYPOOL_H_ */
@@ -6,8 +6,8 @@
  * @email  WangLiangCN@live.com
  *
  * @brief  Fixed length, Unable to recycle, List style memory pool.
- *   Create and destroy memory pool, due to frequent use of Malloc() and Free(), so make it
- * inline and defined in MemoryPool.h
+ *   Create and destroy memory pool, and batch Malloc/Free. Due to frequent use of Malloc() and Free(), they
+ * are inline and defined in MemoryPool.h
  */
 
 // The following macro designed for test purpose only, delete it when using.
@@ -56,4 +56,72 @@ void DestroyMemoryPool(MemoryPool_t **pPool)
 	*pPool = NULL;
 }
 
+/**
+ * @brief Get many blocks from memory pool at once, idle blocks are taken from list in one pass and pool
+ * is updated once, if not enough, the rest are allocated from system.
+ *
+ * @param pPool Which pool to get from.
+ * @param pPtrs Where to save addresses of got memory blocks.
+ * @param uCount Number of memory blocks want to get.
+ * @return Number of memory blocks got, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	assert(NULL != pPool);
+	unsigned int uGot = 0;
+	Node_t *pNode = pPool->pFirstAvailable;
+
+	for (; (uGot < uCount) && (NULL != pNode); ++ uGot)
+	{
+		pPtrs[uGot] = &(pNode->data);
+		pNode = pNode->pNext;
+	}
+	pPool->pFirstAvailable = pNode;
+
+	for (; uGot < uCount; ++ uGot)
+	{
+		pPtrs[uGot] = malloc(pPool->uBlockSize);
+		if (NULL == pPtrs[uGot])
+		{
+			PrintError("Failed to malloc memory from system.");
+			break;
+		}
+	}
+
+	return uGot;
+}
+
+/**
+ * @brief Back many memory blocks to pool at once, they are linked together and joined to list once.
+ *
+ * @param pPool Which pool to back.
+ * @param pPtrs Addresses of memory blocks.
+ * @param uCount Number of memory blocks.
+ * @note Make sure memory pool didn't been destroy, if already, it will free these blocks to system.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	unsigned int i = 0;
+
+	if (NULL == pPool)
+	{
+		PrintWarning("Ptrs will be freed but memory pool already been destroy.");
+		for (; i < uCount; ++ i)
+		{
+			free(pPtrs[i]);
+		}
+		return;
+	}
+
+	Node_t *pFirstNode = pPool->pFirstAvailable;
+	Node_t *pFreeNode = NULL;
+	for (; i < uCount; ++ i)
+	{
+		pFreeNode = (Node_t *)pPtrs[i];
+		pFreeNode->pNext = pFirstNode;
+		pFirstNode = pFreeNode;
+	}
+	pPool->pFirstAvailable = pFirstNode;
+}
+
 #endif /* ENABLE_FULMemoryPool */
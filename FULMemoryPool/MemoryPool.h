@@ -139,4 +139,25 @@ inline void Free(MemoryPool_t *pPool, void *pPtr)
 	pPool->pFirstAvailable = pFreeNode;
 }
 
+/**
+ * @brief Get many blocks from memory pool at once, idle blocks are taken from list in one pass and pool
+ * is updated once, if not enough, the rest are allocated from system.
+ *
+ * @param pPool Which pool to get from.
+ * @param pPtrs Where to save addresses of got memory blocks.
+ * @param uCount Number of memory blocks want to get.
+ * @return Number of memory blocks got, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
+/**
+ * @brief Back many memory blocks to pool at once, they are linked together and joined to list once.
+ *
+ * @param pPool Which pool to back.
+ * @param pPtrs Addresses of memory blocks.
+ * @param uCount Number of memory blocks.
+ * @note Make sure memory pool didn't been destroy, if already, it will free these blocks to system.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
 #endif /* MEMORYPOOL_H_ */
@@ -0,0 +1,448 @@
+/**
+ * @file   MemoryPoolBenchmark.c
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Benchmark memory pools used by threads at the same time, against system malloc/free.
+ *
+ *   Three workloads run with 1, 2, 4 ... threads sharing one allocator:
+ *   - Independent threads, every thread allocates a batch of blocks and frees them itself.
+ *   - Producer/consumer handoff, every thread allocates blocks and passes them to the next thread by a
+ * queue, and frees blocks passed from the thread before it.
+ *   - Larson style, every thread keeps BENCH_LIVE_BLOCKS blocks and replaces a random one each time, so
+ * blocks live for random time. In the second half, threads take over blocks of the next thread, so blocks
+ * outlive threads allocated them.
+ *
+ *   Operations are Malloc and Free both, scaling efficiency is operations per second of N threads divided
+ * by N times of it of one thread.
+ */
+
+#include "MemoryPoolTester.h"
+#include <limits.h>
+#include <sched.h>
+
+/**
+ * @brief Blocks a thread allocates before freeing them in independent workload.
+ */
+#define BENCH_BATCH 64
+
+/**
+ * @brief Blocks a handoff queue can keep, must be 2^n.
+ */
+#define BENCH_QUEUE_SIZE 256
+
+/**
+ * @brief Size of cache line, queues are aligned to it, so that threads don't write the same line.
+ */
+#define BENCH_CACHE_LINE 64
+
+/**
+ * @brief Workloads of benchmark.
+ */
+typedef enum BenchWorkload
+{
+	BENCH_INDEPENDENT = 0,      ///< Every thread frees blocks it allocated.
+	BENCH_HANDOFF,              ///< Every thread frees blocks allocated by the thread before it.
+	BENCH_LARSON,               ///< Blocks live for random time, and half of them are freed by other thread.
+	BENCH_WORKLOADS             ///< Number of workloads.
+}BenchWorkload_t;
+
+/**
+ * @brief Names of workloads printed in report.
+ */
+const char *g_pWorkloadNames[BENCH_WORKLOADS] = {"independent threads", "producer/consumer handoff",
+		"Larson random lifetime"};
+
+/**
+ * @brief Queue passing blocks from a thread to the next one, only one thread pushes and one pops.
+ */
+typedef struct BenchQueue
+{
+	void *pBlocks[BENCH_QUEUE_SIZE];    ///< Blocks passed.
+	unsigned long uHead;                ///< Number of blocks popped, only changed by thread pops.
+	unsigned long uTail;                ///< Number of blocks pushed, only changed by thread pushes.
+}__attribute__((aligned(BENCH_CACHE_LINE))) BenchQueue_t;
+
+/**
+ * @brief A run of workload, shared by its threads.
+ */
+typedef struct BenchRun
+{
+	const BenchAllocator_t *pAllocator; ///< Allocator benchmarked.
+	void *pHandle;                      ///< Created by allocator, given to its functions.
+	BenchWorkload_t eWorkload;          ///< Workload to run.
+	unsigned int uThreads;              ///< Number of threads.
+	char bFixedLen;                     ///< Allocate MALLOC_MAX_LEN every time if 1.
+	char bAborted;                      ///< Not all threads are created, created ones quit at once if 1.
+	pthread_mutex_t gate;               ///< Held by main while creating threads, they take it first.
+	pthread_barrier_t start;            ///< Threads and main wait here twice, timing starts between.
+	pthread_barrier_t round;            ///< Threads wait here between rounds of Larson workload.
+	BenchQueue_t *pQueues;              ///< Queue of every thread, for handoff workload.
+	void **pSlots;                      ///< BENCH_LIVE_BLOCKS blocks of every thread, for Larson workload.
+}BenchRun_t;
+
+/**
+ * @brief A thread of run.
+ */
+typedef struct BenchThread
+{
+	BenchRun_t *pRun;                   ///< Run this thread in.
+	unsigned int uId;                   ///< Index of thread, from 0.
+	pthread_t thread;                   ///< Thread id.
+}BenchThread_t;
+
+/**
+ * @brief Allocate from system by malloc().
+ */
+void *SystemBenchMalloc(void *pAllocator, size_t uSize)
+{
+	return malloc(uSize);
+}
+
+/**
+ * @brief Free to system by free().
+ */
+void SystemBenchFree(void *pAllocator, void *pPtr)
+{
+	free(pPtr);
+}
+
+/**
+ * @brief System malloc/free, every allocator is compared with it.
+ */
+const BenchAllocator_t g_systemAllocator = {"system malloc/free", NULL, NULL, SystemBenchMalloc,
+		SystemBenchFree};
+
+/**
+ * @brief Put a memory pool behind a lock, so that threads can share it.
+ *
+ * @param pPool Memory pool to share, NULL if failed to create it.
+ * @return Pool behind lock, NULL if failed.
+ */
+LockedPool_t *CreateLockedPool(void *pPool)
+{
+	if (NULL == pPool)
+	{
+		return NULL;
+	}
+	LockedPool_t *pLockedPool = (LockedPool_t *)malloc(sizeof(LockedPool_t));
+	if (NULL == pLockedPool)
+	{
+		PrintError("Failed to malloc memory from system.");
+		return NULL;
+	}
+	pLockedPool->pPool = pPool;
+	pthread_mutex_init(&(pLockedPool->lock), NULL);
+
+	return pLockedPool;
+}
+
+/**
+ * @brief Destroy lock of a pool put behind it by CreateLockedPool(), the pool itself is destroyed by caller.
+ *
+ * @param pLockedPool Pool behind lock.
+ */
+void DestroyLockedPool(LockedPool_t *pLockedPool)
+{
+	pthread_mutex_destroy(&(pLockedPool->lock));
+	free(pLockedPool);
+}
+
+/**
+ * @brief Get length of next block to allocate.
+ *
+ * @param pRun Which run the block in.
+ * @param pSeed Random seed of thread.
+ * @return Length of block.
+ */
+inline size_t GetBenchSize(BenchRun_t *pRun, unsigned int *pSeed)
+{
+	return pRun->bFixedLen ? MALLOC_MAX_LEN : ((size_t)rand_r(pSeed) % MALLOC_MAX_LEN + 1);
+}
+
+/**
+ * @brief Allocate a block and write it, so that its memory is really used.
+ *
+ * @param pRun Which run the block in.
+ * @param pSeed Random seed of thread.
+ * @return Allocated block, exit if failed, so that failed allocator is not timed.
+ */
+inline void *BenchMalloc(BenchRun_t *pRun, unsigned int *pSeed)
+{
+	char *pPtr = (char *)pRun->pAllocator->pMalloc(pRun->pHandle, GetBenchSize(pRun, pSeed));
+	if (NULL == pPtr)
+	{
+		PrintError("Failed to allocate memory in benchmark.");
+		exit(-1);
+	}
+	*pPtr = '\0';
+
+	return pPtr;
+}
+
+/**
+ * @brief Every thread allocates a batch of blocks, then frees them itself.
+ */
+void RunIndependent(BenchRun_t *pRun, unsigned int uId, unsigned int *pSeed)
+{
+	void *pBlocks[BENCH_BATCH];
+	for (unsigned int i=0; i<BENCH_OPS_PER_THREAD / BENCH_BATCH; ++ i)
+	{
+		for (unsigned int j=0; j<BENCH_BATCH; ++ j)
+		{
+			pBlocks[j] = BenchMalloc(pRun, pSeed);
+		}
+		for (unsigned int j=0; j<BENCH_BATCH; ++ j)
+		{
+			pRun->pAllocator->pFree(pRun->pHandle, pBlocks[j]);
+		}
+	}
+}
+
+/**
+ * @brief Every thread pushes blocks it allocates to its queue, and frees blocks popped from queue of the
+ * thread before it, it yields CPU if it can do neither.
+ */
+void RunHandoff(BenchRun_t *pRun, unsigned int uId, unsigned int *pSeed)
+{
+	BenchQueue_t *pOut = &(pRun->pQueues[uId]);
+	BenchQueue_t *pIn = &(pRun->pQueues[(uId + pRun->uThreads - 1) % pRun->uThreads]);
+	unsigned long uMade = 0;
+	unsigned long uFreed = 0;
+	char bMoved = 0;
+
+	while ((uMade < BENCH_OPS_PER_THREAD) || (uFreed < BENCH_OPS_PER_THREAD))
+	{
+		bMoved = 0;
+		if ((uMade < BENCH_OPS_PER_THREAD)
+				&& (pOut->uTail - __atomic_load_n(&(pOut->uHead), __ATOMIC_ACQUIRE) < BENCH_QUEUE_SIZE))
+		{
+			pOut->pBlocks[pOut->uTail & (BENCH_QUEUE_SIZE - 1)] = BenchMalloc(pRun, pSeed);
+			__atomic_store_n(&(pOut->uTail), pOut->uTail + 1, __ATOMIC_RELEASE);
+			++ uMade;
+			bMoved = 1;
+		}
+		if ((uFreed < BENCH_OPS_PER_THREAD)
+				&& (__atomic_load_n(&(pIn->uTail), __ATOMIC_ACQUIRE) != pIn->uHead))
+		{
+			void *pPtr = pIn->pBlocks[pIn->uHead & (BENCH_QUEUE_SIZE - 1)];
+			__atomic_store_n(&(pIn->uHead), pIn->uHead + 1, __ATOMIC_RELEASE);
+			pRun->pAllocator->pFree(pRun->pHandle, pPtr);
+			++ uFreed;
+			bMoved = 1;
+		}
+		(!bMoved) ? sched_yield() : 0;
+	}
+}
+
+/**
+ * @brief Every thread replaces a random block of its slots, in the second round it replaces blocks of
+ * the next thread, which are allocated by that thread.
+ */
+void RunLarson(BenchRun_t *pRun, unsigned int uId, unsigned int *pSeed)
+{
+	for (unsigned int uRound=0; uRound<2; ++ uRound)
+	{
+		void **pSlots = pRun->pSlots + (size_t)((uId + uRound) % pRun->uThreads) * BENCH_LIVE_BLOCKS;
+		unsigned int uSlot = 0;
+		for (unsigned int i=0; i<BENCH_OPS_PER_THREAD / 2; ++ i)
+		{
+			uSlot = (unsigned int)rand_r(pSeed) % BENCH_LIVE_BLOCKS;
+			pRun->pAllocator->pFree(pRun->pHandle, pSlots[uSlot]);
+			pSlots[uSlot] = BenchMalloc(pRun, pSeed);
+		}
+		(0 == uRound) ? pthread_barrier_wait(&(pRun->round)) : 0;
+	}
+}
+
+/**
+ * @brief Thread of run, it prepares blocks of Larson workload before timing starts.
+ *
+ * @param pArg BenchThread_t of this thread.
+ */
+void *BenchThreadMain(void *pArg)
+{
+	BenchThread_t *pThread = (BenchThread_t *)pArg;
+	BenchRun_t *pRun = pThread->pRun;
+	unsigned int uSeed = pThread->uId * 2654435761U + 1;
+
+	// Main thread holds gate until all threads are created, if it failed to create some, others quit here.
+	pthread_mutex_lock(&(pRun->gate));
+	pthread_mutex_unlock(&(pRun->gate));
+	if (pRun->bAborted)
+	{
+		return NULL;
+	}
+
+	if (BENCH_LARSON == pRun->eWorkload)
+	{
+		for (unsigned int i=0; i<BENCH_LIVE_BLOCKS; ++ i)
+		{
+			pRun->pSlots[(size_t)pThread->uId * BENCH_LIVE_BLOCKS + i] = BenchMalloc(pRun, &uSeed);
+		}
+	}
+
+	// Main thread starts timing after all threads are ready, and before any of them goes on.
+	pthread_barrier_wait(&(pRun->start));
+	pthread_barrier_wait(&(pRun->start));
+	switch (pRun->eWorkload)
+	{
+	case BENCH_INDEPENDENT:
+		RunIndependent(pRun, pThread->uId, &uSeed);
+		break;
+	case BENCH_HANDOFF:
+		RunHandoff(pRun, pThread->uId, &uSeed);
+		break;
+	default:
+		RunLarson(pRun, pThread->uId, &uSeed);
+		break;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Run a workload with threads sharing an allocator.
+ *
+ * @param pAllocator Allocator to benchmark.
+ * @param eWorkload Workload to run.
+ * @param uThreads Number of threads.
+ * @param bFixedLen Allocate MALLOC_MAX_LEN every time if 1, random length up to it if 0.
+ * @return Malloc and Free operations per second, 0 if failed.
+ */
+double RunWorkload(const BenchAllocator_t *pAllocator, BenchWorkload_t eWorkload, unsigned int uThreads,
+		char bFixedLen)
+{
+	BenchRun_t run = {pAllocator, NULL, eWorkload, uThreads, bFixedLen};
+	BenchThread_t *pThreads = (BenchThread_t *)malloc(sizeof(BenchThread_t) * uThreads);
+	run.pSlots = (void **)malloc(sizeof(void *) * BENCH_LIVE_BLOCKS * uThreads);
+	if ((0 != posix_memalign((void **)&run.pQueues, BENCH_CACHE_LINE, sizeof(BenchQueue_t) * uThreads))
+			|| (NULL == pThreads) || (NULL == run.pSlots))
+	{
+		PrintError("Failed to malloc memory from system.");
+		free(pThreads);
+		free(run.pSlots);
+		return 0;
+	}
+	if ((NULL != pAllocator->pCreate) && (NULL == (run.pHandle = pAllocator->pCreate())))
+	{
+		free(pThreads);
+		free(run.pSlots);
+		free(run.pQueues);
+		return 0;
+	}
+	memset(run.pQueues, 0, sizeof(BenchQueue_t) * uThreads);
+	pthread_barrier_init(&run.start, NULL, uThreads + 1);
+	pthread_barrier_init(&run.round, NULL, uThreads);
+	pthread_mutex_init(&run.gate, NULL);
+
+	// Threads created wait for gate, so that they quit instead of waiting at barrier for threads not created.
+	unsigned int uCreated = 0;
+	pthread_mutex_lock(&run.gate);
+	while (uCreated < uThreads)
+	{
+		pThreads[uCreated].pRun = &run;
+		pThreads[uCreated].uId = uCreated;
+		if (0 != pthread_create(&(pThreads[uCreated].thread), NULL, BenchThreadMain, &(pThreads[uCreated])))
+		{
+			PrintError("Failed to create thread of benchmark.");
+			run.bAborted = 1;
+			break;
+		}
+		++ uCreated;
+	}
+	pthread_mutex_unlock(&run.gate);
+
+	// Timing starts when all threads are ready, and stops when all of them finish.
+	struct timespec startTime, endTime;
+	if (!run.bAborted)
+	{
+		pthread_barrier_wait(&run.start);
+		clock_gettime(CLOCK_MONOTONIC, &startTime);
+		pthread_barrier_wait(&run.start);
+	}
+	for (unsigned int i=0; i<uCreated; ++ i)
+	{
+		pthread_join(pThreads[i].thread, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+	// Blocks still alive in Larson workload are freed after timing.
+	for (size_t i=0; (BENCH_LARSON == eWorkload) && !run.bAborted && (i<(size_t)BENCH_LIVE_BLOCKS * uThreads);
+			++ i)
+	{
+		pAllocator->pFree(run.pHandle, run.pSlots[i]);
+	}
+	(NULL != pAllocator->pDestroy) ? pAllocator->pDestroy(run.pHandle) : (void)0;
+	pthread_barrier_destroy(&run.start);
+	pthread_barrier_destroy(&run.round);
+	pthread_mutex_destroy(&run.gate);
+	free(pThreads);
+	free(run.pSlots);
+	free(run.pQueues);
+	if (run.bAborted)
+	{
+		return 0;
+	}
+
+	double fSeconds = (endTime.tv_sec - startTime.tv_sec) + (endTime.tv_nsec - startTime.tv_nsec) / 1e9;
+	return 2.0 * BENCH_OPS_PER_THREAD * uThreads / ((fSeconds > 0) ? fSeconds : 1e-9);
+}
+
+/**
+ * @brief Benchmark allocators with threads, report operations per second of every workload and thread
+ * count, with scaling efficiency and speed compared with system malloc/free.
+ *
+ * @param pAllocators Allocators to benchmark.
+ * @param uCount Number of allocators.
+ * @param bFixedLen Allocate MALLOC_MAX_LEN every time if 1, random length up to it if 0.
+ * @param uMaxThreads Most threads to run with.
+ * @return 0 if succeed, -1 if any allocator failed.
+ */
+int RunBenchmark(const BenchAllocator_t *pAllocators, unsigned int uCount, char bFixedLen,
+		unsigned int uMaxThreads)
+{
+	// Threads run with are 1, 2, 4 ... and uMaxThreads.
+	unsigned int pThreadNums[sizeof(unsigned int) * CHAR_BIT + 1];
+	unsigned int uRuns = 0;
+	uMaxThreads = (0 == uMaxThreads) ? 1 : uMaxThreads;
+	for (unsigned int uThreads=1; uThreads<uMaxThreads; uThreads <<= 1)
+	{
+		pThreadNums[uRuns ++] = uThreads;
+	}
+	pThreadNums[uRuns ++] = uMaxThreads;
+
+	double pSystemOps[sizeof(unsigned int) * CHAR_BIT + 1] = {0};
+	double fOps = 0;
+	double fSingleOps = 0;
+	int ret = 0;
+	printf("Benchmark %s length up to %d threads, every thread does %d Malloc and %d Free.\n",
+			bFixedLen ? "fixed" : "variable", uMaxThreads, BENCH_OPS_PER_THREAD, BENCH_OPS_PER_THREAD);
+	for (int eWorkload=0; eWorkload<BENCH_WORKLOADS; ++ eWorkload)
+	{
+		printf("\nWorkload: %s.\n", g_pWorkloadNames[eWorkload]);
+		printf("%-28s %8s %12s %11s %10s\n", "Allocator", "Threads", "Mops/s", "Efficiency", "vs malloc");
+		for (int i=-1; i<(int)uCount; ++ i)
+		{
+			const BenchAllocator_t *pAllocator = (i < 0) ? &g_systemAllocator : &(pAllocators[i]);
+			for (unsigned int j=0; j<uRuns; ++ j)
+			{
+				fOps = RunWorkload(pAllocator, (BenchWorkload_t)eWorkload, pThreadNums[j], bFixedLen);
+				if (0 == fOps)
+				{
+					printf("%-28s %8u %12s\n", pAllocator->pName, pThreadNums[j], "failed");
+					ret = -1;
+					break;
+				}
+				fSingleOps = (0 == j) ? fOps : fSingleOps;
+				(i < 0) ? (pSystemOps[j] = fOps) : 0;
+				printf("%-28s %8u %12.2f %10.1f%% %10.2f\n", pAllocator->pName, pThreadNums[j], fOps / 1e6,
+						100.0 * fOps / (fSingleOps * pThreadNums[j]), fOps / pSystemOps[j]);
+			}
+		}
+	}
+
+	return ret;
+}
@@ -89,10 +89,122 @@ int SystemDefaultAllocatorTest_VarLen()
 	return 0;
 }
 
-int main()
+/**
+ * @brief Fill memory blocks with their index and read it back, so that overlapped or not writable blocks
+ * are found.
+ *
+ * @param pPtrs Addresses of memory blocks.
+ * @param uCount Number of memory blocks.
+ * @param uSize Size of every memory block, at least sizeof(unsigned int).
+ * @return 0 if every block keeps its own index, -1 if not.
+ */
+int CheckBlocks(void **pPtrs, unsigned int uCount, size_t uSize)
+{
+	for (unsigned int i=0; i<uCount; ++ i)
+	{
+		memset(pPtrs[i], (int)(i & 0xFF), uSize);
+		memcpy(pPtrs[i], &i, sizeof(unsigned int));
+	}
+	for (unsigned int i=0; i<uCount; ++ i)
+	{
+		unsigned int uIndex;
+		memcpy(&uIndex, pPtrs[i], sizeof(unsigned int));
+		if ((uIndex != i) || ((unsigned char)(i & 0xFF) != ((unsigned char *)pPtrs[i])[uSize - 1]))
+		{
+			PrintError("Memory block was overwritten by another block.");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Fill memory with bytes made from their offset, so that CheckPattern() can find if it is changed.
+ *
+ * @param pPtr Address of memory.
+ * @param uLen Length of memory.
+ */
+void FillPattern(void *pPtr, size_t uLen)
+{
+	for (size_t i=0; i<uLen; ++ i)
+	{
+		((unsigned char *)pPtr)[i] = (unsigned char)(i * 31 + 7);
+	}
+}
+
+/**
+ * @brief Check memory still has bytes FillPattern() filled.
+ *
+ * @param pPtr Address of memory.
+ * @param uLen Length of memory to check.
+ * @return 0 if not changed, -1 if changed.
+ */
+int CheckPattern(const void *pPtr, size_t uLen)
+{
+	for (size_t i=0; i<uLen; ++ i)
+	{
+		if (((const unsigned char *)pPtr)[i] != (unsigned char)(i * 31 + 7))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Benchmark enabled memory pool with threads, against system default allocator.
+ *
+ * @param uMaxThreads Most threads to run with.
+ */
+int MemoryPoolBenchmark(unsigned int uMaxThreads)
+{
+#if defined(ENABLE_FULMemoryPool)
+	return FULMemoryPoolBenchmark(uMaxThreads);
+#elif defined (ENABLE_VULMemoryPool)
+	return VULMemoryPoolBenchmark(uMaxThreads);
+#elif defined (ENABLE_FALMemoryPool)
+	return FALMemoryPoolBenchmark(uMaxThreads);
+#elif defined (ENABLE_VALMemoryPool)
+	return VALMemoryPoolBenchmark(uMaxThreads);
+#elif defined (ENABLE_FUBMemoryPool)
+	return FUBMemoryPoolBenchmark(uMaxThreads);
+#elif defined (ENABLE_VUBMemoryPool)
+	return VUBMemoryPoolBenchmark(uMaxThreads);
+#elif defined (ENABLE_FABMemoryPool)
+	return FABMemoryPoolBenchmark(uMaxThreads);
+#elif defined (ENABLE_VABMemoryPool)
+	return VABMemoryPoolBenchmark(uMaxThreads);
+#else
+	PrintLog("Please define one of macros to enable related memory pool tester, please define it in MemoryPool.h\n");
+	return -1;
+#endif
+}
+
+/**
+ * @brief Test enabled memory pool, or benchmark it with threads if run as "memoryPoolTester bench [threads]".
+ */
+int main(int argc, char *argv[])
 {
 	int ret;
 
+	if ((argc > 1) && (0 == strcmp(argv[1], "bench")))
+	{
+		long iThreads = (argc > 2) ? strtol(argv[2], NULL, 10) : BENCH_MAX_THREADS;
+		if (iThreads <= 0)
+		{
+			PrintError("Number of threads to benchmark with must be positive.");
+			return -1;
+		}
+		if (iThreads > BENCH_THREADS_LIMIT)
+		{
+			PrintWarning("Too many threads to benchmark with, lowered to BENCH_THREADS_LIMIT.");
+			iThreads = BENCH_THREADS_LIMIT;
+		}
+		return MemoryPoolBenchmark((unsigned int)iThreads);
+	}
+
 #if defined(ENABLE_FULMemoryPool) || defined (ENABLE_FALMemoryPool) || defined (ENABLE_FABMemoryPool) || defined (ENABLE_FUBMemoryPool)
 	SystemDefaultAllocatorTest_FixedLen();
 #else
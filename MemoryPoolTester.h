@@ -13,6 +13,7 @@
 
 #include "CProjectDfn.h"
 #include <time.h>
+#include <pthread.h>
 
 /**
  * @brief Longest length of string can allocate from pool.
@@ -29,6 +30,52 @@
  */
 #define TEST_RETRY_TIMES 99
 
+/**
+ * @brief Allocate so many blocks at once in batch test.
+ */
+#define TEST_BATCH_BLOCKS 200
+
+/**
+ * @brief Benchmark runs with 1, 2, 4 ... threads up to this, if not given by command line.
+ */
+#define BENCH_MAX_THREADS 8
+
+/**
+ * @brief Benchmark runs with this many threads at most, more given by command line are lowered to it.
+ */
+#define BENCH_THREADS_LIMIT 1024
+
+/**
+ * @brief Every thread allocates so many blocks and frees them in a workload of benchmark.
+ */
+#define BENCH_OPS_PER_THREAD 100000
+
+/**
+ * @brief Blocks every thread keeps alive in Larson workload of benchmark.
+ */
+#define BENCH_LIVE_BLOCKS 1000
+
+/**
+ * @brief Allocator benchmarked, its functions can be called by threads at the same time.
+ */
+typedef struct BenchAllocator
+{
+	const char *pName;                                ///< Name printed in report.
+	void *(*pCreate)(void);                           ///< Create allocator, NULL if failed, can be NULL.
+	void (*pDestroy)(void *pAllocator);               ///< Destroy allocator, can be NULL.
+	void *(*pMalloc)(void *pAllocator, size_t uSize); ///< Allocate a block, not bigger than MALLOC_MAX_LEN.
+	void (*pFree)(void *pAllocator, void *pPtr);      ///< Free a block, maybe allocated by another thread.
+}BenchAllocator_t;
+
+/**
+ * @brief Memory pool shared by threads behind a lock, for pools can't be used by threads at the same time.
+ */
+typedef struct LockedPool
+{
+	void *pPool;                                      ///< Memory pool, only used with lock taken.
+	pthread_mutex_t lock;                             ///< Lock of pool.
+}LockedPool_t;
+
 /**
  * @brief Test one kind of memory pool, enable it and program will test this kind of pool.
  * @note Enable one of them at one time.
@@ -68,5 +115,111 @@ extern int FALMemoryPoolTester();
 extern int VALMemoryPoolTester();
 extern int FUBMemoryPoolTester();
 extern int FABMemoryPoolTester();
+extern int VUBMemoryPoolTester();
+extern int VABMemoryPoolTester();
+
+/**
+ * @brief Fill memory blocks with their index and read it back, so that overlapped or not writable blocks
+ * are found.
+ *
+ * @param pPtrs Addresses of memory blocks.
+ * @param uCount Number of memory blocks.
+ * @param uSize Size of every memory block, at least sizeof(unsigned int).
+ * @return 0 if every block keeps its own index, -1 if not.
+ */
+extern int CheckBlocks(void **pPtrs, unsigned int uCount, size_t uSize);
+
+/**
+ * @brief Fill memory with bytes made from their offset, so that CheckPattern() can find if it is changed.
+ *
+ * @param pPtr Address of memory.
+ * @param uLen Length of memory.
+ */
+extern void FillPattern(void *pPtr, size_t uLen);
+
+/**
+ * @brief Check memory still has bytes FillPattern() filled.
+ *
+ * @param pPtr Address of memory.
+ * @param uLen Length of memory to check.
+ * @return 0 if not changed, -1 if changed.
+ */
+extern int CheckPattern(const void *pPtr, size_t uLen);
+
+/**
+ * @brief Put a memory pool behind a lock, so that threads can share it.
+ *
+ * @param pPool Memory pool to share, NULL if failed to create it.
+ * @return Pool behind lock, NULL if failed.
+ */
+extern LockedPool_t *CreateLockedPool(void *pPool);
+
+/**
+ * @brief Destroy lock of a pool put behind it by CreateLockedPool(), the pool itself is destroyed by caller.
+ *
+ * @param pLockedPool Pool behind lock.
+ */
+extern void DestroyLockedPool(LockedPool_t *pLockedPool);
+
+/**
+ * @brief Define PREFIX##BenchCreate/Destroy/Malloc/Free of BenchAllocator_t, which share MemoryPool_t of
+ * the pool tester including it behind a lock, so that every tester only writes how to create and allocate.
+ *
+ * @param PREFIX Name of pool, such as FAB.
+ * @param CREATE Expression to create the pool.
+ * @param MALLOC Expression to allocate from pPool a block of uSize.
+ */
+#define DEFINE_LOCKED_ALLOCATOR(PREFIX, CREATE, MALLOC) \
+	void *PREFIX##BenchCreate(void) \
+	{ \
+		return CreateLockedPool(CREATE); \
+	} \
+	void PREFIX##BenchDestroy(void *pAllocator) \
+	{ \
+		MemoryPool_t *pPool = (MemoryPool_t *)((LockedPool_t *)pAllocator)->pPool; \
+		DestroyMemoryPool(&pPool); \
+		DestroyLockedPool((LockedPool_t *)pAllocator); \
+	} \
+	void *PREFIX##BenchMalloc(void *pAllocator, size_t uSize) \
+	{ \
+		LockedPool_t *pLockedPool = (LockedPool_t *)pAllocator; \
+		MemoryPool_t *pPool = (MemoryPool_t *)pLockedPool->pPool; \
+		pthread_mutex_lock(&(pLockedPool->lock)); \
+		void *pPtr = MALLOC; \
+		pthread_mutex_unlock(&(pLockedPool->lock)); \
+		return pPtr; \
+	} \
+	void PREFIX##BenchFree(void *pAllocator, void *pPtr) \
+	{ \
+		LockedPool_t *pLockedPool = (LockedPool_t *)pAllocator; \
+		pthread_mutex_lock(&(pLockedPool->lock)); \
+		Free((MemoryPool_t *)pLockedPool->pPool, pPtr); \
+		pthread_mutex_unlock(&(pLockedPool->lock)); \
+	}
+
+/**
+ * @brief Benchmark allocators with threads, report operations per second of every workload and thread
+ * count, with scaling efficiency and speed compared with system malloc/free.
+ *
+ * @param pAllocators Allocators to benchmark.
+ * @param uCount Number of allocators.
+ * @param bFixedLen Allocate MALLOC_MAX_LEN every time if 1, random length up to it if 0.
+ * @param uMaxThreads Most threads to run with.
+ * @return 0 if succeed, -1 if any allocator failed.
+ */
+extern int RunBenchmark(const BenchAllocator_t *pAllocators, unsigned int uCount, char bFixedLen,
+		unsigned int uMaxThreads);
+
+/**
+ * @brief Memory pool benchmark, every pool is benchmarked with its thread safe front-ends.
+ */
+extern int FULMemoryPoolBenchmark(unsigned int uMaxThreads);
+extern int VULMemoryPoolBenchmark(unsigned int uMaxThreads);
+extern int FALMemoryPoolBenchmark(unsigned int uMaxThreads);
+extern int VALMemoryPoolBenchmark(unsigned int uMaxThreads);
+extern int FUBMemoryPoolBenchmark(unsigned int uMaxThreads);
+extern int FABMemoryPoolBenchmark(unsigned int uMaxThreads);
+extern int VUBMemoryPoolBenchmark(unsigned int uMaxThreads);
+extern int VABMemoryPoolBenchmark(unsigned int uMaxThreads);
 
 #endif /* MEMORY_POOL_TESTER_H */
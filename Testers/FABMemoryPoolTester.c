@@ -10,6 +10,7 @@
 
 #include "../FABMemoryPool/MemoryPool.h"
 #include "../MemoryPoolTester.h"
+#include <stdint.h>
 #include <sys/time.h>
 
 #ifdef ENABLE_FABMemoryPool
@@ -137,6 +138,370 @@ int FABMemoryPoolRandomTester()
 	return 0;
 }
 
+/**
+ * @brief Tester for MallocBatch/FreeBatch of FABMemoryPool, blocks got by a batch must be distinct and
+ * writable, also when got again after they are backed.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FABMemoryPoolBatchTester()
+{
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	int ret = 0;
+
+	PrintLog("Now testing memory pool MallocBatch/FreeBatch, FAB memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+	for (int i=0; (i<2) && (0 == ret); ++i)
+	{
+		unsigned int uGot = MallocBatch(pPool, pPtrs, TEST_BATCH_BLOCKS);
+		if (TEST_BATCH_BLOCKS != uGot)
+		{
+			PrintError("MallocBatch got less blocks than wanted.");
+			ret = -1;
+		}
+		else
+		{
+			ret = CheckBlocks(pPtrs, uGot, MALLOC_MAX_LEN);
+		}
+		FreeBatch(pPool, pPtrs, uGot);
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool MallocBatch/FreeBatch tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for uBlockAlign of FABMemoryPool, blocks got by Malloc() and MallocBatch() must be aligned,
+ * both in first chunk and in chunks grown after it.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FABMemoryPoolAlignTester()
+{
+	const BlockIndex_t aAligns[] = {64, 4096};
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	MemoryPoolConfig_t config;
+	int ret = 0;
+
+	PrintLog("Now testing memory pool uBlockAlign, FAB memory pool.");
+	for (int i=0; (i<2*sizeof(aAligns)/sizeof(BlockIndex_t)) && (0 == ret); ++i)
+	{
+		// Blocks are got one by one first, then by a batch, from a new pool every time.
+		InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+		config.uBlockAlign = aAligns[i / 2];
+		MemoryPool_t *pPool = CreateMemoryPoolWithConfig(&config);
+		if (NULL == pPool)
+		{
+			PrintError("Failed to create memory pool with uBlockAlign.");
+			return -1;
+		}
+		unsigned int uGot = 0;
+		if (0 == i % 2)
+		{
+			while ((uGot < TEST_BATCH_BLOCKS) && (NULL != (pPtrs[uGot] = Malloc(pPool))))
+			{
+				++ uGot;
+			}
+		}
+		else
+		{
+			uGot = MallocBatch(pPool, pPtrs, TEST_BATCH_BLOCKS);
+		}
+		if ((TEST_BATCH_BLOCKS != uGot) || (pPool->uChunks < 2))
+		{
+			PrintError("Failed to get blocks of more than one chunk.");
+			ret = -1;
+		}
+		for (unsigned int j=0; (j<uGot) && (0 == ret); ++ j)
+		{
+			if (0 != ((uintptr_t)pPtrs[j] % aAligns[i / 2]))
+			{
+				PrintError("Block is not aligned to uBlockAlign.");
+				ret = -1;
+			}
+		}
+		(0 == ret) ? (ret = CheckBlocks(pPtrs, uGot, MALLOC_MAX_LEN)) : 0;
+		FreeBatch(pPool, pPtrs, uGot);
+		DestroyMemoryPool(&pPool);
+	}
+	printf("Memory pool uBlockAlign tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for releasing empty chunks of FABMemoryPool. Malloc/Free at the boundary of a chunk must
+ * not create and release chunk again and again, at most uKeepEmptyChunks empty chunks are kept, chunks in
+ * release delay are kept, and TrimMemoryPool() releases them once delay is 0.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FABMemoryPoolHysteresisTester()
+{
+	const unsigned int uBlocks = FIRST_CHUNK_BLOCKS + 4 * GROW_CHUNK_BLOCKS;
+	void *pPtrs[FIRST_CHUNK_BLOCKS + 4 * GROW_CHUNK_BLOCKS];
+	MemoryPoolConfig_t config;
+	int ret = 0;
+
+	PrintLog("Now testing releasing empty chunks, FAB memory pool.");
+	InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+
+	// First chunk is full, the second one becomes empty every time, it is kept and used again.
+	MemoryPool_t *pPool = CreateMemoryPoolWithConfig(&config);
+	for (unsigned int i=0; i<FIRST_CHUNK_BLOCKS; ++ i)
+	{
+		pPtrs[i] = Malloc(pPool);
+	}
+	for (int i=0; (i<TEST_MALLOC_TIMES) && (0 == ret); ++ i)
+	{
+		Free(pPool, Malloc(pPool));
+		if ((2 != pPool->uChunks) || (1 != pPool->uEmptyChunks))
+		{
+			PrintError("Chunk at the boundary is not kept.");
+			ret = -1;
+		}
+	}
+	DestroyMemoryPool(&pPool);
+
+	// All chunks become empty, only uKeepEmptyChunks of them are kept.
+	config.uKeepEmptyChunks = 2;
+	pPool = CreateMemoryPoolWithConfig(&config);
+	for (unsigned int i=0; i<uBlocks; ++ i)
+	{
+		pPtrs[i] = Malloc(pPool);
+	}
+	FreeBatch(pPool, pPtrs, uBlocks);
+	if ((0 == ret) && ((2 != pPool->uChunks) || (2 != pPool->uEmptyChunks)))
+	{
+		PrintError("Empty chunks more than uKeepEmptyChunks are not released.");
+		ret = -1;
+	}
+	DestroyMemoryPool(&pPool);
+
+	// Empty chunks in release delay are kept, TrimMemoryPool() releases them when delay is 0.
+	config.uKeepEmptyChunks = 1;
+	config.uReleaseDelayMs = 60 * 1000;
+	pPool = CreateMemoryPoolWithConfig(&config);
+	for (unsigned int i=0; i<uBlocks; ++ i)
+	{
+		pPtrs[i] = Malloc(pPool);
+	}
+	FreeBatch(pPool, pPtrs, uBlocks);
+	if ((0 == ret) && ((5 != pPool->uChunks) || (5 != pPool->uEmptyChunks)))
+	{
+		PrintError("Empty chunks are released before release delay.");
+		ret = -1;
+	}
+	pPool->uReleaseDelayMs = 0;
+	TrimMemoryPool(pPool);
+	if ((0 == ret) && ((1 != pPool->uChunks) || (1 != pPool->uEmptyChunks)))
+	{
+		PrintError("Empty chunks are not released by TrimMemoryPool().");
+		ret = -1;
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool releasing empty chunks tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Grow callback for tester, new chunk has GROW_CHUNK_BLOCKS more blocks than the last one.
+ *
+ * @param pPool Which pool needs to grow.
+ * @param pArg Number of calls, counted by callback.
+ * @return Number of blocks of new chunk.
+ */
+BlockIndex_t FABGrowByChunks(const MemoryPool_t *pPool, void *pArg)
+{
+	++ *(unsigned int *)pArg;
+	return (BlockIndex_t)(pPool->uChunks * GROW_CHUNK_BLOCKS);
+}
+
+/**
+ * @brief Get blocks of a pool one by one up to a peak, every chunk it grows must have as many blocks as
+ * grow policy of config decides, capped by uMaxChunkBlocks of config and by MAX_CHUNK_ALIGN.
+ *
+ * @param pConfig Options of pool, with GROW_GEOMETRIC or GROW_CALLBACK by FABGrowByChunks().
+ * @param uPeak Number of blocks using at the same time.
+ * @return Number of chunks pool has at the peak, 0 if chunks are not as expected.
+ */
+size_t FABGrowToPeak(const MemoryPoolConfig_t *pConfig, unsigned int uPeak)
+{
+	void **pPtrs = (void **)malloc(sizeof(void *) * uPeak);
+	MemoryPool_t *pPool = CreateMemoryPoolWithConfig(pConfig);
+	if ((NULL == pPtrs) || (NULL == pPool))
+	{
+		PrintError("Failed to create memory pool to grow.");
+		free(pPtrs);
+		(NULL != pPool) ? DestroyMemoryPool(&pPool) : (void)0;
+		return 0;
+	}
+	size_t uMaxBlocks = (MAX_CHUNK_ALIGN - pPool->uBlockOffset) / pPool->uBlockSize;
+	uMaxBlocks = (pConfig->uMaxChunkBlocks < uMaxBlocks) ? pConfig->uMaxChunkBlocks : uMaxBlocks;
+	size_t uChunks = 0;
+	size_t uTotalBlocks = 0;
+	size_t uBlocks = 0;
+	int ret = 0;
+
+	for (unsigned int i=0; (i<uPeak) && (0 == ret); ++ i)
+	{
+		// Pool grows only when all blocks are used, work out how many blocks the new chunk should have.
+		if (i == uTotalBlocks)
+		{
+			uBlocks = (GROW_CALLBACK == pConfig->eGrowPolicy) ? uChunks * GROW_CHUNK_BLOCKS
+					: (size_t)(uTotalBlocks * (pConfig->fGrowFactor - 1));
+			uBlocks = (uBlocks < pConfig->uGrowChunkBlocks) ? pConfig->uGrowChunkBlocks : uBlocks;
+			uBlocks = (uBlocks > uMaxBlocks) ? uMaxBlocks : uBlocks;
+			uBlocks = (0 == uChunks) ? pConfig->uFirstChunkBlocks : uBlocks;
+			uTotalBlocks += uBlocks;
+			++ uChunks;
+		}
+		pPtrs[i] = Malloc(pPool);
+		if ((NULL == pPtrs[i]) || (uChunks != pPool->uChunks) || (uTotalBlocks != pPool->uTotalBlocks))
+		{
+			PrintError("Chunk grown is not as big as grow policy decides.");
+			ret = -1;
+		}
+	}
+	DestroyMemoryPool(&pPool);
+	free(pPtrs);
+
+	return (0 == ret) ? uChunks : 0;
+}
+
+/**
+ * @brief Tester for GROW_GEOMETRIC and GROW_CALLBACK of FABMemoryPool, chunks must grow by factor or
+ * callback, stop growing at uMaxChunkBlocks or at MAX_CHUNK_ALIGN, and number of chunks at a peak of
+ * using blocks is as small as the policy makes it.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FABMemoryPoolGrowTester()
+{
+	MemoryPoolConfig_t config;
+	unsigned int uCalls = 0;
+	int ret = 0;
+
+	PrintLog("Now testing memory pool grow policy, FAB memory pool.");
+
+	// Chunks of 64, 64, 128, 256, 512, 512, 512 blocks for 2000 blocks.
+	InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, GROW_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+	config.eGrowPolicy = GROW_GEOMETRIC;
+	config.uMaxChunkBlocks = 8 * GROW_CHUNK_BLOCKS;
+	if (7 != FABGrowToPeak(&config, 2000))
+	{
+		PrintError("GROW_GEOMETRIC doesn't grow by factor up to uMaxChunkBlocks.");
+		ret = -1;
+	}
+
+	// Chunks of 16 KiB blocks fit in MAX_CHUNK_ALIGN only if they have less than 256 blocks, so chunks are
+	// 16, 16, 32, 64, 128, 255, 255, 255 blocks for 800 blocks.
+	InitMemoryPoolConfig(&config, 16 * 1024, 16, 16);
+	config.eGrowPolicy = GROW_GEOMETRIC;
+	config.uMaxChunkBlocks = 1024;
+	if ((0 == ret) && (8 != FABGrowToPeak(&config, 800)))
+	{
+		PrintError("GROW_GEOMETRIC doesn't stop growing at MAX_CHUNK_ALIGN.");
+		ret = -1;
+	}
+
+	// Chunks of 64, 64, 128, 192, 256, 256, 256 blocks for 1000 blocks, callback is called for all but first.
+	InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, GROW_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+	config.eGrowPolicy = GROW_CALLBACK;
+	config.uMaxChunkBlocks = 4 * GROW_CHUNK_BLOCKS;
+	config.pGrowCallback = FABGrowByChunks;
+	config.pGrowArg = &uCalls;
+	if ((0 == ret) && ((7 != FABGrowToPeak(&config, 1000)) || (6 != uCalls)))
+	{
+		PrintError("GROW_CALLBACK doesn't grow as callback decides up to uMaxChunkBlocks.");
+		ret = -1;
+	}
+	printf("Memory pool grow policy tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Blocks of a pool with bRemoteFree, allocated by owner and freed by another thread.
+ */
+typedef struct RemoteFreeTest
+{
+	MemoryPool_t *pPool;                    ///< Pool created by owner thread.
+	void *pPtrs[TEST_BATCH_BLOCKS];         ///< Blocks allocated by owner thread.
+}RemoteFreeTest_t;
+
+/**
+ * @brief Thread of remote free tester, frees blocks of owner one by one and by a batch.
+ *
+ * @param pArg Pool and blocks to free.
+ * @return NULL.
+ */
+void *FABRemoteFreeTestThread(void *pArg)
+{
+	RemoteFreeTest_t *pTest = (RemoteFreeTest_t *)pArg;
+
+	for (int i=0; i<TEST_BATCH_BLOCKS/2; ++ i)
+	{
+		Free(pTest->pPool, pTest->pPtrs[i]);
+	}
+	FreeBatch(pTest->pPool, pTest->pPtrs + TEST_BATCH_BLOCKS/2, TEST_BATCH_BLOCKS - TEST_BATCH_BLOCKS/2);
+
+	return NULL;
+}
+
+/**
+ * @brief Tester for blocks freed by other thread of FABMemoryPool, owner must give them back when a batch
+ * of them is queued, though it still has a partial chunk, and reuse them without growing.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FABMemoryPoolRemoteFreeTester()
+{
+	RemoteFreeTest_t test;
+	MemoryPoolConfig_t config;
+	pthread_t thread;
+	int ret = 0;
+
+	PrintLog("Now testing blocks freed by other thread, FAB memory pool.");
+	InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+	config.uKeepEmptyChunks = UINT_MAX;
+	config.bRemoteFree = 1;
+	test.pPool = CreateMemoryPoolWithConfig(&config);
+	if ((NULL == test.pPool) || (TEST_BATCH_BLOCKS != MallocBatch(test.pPool, test.pPtrs, TEST_BATCH_BLOCKS))
+			|| (0 != pthread_create(&thread, NULL, FABRemoteFreeTestThread, &test)))
+	{
+		PrintError("Failed to create remote free tester.");
+		(NULL != test.pPool) ? DestroyMemoryPool(&test.pPool) : (void)0;
+		return -1;
+	}
+	pthread_join(thread, NULL);
+
+	// Chunks grown for the blocks are not all full, so only the count of queued blocks makes them back.
+	size_t uTotalBlocks = test.pPool->uTotalBlocks;
+	test.pPtrs[0] = Malloc(test.pPool);
+	if ((NULL != test.pPool->pRemoteFree) || (0 != test.pPool->uRemoteFrees))
+	{
+		PrintError("Blocks freed by other thread are not given back when a batch of them is queued.");
+		ret = -1;
+	}
+	else if ((TEST_BATCH_BLOCKS - 1 != MallocBatch(test.pPool, test.pPtrs + 1, TEST_BATCH_BLOCKS - 1))
+			|| (uTotalBlocks != test.pPool->uTotalBlocks))
+	{
+		PrintError("Blocks freed by other thread are not reused.");
+		ret = -1;
+	}
+	else
+	{
+		ret = CheckBlocks(test.pPtrs, TEST_BATCH_BLOCKS, MALLOC_MAX_LEN);
+	}
+	DestroyMemoryPool(&test.pPool);
+	printf("Memory pool remote Free tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
 /**
  * @brief Tester for FULMemoryPool.
  */
@@ -147,7 +512,52 @@ int FABMemoryPoolTester()
 #else
 	FABMemoryPoolRandomTester();
 #endif
-	return 0;
+	return ((0 == FABMemoryPoolBatchTester()) && (0 == FABMemoryPoolAlignTester())
+			&& (0 == FABMemoryPoolHysteresisTester()) && (0 == FABMemoryPoolGrowTester())
+			&& (0 == FABMemoryPoolRemoteFreeTester())) ? 0 : -1;
+}
+
+/**
+ * @brief FAB memory pool shared by threads behind a lock, for benchmark.
+ */
+DEFINE_LOCKED_ALLOCATOR(FAB, CreateMemoryPool(MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS),
+		Malloc(pPool))
+
+/**
+ * @brief Create FAB memory pool with bRemoteFree for benchmark, owner is main thread, so that blocks freed
+ * by every thread of benchmark are queued without lock, Malloc() is still behind a lock.
+ */
+void *FABRemoteBenchCreate(void)
+{
+	MemoryPoolConfig_t config;
+	InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+	config.bRemoteFree = 1;
+
+	return CreateLockedPool(CreateMemoryPoolWithConfig(&config));
+}
+
+/**
+ * @brief Free to FAB memory pool with bRemoteFree, block is queued for owner without lock.
+ */
+void FABRemoteBenchFree(void *pAllocator, void *pPtr)
+{
+	Free((MemoryPool_t *)((LockedPool_t *)pAllocator)->pPool, pPtr);
+}
+
+/**
+ * @brief Benchmark of FABMemoryPool with threads, pool is shared behind a lock, and with blocks freed by
+ * threads queued without lock.
+ *
+ * @param uMaxThreads Most threads to run with.
+ */
+int FABMemoryPoolBenchmark(unsigned int uMaxThreads)
+{
+	const BenchAllocator_t pAllocators[] = {
+			{"FAB pool, locked", FABBenchCreate, FABBenchDestroy, FABBenchMalloc, FABBenchFree},
+			{"FAB pool, remote free", FABRemoteBenchCreate, FABBenchDestroy, FABBenchMalloc, FABRemoteBenchFree}
+	};
+
+	return RunBenchmark(pAllocators, sizeof(pAllocators) / sizeof(BenchAllocator_t), 1, uMaxThreads);
 }
 
 #endif /* ENABLE_FABMemoryPool */
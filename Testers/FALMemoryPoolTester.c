@@ -8,11 +8,207 @@
  */
 
 #include "../FALMemoryPool/MemoryPool.h"
+#include "../FALMemoryPool/ConcurrentPool.h"
 #include "../MemoryPoolTester.h"
 #include <sys/time.h>
+#include <sched.h>
 
 #ifdef ENABLE_FALMemoryPool
 
+/**
+ * @brief Threads sharing a pool in concurrent pool test.
+ */
+#define CONCURRENT_TEST_THREADS 4
+
+/**
+ * @brief Rounds of every thread in concurrent pool test, it gets and gives back up to TEST_BATCH_BLOCKS
+ * blocks in a round.
+ */
+#define CONCURRENT_TEST_ROUNDS 20000
+
+/**
+ * @brief Idle cap of pool in concurrent pool test, small so that blocks are retired and used again.
+ */
+#define CONCURRENT_TEST_IDLE_CAP 16
+
+/**
+ * @brief Tester for MallocBatch/FreeBatch of FALMemoryPool, blocks got by a batch must be distinct and
+ * writable, also when got again after they are backed.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FALMemoryPoolBatchTester()
+{
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	int ret = 0;
+
+	PrintLog("Now testing memory pool MallocBatch/FreeBatch, FAL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	for (int i=0; (i<2) && (0 == ret); ++i)
+	{
+		unsigned int uGot = MallocBatch(pPool, pPtrs, TEST_BATCH_BLOCKS);
+		if (TEST_BATCH_BLOCKS != uGot)
+		{
+			PrintError("MallocBatch got less blocks than wanted.");
+			ret = -1;
+		}
+		else
+		{
+			ret = CheckBlocks(pPtrs, uGot, MALLOC_MAX_LEN);
+		}
+		FreeBatch(pPool, pPtrs, uGot);
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool MallocBatch/FreeBatch tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for idle cap of FALMemoryPool, pool of big blocks keeps no more idle blocks than
+ * uMaxIdleBytes from the beginning, and blocks got from system and given back don't wrap blocks using.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FALMemoryPoolIdleCapTester()
+{
+	const unsigned int uBlockSize = MAX_IDLE_BYTES / 4;
+	void *pPtrs[2 * MIN_IDLE_CAP];
+	int ret = 0;
+
+	PrintLog("Now testing memory pool idle cap, FAL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(uBlockSize);
+	for (int i=0; i<2*MIN_IDLE_CAP; ++i)
+	{
+		pPtrs[i] = malloc(uBlockSize);
+	}
+	FreeBatch(pPool, pPtrs, MIN_IDLE_CAP);
+	for (int i=MIN_IDLE_CAP; i<2*MIN_IDLE_CAP; ++i)
+	{
+		Free(pPool, pPtrs[i]);
+	}
+	if ((pPool->uIdleCap > 4) || (pPool->uAvailableNum > 4))
+	{
+		PrintError("Idle blocks are more than uMaxIdleBytes.");
+		ret = -1;
+	}
+	else if ((0 != pPool->uUsing) || (0 != pPool->uLowWater) || (0 != pPool->uHighWater))
+	{
+		PrintError("Blocks using wrap when blocks got from system are given back.");
+		ret = -1;
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool idle cap tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief A thread of concurrent pool tester.
+ */
+typedef struct ConcurrentTest
+{
+	ConcurrentPool_t *pPool;    ///< Pool shared by threads.
+	unsigned int uId;           ///< Index of thread, written to every block it gets.
+	int ret;                    ///< 0 if every block got kept its tag, -1 if not.
+}ConcurrentTest_t;
+
+/**
+ * @brief Thread of concurrent pool tester, writes its index and round to every block it gets, and checks
+ * them before giving block back, so a block handed out to two threads at the same time is found.
+ *
+ * @param pArg ConcurrentTest_t of this thread.
+ * @return NULL.
+ */
+void *FALConcurrentTestThread(void *pArg)
+{
+	ConcurrentTest_t *pTest = (ConcurrentTest_t *)pArg;
+	unsigned int *pBlocks[TEST_BATCH_BLOCKS];
+	unsigned int uSeed = pTest->uId + 1;
+
+	for (unsigned int i=0; (i<CONCURRENT_TEST_ROUNDS) && (0 == pTest->ret); ++ i)
+	{
+		unsigned int uCount = (unsigned int)rand_r(&uSeed) % TEST_BATCH_BLOCKS + 1;
+		for (unsigned int j=0; j<uCount; ++ j)
+		{
+			pBlocks[j] = (unsigned int *)ConcurrentMalloc(pTest->pPool);
+			if (NULL == pBlocks[j])
+			{
+				pTest->ret = -1;
+				uCount = j;
+				break;
+			}
+			pBlocks[j][0] = pTest->uId;
+			pBlocks[j][1] = i;
+		}
+		(0 == i % 64) ? sched_yield() : 0;
+		for (unsigned int j=0; j<uCount; ++ j)
+		{
+			((pBlocks[j][0] != pTest->uId) || (pBlocks[j][1] != i)) ? (pTest->ret = -1) : 0;
+			ConcurrentFree(pTest->pPool, pBlocks[j]);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Tester for concurrent pool of FALMemoryPool, threads get and give back blocks at the same time,
+ * no block can be got by two threads, and idle blocks in stack are not more than uIdleCap.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FALConcurrentPoolTester()
+{
+	pthread_t threads[CONCURRENT_TEST_THREADS];
+	ConcurrentTest_t tests[CONCURRENT_TEST_THREADS];
+	unsigned int uCreated = 0;
+	int ret = 0;
+
+	PrintLog("Now testing ConcurrentMalloc/ConcurrentFree with threads, FAL memory pool.");
+	ConcurrentPool_t *pPool = CreateConcurrentPool(MALLOC_MAX_LEN);
+	if (NULL == pPool)
+	{
+		return -1;
+	}
+	pPool->uIdleCap = CONCURRENT_TEST_IDLE_CAP;
+	for (; uCreated<CONCURRENT_TEST_THREADS; ++ uCreated)
+	{
+		tests[uCreated].pPool = pPool;
+		tests[uCreated].uId = uCreated;
+		tests[uCreated].ret = 0;
+		if (0 != pthread_create(&(threads[uCreated]), NULL, FALConcurrentTestThread, &(tests[uCreated])))
+		{
+			PrintError("Failed to create concurrent pool tester.");
+			ret = -1;
+			break;
+		}
+	}
+	for (unsigned int i=0; i<uCreated; ++ i)
+	{
+		pthread_join(threads[i], NULL);
+		(0 != tests[i].ret) ? (ret = -1) : 0;
+	}
+	(0 != ret) ? PrintError("A block is got by two threads at the same time.") : (void)0;
+
+	// No thread uses pool now, blocks in stack are counted exactly.
+	unsigned long uIdle = 0;
+	for (Node_t *pNode=pPool->top.top.pNode; NULL != pNode; pNode=pNode->pNext)
+	{
+		++ uIdle;
+	}
+	if ((uIdle > CONCURRENT_TEST_IDLE_CAP) || (uIdle != pPool->uPushes - pPool->top.top.uTag))
+	{
+		PrintError("Idle blocks in stack are more than idle cap, or not counted.");
+		ret = -1;
+	}
+	TrimConcurrentPool(pPool);
+	DestroyConcurrentPool(&pPool);
+	printf("Concurrent pool tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
 /**
  * @brief Tester for FALMemoryPool.
  */
@@ -48,7 +244,62 @@ int FALMemoryPoolTester()
 			TEST_MALLOC_TIMES, TEST_RETRY_TIMES, costTime);
 
 	free(pStrings);
-	return 0;
+	return ((0 == FALMemoryPoolBatchTester()) && (0 == FALMemoryPoolIdleCapTester())
+			&& (0 == FALConcurrentPoolTester())) ? 0 : -1;
+}
+
+/**
+ * @brief FAL memory pool shared by threads behind a lock, for benchmark.
+ */
+DEFINE_LOCKED_ALLOCATOR(FAL, CreateMemoryPool(MALLOC_MAX_LEN), Malloc(pPool))
+
+/**
+ * @brief Create FAL memory pool shared by threads without lock, for benchmark.
+ */
+void *FALConcurrentBenchCreate(void)
+{
+	return CreateConcurrentPool(MALLOC_MAX_LEN);
+}
+
+/**
+ * @brief Destroy FAL memory pool shared by threads without lock.
+ */
+void FALConcurrentBenchDestroy(void *pAllocator)
+{
+	ConcurrentPool_t *pPool = (ConcurrentPool_t *)pAllocator;
+	DestroyConcurrentPool(&pPool);
+}
+
+/**
+ * @brief Allocate from FAL memory pool shared by threads without lock.
+ */
+void *FALConcurrentBenchMalloc(void *pAllocator, size_t uSize)
+{
+	return ConcurrentMalloc((ConcurrentPool_t *)pAllocator);
+}
+
+/**
+ * @brief Free to FAL memory pool shared by threads without lock.
+ */
+void FALConcurrentBenchFree(void *pAllocator, void *pPtr)
+{
+	ConcurrentFree((ConcurrentPool_t *)pAllocator, pPtr);
+}
+
+/**
+ * @brief Benchmark of FALMemoryPool with threads, pool is shared behind a lock, and by its lock-free pool.
+ *
+ * @param uMaxThreads Most threads to run with.
+ */
+int FALMemoryPoolBenchmark(unsigned int uMaxThreads)
+{
+	const BenchAllocator_t pAllocators[] = {
+			{"FAL pool, locked", FALBenchCreate, FALBenchDestroy, FALBenchMalloc, FALBenchFree},
+			{"FAL pool, concurrent", FALConcurrentBenchCreate, FALConcurrentBenchDestroy,
+				FALConcurrentBenchMalloc, FALConcurrentBenchFree}
+	};
+
+	return RunBenchmark(pAllocators, sizeof(pAllocators) / sizeof(BenchAllocator_t), 1, uMaxThreads);
 }
 
 #endif /* ENABLE_FALMemoryPool */
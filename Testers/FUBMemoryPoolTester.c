@@ -10,6 +10,7 @@
 
 #include "../FUBMemoryPool/MemoryPool.h"
 #include "../MemoryPoolTester.h"
+#include <stdint.h>
 #include <sys/time.h>
 
 #ifdef ENABLE_FUBMemoryPool
@@ -137,6 +138,215 @@ int FUBMemoryPoolRandomTester()
 	return 0;
 }
 
+/**
+ * @brief Tester for MallocBatch/FreeBatch of FUBMemoryPool, blocks got by a batch must be distinct and
+ * writable, also when got again after they are backed.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FUBMemoryPoolBatchTester()
+{
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	int ret = 0;
+
+	PrintLog("Now testing memory pool MallocBatch/FreeBatch, FUB memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+	for (int i=0; (i<2) && (0 == ret); ++i)
+	{
+		unsigned int uGot = MallocBatch(pPool, pPtrs, TEST_BATCH_BLOCKS);
+		if (TEST_BATCH_BLOCKS != uGot)
+		{
+			PrintError("MallocBatch got less blocks than wanted.");
+			ret = -1;
+		}
+		else
+		{
+			ret = CheckBlocks(pPtrs, uGot, MALLOC_MAX_LEN);
+		}
+		FreeBatch(pPool, pPtrs, uGot);
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool MallocBatch/FreeBatch tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for uBlockAlign of FUBMemoryPool, blocks got by Malloc() and MallocBatch() must be aligned,
+ * both in first chunk and in chunks grown after it.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FUBMemoryPoolAlignTester()
+{
+	const BlockIndex_t aAligns[] = {64, 4096};
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	MemoryPoolConfig_t config;
+	int ret = 0;
+
+	PrintLog("Now testing memory pool uBlockAlign, FUB memory pool.");
+	for (int i=0; (i<2*sizeof(aAligns)/sizeof(BlockIndex_t)) && (0 == ret); ++i)
+	{
+		// Blocks are got one by one first, then by a batch, from a new pool every time.
+		InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+		config.uBlockAlign = aAligns[i / 2];
+		MemoryPool_t *pPool = CreateMemoryPoolWithConfig(&config);
+		if (NULL == pPool)
+		{
+			PrintError("Failed to create memory pool with uBlockAlign.");
+			return -1;
+		}
+		unsigned int uGot = 0;
+		if (0 == i % 2)
+		{
+			while ((uGot < TEST_BATCH_BLOCKS) && (NULL != (pPtrs[uGot] = Malloc(pPool))))
+			{
+				++ uGot;
+			}
+		}
+		else
+		{
+			uGot = MallocBatch(pPool, pPtrs, TEST_BATCH_BLOCKS);
+		}
+		if ((TEST_BATCH_BLOCKS != uGot) || (pPool->uChunks < 2))
+		{
+			PrintError("Failed to get blocks of more than one chunk.");
+			ret = -1;
+		}
+		for (unsigned int j=0; (j<uGot) && (0 == ret); ++ j)
+		{
+			if (0 != ((uintptr_t)pPtrs[j] % aAligns[i / 2]))
+			{
+				PrintError("Block is not aligned to uBlockAlign.");
+				ret = -1;
+			}
+		}
+		(0 == ret) ? (ret = CheckBlocks(pPtrs, uGot, MALLOC_MAX_LEN)) : 0;
+		FreeBatch(pPool, pPtrs, uGot);
+		DestroyMemoryPool(&pPool);
+	}
+	printf("Memory pool uBlockAlign tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Grow callback for tester, new chunk has GROW_CHUNK_BLOCKS more blocks than the last one.
+ *
+ * @param pPool Which pool needs to grow.
+ * @param pArg Number of calls, counted by callback.
+ * @return Number of blocks of new chunk.
+ */
+BlockIndex_t FUBGrowByChunks(const MemoryPool_t *pPool, void *pArg)
+{
+	++ *(unsigned int *)pArg;
+	return (BlockIndex_t)(pPool->uChunks * GROW_CHUNK_BLOCKS);
+}
+
+/**
+ * @brief Get blocks of a pool one by one up to a peak, every chunk it grows must have as many blocks as
+ * grow policy of config decides, capped by uMaxChunkBlocks of config and by MAX_CHUNK_ALIGN.
+ *
+ * @param pConfig Options of pool, with GROW_GEOMETRIC or GROW_CALLBACK by FUBGrowByChunks().
+ * @param uPeak Number of blocks using at the same time.
+ * @return Number of chunks pool has at the peak, 0 if chunks are not as expected.
+ */
+size_t FUBGrowToPeak(const MemoryPoolConfig_t *pConfig, unsigned int uPeak)
+{
+	void **pPtrs = (void **)malloc(sizeof(void *) * uPeak);
+	MemoryPool_t *pPool = CreateMemoryPoolWithConfig(pConfig);
+	if ((NULL == pPtrs) || (NULL == pPool))
+	{
+		PrintError("Failed to create memory pool to grow.");
+		free(pPtrs);
+		(NULL != pPool) ? DestroyMemoryPool(&pPool) : (void)0;
+		return 0;
+	}
+	size_t uMaxBlocks = (MAX_CHUNK_ALIGN - pPool->uBlockOffset) / pPool->uBlockSize;
+	uMaxBlocks = (pConfig->uMaxChunkBlocks < uMaxBlocks) ? pConfig->uMaxChunkBlocks : uMaxBlocks;
+	size_t uChunks = 0;
+	size_t uTotalBlocks = 0;
+	size_t uBlocks = 0;
+	int ret = 0;
+
+	for (unsigned int i=0; (i<uPeak) && (0 == ret); ++ i)
+	{
+		// Pool grows only when all blocks are used, work out how many blocks the new chunk should have.
+		if (i == uTotalBlocks)
+		{
+			uBlocks = (GROW_CALLBACK == pConfig->eGrowPolicy) ? uChunks * GROW_CHUNK_BLOCKS
+					: (size_t)(uTotalBlocks * (pConfig->fGrowFactor - 1));
+			uBlocks = (uBlocks < pConfig->uGrowChunkBlocks) ? pConfig->uGrowChunkBlocks : uBlocks;
+			uBlocks = (uBlocks > uMaxBlocks) ? uMaxBlocks : uBlocks;
+			uBlocks = (0 == uChunks) ? pConfig->uFirstChunkBlocks : uBlocks;
+			uTotalBlocks += uBlocks;
+			++ uChunks;
+		}
+		pPtrs[i] = Malloc(pPool);
+		if ((NULL == pPtrs[i]) || (uChunks != pPool->uChunks) || (uTotalBlocks != pPool->uTotalBlocks))
+		{
+			PrintError("Chunk grown is not as big as grow policy decides.");
+			ret = -1;
+		}
+	}
+	DestroyMemoryPool(&pPool);
+	free(pPtrs);
+
+	return (0 == ret) ? uChunks : 0;
+}
+
+/**
+ * @brief Tester for GROW_GEOMETRIC and GROW_CALLBACK of FUBMemoryPool, chunks must grow by factor or
+ * callback, stop growing at uMaxChunkBlocks or at MAX_CHUNK_ALIGN, and number of chunks at a peak of
+ * using blocks is as small as the policy makes it.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FUBMemoryPoolGrowTester()
+{
+	MemoryPoolConfig_t config;
+	unsigned int uCalls = 0;
+	int ret = 0;
+
+	PrintLog("Now testing memory pool grow policy, FUB memory pool.");
+
+	// Chunks of 64, 64, 128, 256, 512, 512, 512 blocks for 2000 blocks.
+	InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, GROW_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+	config.eGrowPolicy = GROW_GEOMETRIC;
+	config.uMaxChunkBlocks = 8 * GROW_CHUNK_BLOCKS;
+	if (7 != FUBGrowToPeak(&config, 2000))
+	{
+		PrintError("GROW_GEOMETRIC doesn't grow by factor up to uMaxChunkBlocks.");
+		ret = -1;
+	}
+
+	// Chunks of 16 KiB blocks fit in MAX_CHUNK_ALIGN only if they have less than 256 blocks, so chunks are
+	// 16, 16, 32, 64, 128, 255, 255, 255 blocks for 800 blocks.
+	InitMemoryPoolConfig(&config, 16 * 1024, 16, 16);
+	config.eGrowPolicy = GROW_GEOMETRIC;
+	config.uMaxChunkBlocks = 1024;
+	if ((0 == ret) && (8 != FUBGrowToPeak(&config, 800)))
+	{
+		PrintError("GROW_GEOMETRIC doesn't stop growing at MAX_CHUNK_ALIGN.");
+		ret = -1;
+	}
+
+	// Chunks of 64, 64, 128, 192, 256, 256, 256 blocks for 1000 blocks, callback is called for all but first.
+	InitMemoryPoolConfig(&config, MALLOC_MAX_LEN, GROW_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS);
+	config.eGrowPolicy = GROW_CALLBACK;
+	config.uMaxChunkBlocks = 4 * GROW_CHUNK_BLOCKS;
+	config.pGrowCallback = FUBGrowByChunks;
+	config.pGrowArg = &uCalls;
+	if ((0 == ret) && ((7 != FUBGrowToPeak(&config, 1000)) || (6 != uCalls)))
+	{
+		PrintError("GROW_CALLBACK doesn't grow as callback decides up to uMaxChunkBlocks.");
+		ret = -1;
+	}
+	printf("Memory pool grow policy tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
 /**
  * @brief Tester for FULMemoryPool.
  */
@@ -147,7 +357,28 @@ int FUBMemoryPoolTester()
 #else
 	FUBMemoryPoolRandomTester();
 #endif
-	return 0;
+	return ((0 == FUBMemoryPoolBatchTester()) && (0 == FUBMemoryPoolAlignTester())
+			&& (0 == FUBMemoryPoolGrowTester())) ? 0 : -1;
+}
+
+/**
+ * @brief FUB memory pool shared by threads behind a lock, for benchmark.
+ */
+DEFINE_LOCKED_ALLOCATOR(FUB, CreateMemoryPool(MALLOC_MAX_LEN, FIRST_CHUNK_BLOCKS, GROW_CHUNK_BLOCKS),
+		Malloc(pPool))
+
+/**
+ * @brief Benchmark of FUBMemoryPool with threads, pool is shared behind a lock.
+ *
+ * @param uMaxThreads Most threads to run with.
+ */
+int FUBMemoryPoolBenchmark(unsigned int uMaxThreads)
+{
+	const BenchAllocator_t pAllocators[] = {
+			{"FUB pool, locked", FUBBenchCreate, FUBBenchDestroy, FUBBenchMalloc, FUBBenchFree}
+	};
+
+	return RunBenchmark(pAllocators, sizeof(pAllocators) / sizeof(BenchAllocator_t), 1, uMaxThreads);
 }
 
 #endif /* ENABLE_FUBMemoryPool */
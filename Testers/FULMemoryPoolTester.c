@@ -13,6 +13,39 @@
 
 #ifdef ENABLE_FULMemoryPool
 
+/**
+ * @brief Tester for MallocBatch/FreeBatch of FULMemoryPool, blocks got by a batch must be distinct and
+ * writable, also when got again after they are backed.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int FULMemoryPoolBatchTester()
+{
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	int ret = 0;
+
+	PrintLog("Now testing memory pool MallocBatch/FreeBatch, FUL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	for (int i=0; (i<2) && (0 == ret); ++i)
+	{
+		unsigned int uGot = MallocBatch(pPool, pPtrs, TEST_BATCH_BLOCKS);
+		if (TEST_BATCH_BLOCKS != uGot)
+		{
+			PrintError("MallocBatch got less blocks than wanted.");
+			ret = -1;
+		}
+		else
+		{
+			ret = CheckBlocks(pPtrs, uGot, MALLOC_MAX_LEN);
+		}
+		FreeBatch(pPool, pPtrs, uGot);
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool MallocBatch/FreeBatch tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
 /**
  * @brief Tester for FULMemoryPool.
  */
@@ -48,7 +81,26 @@ int FULMemoryPoolTester()
 			TEST_MALLOC_TIMES, TEST_RETRY_TIMES, costTime);
 
 	free(pStrings);
-	return 0;
+	return FULMemoryPoolBatchTester();
+}
+
+/**
+ * @brief FUL memory pool shared by threads behind a lock, for benchmark.
+ */
+DEFINE_LOCKED_ALLOCATOR(FUL, CreateMemoryPool(MALLOC_MAX_LEN), Malloc(pPool))
+
+/**
+ * @brief Benchmark of FULMemoryPool with threads, pool is shared behind a lock.
+ *
+ * @param uMaxThreads Most threads to run with.
+ */
+int FULMemoryPoolBenchmark(unsigned int uMaxThreads)
+{
+	const BenchAllocator_t pAllocators[] = {
+			{"FUL pool, locked", FULBenchCreate, FULBenchDestroy, FULBenchMalloc, FULBenchFree}
+	};
+
+	return RunBenchmark(pAllocators, sizeof(pAllocators) / sizeof(BenchAllocator_t), 1, uMaxThreads);
 }
 
 #endif /* ENABLE_FULMemoryPool */
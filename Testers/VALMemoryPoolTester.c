@@ -9,12 +9,374 @@
  */
 
 #include "../VALMemoryPool/MemoryPool.h"
+#include "../VALMemoryPool/ThreadCache.h"
+#include "../VALMemoryPool/ShardedPool.h"
+#include "../VALMemoryPool/StringTable.h"
 #include "../MemoryPoolTester.h"
 #include <time.h>
 #include <sys/time.h>
 
 #ifdef ENABLE_VALMemoryPool
 
+/**
+ * @brief Tester for MallocBatch/FreeBatch of VALMemoryPool, blocks got by a batch must be distinct and
+ * writable, also when got again after they are backed.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VALMemoryPoolBatchTester()
+{
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	const size_t uSize = MALLOC_MAX_LEN / 3;
+	int ret = 0;
+
+	PrintLog("Now testing memory pool MallocBatch/FreeBatch, VAL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	for (int i=0; (i<2) && (0 == ret); ++i)
+	{
+		unsigned int uGot = MallocBatch(pPool, uSize, pPtrs, TEST_BATCH_BLOCKS);
+		if (TEST_BATCH_BLOCKS != uGot)
+		{
+			PrintError("MallocBatch got less blocks than wanted.");
+			ret = -1;
+		}
+		else
+		{
+			ret = CheckBlocks(pPtrs, uGot, uSize);
+		}
+		FreeBatch(pPool, pPtrs, uGot);
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool MallocBatch/FreeBatch tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for Realloc of VALMemoryPool, string grows in its size class, moves to bigger classes and
+ * big blocks, is remapped when mapped, then shrinks back to pool, and keeps its content all the time.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VALMemoryPoolReallocTester()
+{
+	// 10 and 16 bytes are in the same size class, 64 KiB is mapped, so 1 MiB is remapped.
+	const size_t aSizes[] = {10, 16, 100, MALLOC_MAX_LEN, 2 * MALLOC_MAX_LEN, 64 * 1024, 1024 * 1024, 100};
+	const unsigned int uSteps = sizeof(aSizes) / sizeof(size_t);
+	int ret = 0;
+
+	PrintLog("Now testing memory pool Realloc, VAL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	void *pPtr = Malloc(pPool, aSizes[0]);
+	FillPattern(pPtr, aSizes[0]);
+	for (unsigned int i=1; (i<uSteps) && (0 == ret); ++ i)
+	{
+		void *pNewPtr = Realloc(pPool, pPtr, aSizes[i]);
+		if ((NULL == pNewPtr)
+				|| (0 != CheckPattern(pNewPtr, (aSizes[i] < aSizes[i - 1]) ? aSizes[i] : aSizes[i - 1])))
+		{
+			PrintError("Realloc lost string in memory block.");
+			ret = -1;
+		}
+		else if ((1 == i) && (pNewPtr != pPtr))
+		{
+			PrintError("Realloc moved string in the same size class.");
+			ret = -1;
+		}
+		pPtr = (NULL == pNewPtr) ? pPtr : pNewPtr;
+		(0 == ret) ? FillPattern(pPtr, aSizes[i]) : (void)0;
+	}
+	Free(pPool, pPtr);
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool Realloc tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Check a pool string has the same content as a string, and length saved in its block is right.
+ *
+ * @param pPool Which pool the string in.
+ * @param pStr Pool string, NULL if failed to get it.
+ * @param pRef String it should be.
+ * @param uLen Length of pRef.
+ * @return 0 if right, -1 if not.
+ */
+int VALCheckPoolString(MemoryPool_t *pPool, const char *pStr, const char *pRef, size_t uLen)
+{
+	if ((NULL == pStr) || (uLen != PoolStrLen(pPool, pStr)) || (0 != strcmp(pStr, pRef)))
+	{
+		PrintError("Pool string is not the same as string copied, or its length is wrong.");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Tester for pool strings of VALMemoryPool, length saved at the end of block must be right when
+ * string is copied, cut, and appended until it is a big block, also by itself.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VALMemoryPoolStringTester()
+{
+	char aRef[4 * MALLOC_MAX_LEN + 4];
+	size_t uLen = 0;
+	int ret = 0;
+
+	PrintLog("Now testing memory pool strings, VAL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+
+	// Lengths around the end of blocks of small size classes.
+	for (uLen=0; (uLen<200) && (0 == ret); ++ uLen)
+	{
+		memset(aRef, 'a' + uLen % 26, uLen);
+		aRef[uLen] = '\0';
+		char *pStr = PoolStrDup(pPool, aRef);
+		ret = VALCheckPoolString(pPool, pStr, aRef, uLen);
+		Free(pPool, pStr);
+
+		pStr = PoolStrNDup(pPool, aRef, uLen / 2);
+		aRef[uLen / 2] = '\0';
+		(0 == ret) ? (ret = VALCheckPoolString(pPool, pStr, aRef, uLen / 2)) : 0;
+		Free(pPool, pStr);
+	}
+
+	// Append string to itself until it is a big block, then append another string.
+	strcpy(aRef, "ab");
+	uLen = strlen(aRef);
+	char *pStr = PoolStrDup(pPool, aRef);
+	while ((0 == ret) && (uLen * 2 <= 4 * MALLOC_MAX_LEN))
+	{
+		char *pNewStr = PoolStrCat(pPool, pStr, pStr);
+		memcpy(aRef + uLen, aRef, uLen);
+		uLen *= 2;
+		aRef[uLen] = '\0';
+		ret = VALCheckPoolString(pPool, pNewStr, aRef, uLen);
+		pStr = (NULL == pNewStr) ? pStr : pNewStr;
+	}
+	if (0 == ret)
+	{
+		char *pNewStr = PoolStrCat(pPool, pStr, "xyz");
+		strcpy(aRef + uLen, "xyz");
+		uLen += 3;
+		ret = VALCheckPoolString(pPool, pNewStr, aRef, uLen);
+		pStr = (NULL == pNewStr) ? pStr : pNewStr;
+	}
+	Free(pPool, pStr);
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool strings tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for string table on VALMemoryPool, the same string is interned at the same address,
+ * string is taken out when its last reference is released, and strings following it in probe sequence are
+ * still found.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VALMemoryPoolStringTableTester()
+{
+	const char *pStrings[TEST_BATCH_BLOCKS];
+	char aStr[32];
+	int ret = 0;
+
+	PrintLog("Now testing string table, VAL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	StringTable_t *pTable = CreateStringTable(pPool);
+
+	// The same string has the same address, however it is interned.
+	const char *pHello = InternString(pTable, "hello");
+	if ((NULL == pHello) || (pHello != InternString(pTable, "hello"))
+			|| (pHello != InternStringN(pTable, "hello world", 5)) || (pHello != RetainString(pHello))
+			|| (pHello == InternString(pTable, "world")) || (2 != pTable->uStrings))
+	{
+		PrintError("The same string is interned at different addresses.");
+		ret = -1;
+	}
+
+	// It stays in table until the last of its four references is released.
+	for (int i=0; (i<3) && (0 == ret); ++ i)
+	{
+		ReleaseString(pTable, pHello);
+		ret = (2 == pTable->uStrings) ? 0 : -1;
+	}
+	ReleaseString(pTable, pHello);
+	if ((0 != ret) || (1 != pTable->uStrings) || (0 != strcmp(InternString(pTable, "hello"), "hello")))
+	{
+		PrintError("Interned string is taken out of table before its last reference is released.");
+		ret = -1;
+	}
+
+	// Release every other string, the rest must still be found after slots are filled by moving them back.
+	for (int i=0; i<TEST_BATCH_BLOCKS; ++ i)
+	{
+		sprintf(aStr, "string %d", i);
+		pStrings[i] = InternString(pTable, aStr);
+	}
+	for (int i=0; i<TEST_BATCH_BLOCKS; i+=2)
+	{
+		ReleaseString(pTable, pStrings[i]);
+	}
+	for (int i=1; (i<TEST_BATCH_BLOCKS) && (0 == ret); i+=2)
+	{
+		sprintf(aStr, "string %d", i);
+		if (pStrings[i] != InternString(pTable, aStr))
+		{
+			PrintError("Interned string is lost after other strings are released.");
+			ret = -1;
+		}
+		ReleaseString(pTable, pStrings[i]);
+	}
+	if ((0 == ret) && (2 + TEST_BATCH_BLOCKS / 2 != pTable->uStrings))
+	{
+		PrintError("Number of strings in table is wrong.");
+		ret = -1;
+	}
+
+	DestroyStringTable(&pTable);
+	DestroyMemoryPool(&pPool);
+	printf("String table tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Thread of thread cache tester, it allocates and frees blocks, then exits with blocks in its cache.
+ *
+ * @param pArg Pool with cache in every thread.
+ * @return Number of blocks pool had using before thread exits, blocks in cache of thread are counted.
+ */
+void *VALThreadCacheTestThread(void *pArg)
+{
+	CachedPool_t *pCachedPool = (CachedPool_t *)pArg;
+	void *pPtrs[TEST_BATCH_BLOCKS];
+
+	for (int i=0; i<TEST_BATCH_BLOCKS; ++ i)
+	{
+		pPtrs[i] = CachedMalloc(pCachedPool, i + 1);
+	}
+	for (int i=0; i<TEST_BATCH_BLOCKS; ++ i)
+	{
+		CachedFree(pCachedPool, pPtrs[i]);
+	}
+	pthread_mutex_lock(&(pCachedPool->lock));
+	unsigned long uUsing = pCachedPool->pPool->uUsing;
+	pthread_mutex_unlock(&(pCachedPool->lock));
+
+	return (void *)uUsing;
+}
+
+/**
+ * @brief Tester for thread cache of VALMemoryPool, blocks cached by a thread must be given back to pool
+ * when it exits.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VALMemoryPoolThreadCacheTester()
+{
+	pthread_t thread;
+	void *pUsing = NULL;
+	int ret = 0;
+
+	PrintLog("Now testing thread cache drained when thread exits, VAL memory pool.");
+	CachedPool_t *pCachedPool = CreateCachedPool(MALLOC_MAX_LEN);
+	if ((NULL == pCachedPool) || (0 != pthread_create(&thread, NULL, VALThreadCacheTestThread, pCachedPool)))
+	{
+		PrintError("Failed to create thread cache tester.");
+		ret = -1;
+	}
+	else
+	{
+		pthread_join(thread, &pUsing);
+		if ((0 == (unsigned long)pUsing) || (0 != pCachedPool->pPool->uUsing))
+		{
+			PrintError("Blocks cached by thread are not given back to pool when it exits.");
+			ret = -1;
+		}
+	}
+	(NULL != pCachedPool) ? DestroyCachedPool(&pCachedPool) : (void)0;
+	printf("Thread cache tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Thread of sharded pool tester, frees blocks allocated on all CPUs, on the CPU it runs on.
+ *
+ * @param pArg Blocks to free, the first pointer is the pool, followed by a block of every shard.
+ * @return NULL.
+ */
+void *VALShardedTestThread(void *pArg)
+{
+	void **pPtrs = (void **)pArg;
+	ShardedPool_t *pShardedPool = (ShardedPool_t *)pPtrs[0];
+
+	for (unsigned int i=0; i<pShardedPool->uShards; ++ i)
+	{
+		ShardedFree(pShardedPool, pPtrs[i + 1]);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Tester for sharded pool of VALMemoryPool, blocks allocated on every CPU and freed by another
+ * thread on any CPU must be given back to the shards they were allocated from.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VALMemoryPoolShardedTester()
+{
+	pthread_t thread;
+	int ret = 0;
+
+	PrintLog("Now testing ShardedFree across CPUs, VAL memory pool.");
+	ShardedPool_t *pShardedPool = CreateShardedPool(MALLOC_MAX_LEN);
+	void **pPtrs = (NULL != pShardedPool)
+			? (void **)malloc(sizeof(void *) * (pShardedPool->uShards + 1)) : NULL;
+	if (NULL == pPtrs)
+	{
+		PrintError("Failed to create sharded pool tester.");
+		(NULL != pShardedPool) ? DestroyShardedPool(&pShardedPool) : (void)0;
+		return -1;
+	}
+
+	// Take a block from every shard, as threads on every CPU would do.
+	pPtrs[0] = pShardedPool;
+	for (unsigned int i=0; i<pShardedPool->uShards; ++ i)
+	{
+		pthread_mutex_lock(&(pShardedPool->pShards[i].lock));
+		pPtrs[i + 1] = Malloc(pShardedPool->pShards[i].pPool, i + 1);
+		pthread_mutex_unlock(&(pShardedPool->pShards[i].lock));
+	}
+	if (0 != pthread_create(&thread, NULL, VALShardedTestThread, pPtrs))
+	{
+		PrintError("Failed to create sharded pool tester.");
+		ret = -1;
+	}
+	else
+	{
+		pthread_join(thread, NULL);
+		for (unsigned int i=0; (i<pShardedPool->uShards) && (0 == ret); ++ i)
+		{
+			if (0 != pShardedPool->pShards[i].pPool->uUsing)
+			{
+				PrintError("Block freed on other CPU is not given back to shard allocated it.");
+				ret = -1;
+			}
+		}
+	}
+	free(pPtrs);
+	DestroyShardedPool(&pShardedPool);
+	printf("Sharded pool tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
 /**
  * @brief Tester for VALMemoryPool.
  */
@@ -67,7 +429,99 @@ int VALMemoryPoolTester()
 			TEST_MALLOC_TIMES, TEST_RETRY_TIMES, costTime);
 
 	free(pStrings);
-	return 0;
+	return ((0 == VALMemoryPoolBatchTester()) && (0 == VALMemoryPoolReallocTester())
+			&& (0 == VALMemoryPoolStringTester()) && (0 == VALMemoryPoolStringTableTester())
+			&& (0 == VALMemoryPoolThreadCacheTester()) && (0 == VALMemoryPoolShardedTester())) ? 0 : -1;
+}
+
+/**
+ * @brief VAL memory pool shared by threads behind a lock, for benchmark.
+ */
+DEFINE_LOCKED_ALLOCATOR(VAL, CreateMemoryPool(MALLOC_MAX_LEN), Malloc(pPool, uSize))
+
+/**
+ * @brief Create VAL memory pool with cache in every thread, for benchmark.
+ */
+void *VALCachedBenchCreate(void)
+{
+	return CreateCachedPool(MALLOC_MAX_LEN);
+}
+
+/**
+ * @brief Destroy VAL memory pool with cache in every thread.
+ */
+void VALCachedBenchDestroy(void *pAllocator)
+{
+	CachedPool_t *pCachedPool = (CachedPool_t *)pAllocator;
+	DestroyCachedPool(&pCachedPool);
+}
+
+/**
+ * @brief Allocate from VAL memory pool with cache in every thread.
+ */
+void *VALCachedBenchMalloc(void *pAllocator, size_t uSize)
+{
+	return CachedMalloc((CachedPool_t *)pAllocator, uSize);
+}
+
+/**
+ * @brief Free to VAL memory pool with cache in every thread.
+ */
+void VALCachedBenchFree(void *pAllocator, void *pPtr)
+{
+	CachedFree((CachedPool_t *)pAllocator, pPtr);
+}
+
+/**
+ * @brief Create VAL memory pool sharded by CPU, for benchmark.
+ */
+void *VALShardedBenchCreate(void)
+{
+	return CreateShardedPool(MALLOC_MAX_LEN);
+}
+
+/**
+ * @brief Destroy VAL memory pool sharded by CPU.
+ */
+void VALShardedBenchDestroy(void *pAllocator)
+{
+	ShardedPool_t *pShardedPool = (ShardedPool_t *)pAllocator;
+	DestroyShardedPool(&pShardedPool);
+}
+
+/**
+ * @brief Allocate from VAL memory pool sharded by CPU.
+ */
+void *VALShardedBenchMalloc(void *pAllocator, size_t uSize)
+{
+	return ShardedMalloc((ShardedPool_t *)pAllocator, uSize);
+}
+
+/**
+ * @brief Free to VAL memory pool sharded by CPU.
+ */
+void VALShardedBenchFree(void *pAllocator, void *pPtr)
+{
+	ShardedFree((ShardedPool_t *)pAllocator, pPtr);
+}
+
+/**
+ * @brief Benchmark of VALMemoryPool with threads, pool is shared behind a lock, and by its thread caches
+ * and CPU shards.
+ *
+ * @param uMaxThreads Most threads to run with.
+ */
+int VALMemoryPoolBenchmark(unsigned int uMaxThreads)
+{
+	const BenchAllocator_t pAllocators[] = {
+			{"VAL pool, locked", VALBenchCreate, VALBenchDestroy, VALBenchMalloc, VALBenchFree},
+			{"VAL pool, thread cache", VALCachedBenchCreate, VALCachedBenchDestroy, VALCachedBenchMalloc,
+				VALCachedBenchFree},
+			{"VAL pool, sharded by CPU", VALShardedBenchCreate, VALShardedBenchDestroy, VALShardedBenchMalloc,
+				VALShardedBenchFree}
+	};
+
+	return RunBenchmark(pAllocators, sizeof(pAllocators) / sizeof(BenchAllocator_t), 0, uMaxThreads);
 }
 
 #endif /* ENABLE_VALMemoryPool */
@@ -1,7 +1,168 @@
-/*
- * VUBMemoryPoolTester.c
+/**
+ * @file   VUBMemoryPoolTester.c
  *
- *  Created on: Oct 19, 2011
- *      Author: user
+ * @date   Oct 19, 2011
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Test program for VUBMemoryPool.
+ */
+
+#include "../VUBMemoryPool/MemoryPool.h"
+#include "../MemoryPoolTester.h"
+#include <time.h>
+#include <sys/time.h>
+
+#ifdef ENABLE_VUBMemoryPool
+
+/**
+ * @brief Tester for MallocBatch/FreeBatch of VUBMemoryPool, blocks got by a batch must be distinct and
+ * writable, also when got again after they are backed.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VUBMemoryPoolBatchTester()
+{
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	const unsigned short uSize = MALLOC_MAX_LEN / 3;
+	int ret = 0;
+
+	PrintLog("Now testing memory pool MallocBatch/FreeBatch, VUB memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	for (int i=0; (i<2) && (0 == ret); ++i)
+	{
+		unsigned int uGot = MallocBatch(pPool, uSize, pPtrs, TEST_BATCH_BLOCKS);
+		if (TEST_BATCH_BLOCKS != uGot)
+		{
+			PrintError("MallocBatch got less blocks than wanted.");
+			ret = -1;
+		}
+		else
+		{
+			ret = CheckBlocks(pPtrs, uGot, uSize);
+		}
+		FreeBatch(pPool, pPtrs, uGot);
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool MallocBatch/FreeBatch tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for big blocks of VUBMemoryPool, big blocks mixed with blocks of pool must be distinct and
+ * writable, and given back by Free() and FreeBatch() in any order, also when hash table of them grows.
+ *
+ * @return 0 if succeed, -1 if failed.
  */
+int VUBMemoryPoolBigBlockTester()
+{
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	int ret = 0;
+
+	PrintLog("Now testing memory pool big blocks, VUB memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	for (int i=0; (i<2) && (0 == ret); ++i)
+	{
+		for (int j=0; j<TEST_BATCH_BLOCKS; ++j)
+		{
+			pPtrs[j] = Malloc(pPool, (0 == j % 3) ? MALLOC_MAX_LEN : (MALLOC_MAX_LEN + 1 + j));
+		}
+		ret = CheckBlocks(pPtrs, TEST_BATCH_BLOCKS, MALLOC_MAX_LEN);
+
+		// Back half of blocks one by one from the end, the others at once.
+		for (int j=TEST_BATCH_BLOCKS-1; j>=TEST_BATCH_BLOCKS/2; --j)
+		{
+			Free(pPool, pPtrs[j]);
+		}
+		FreeBatch(pPool, pPtrs, TEST_BATCH_BLOCKS / 2);
+		if ((NULL != pPool->pFirstBigBlock) || (0 != pPool->uBigBlocks))
+		{
+			PrintError("Big blocks are not given back.");
+			ret = -1;
+		}
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool big blocks tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for VUBMemoryPool.
+ */
+int VUBMemoryPoolTester()
+{
+	// To compute used time.
+	struct timeval startTime, endTime;
+	unsigned long long costTime = 0ULL;
+
+	// To store available memory address got from system or pool.
+	char **pStrings = (char **)malloc(sizeof(char *) * TEST_MALLOC_TIMES);
+	// Generate variable length of string.
+	int aStrLen[TEST_MALLOC_TIMES];
+	srand((unsigned int)time(NULL) + rand());
+	for (int i=0; i<TEST_MALLOC_TIMES; ++i)
+	{
+		aStrLen[i] = rand() % MALLOC_MAX_LEN;
+		srand(aStrLen[i]);
+	}
+
+	// Memory pool Malloc/Free test.
+	PrintLog("Now testing memory pool Malloc/Free, VUB memory pool.");
+	gettimeofday(&startTime, NULL);
+
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	for (int i=0; i<TEST_RETRY_TIMES; ++i)
+	{
+		for (int j=0; j<TEST_MALLOC_TIMES; ++j)
+		{
+			pStrings[j] = Malloc(pPool, sizeof(char) * (aStrLen[j] + 1));
+			//GenerateRandStr(pStrings[j], aStrLen[j]);
+			*pStrings[j] = '\0';
+		}
+		for (int j=0; j<TEST_MALLOC_TIMES; ++j)
+		{
+			Free(pPool, pStrings[j]);
+		}
+	}
+	/*
+	 * The following code tests when wants to allocate a big block memory than pool can do, then deliver
+	 * action to system, and record this memory, when destroy memory pool, all allocated big block will
+	 * be release.
+	 */
+	/*for (int i=0; i<TEST_MALLOC_TIMES; ++i)
+	{
+		pStrings[i] = Malloc(pPool, sizeof(char) * (aStrLen[i] + MALLOC_MAX_LEN));
+	}*/
+	DestroyMemoryPool(&pPool);
+
+	gettimeofday(&endTime, NULL);
+	costTime = 1000 * 1000 * (endTime.tv_sec - startTime.tv_sec) + endTime.tv_usec - startTime.tv_usec;
+	printf("Memory pool Malloc/Free tested, malloc and free %d strings for %d times, cost %llu us.\n",
+			TEST_MALLOC_TIMES, TEST_RETRY_TIMES, costTime);
+
+	free(pStrings);
+	return ((0 == VUBMemoryPoolBatchTester()) && (0 == VUBMemoryPoolBigBlockTester())) ? 0 : -1;
+}
+
+/**
+ * @brief VUB memory pool shared by threads behind a lock, for benchmark.
+ */
+DEFINE_LOCKED_ALLOCATOR(VUB, CreateMemoryPool(MALLOC_MAX_LEN), Malloc(pPool, (unsigned short)uSize))
+
+/**
+ * @brief Benchmark of VUBMemoryPool with threads, pool is shared behind a lock.
+ *
+ * @param uMaxThreads Most threads to run with.
+ */
+int VUBMemoryPoolBenchmark(unsigned int uMaxThreads)
+{
+	const BenchAllocator_t pAllocators[] = {
+			{"VUB pool, locked", VUBBenchCreate, VUBBenchDestroy, VUBBenchMalloc, VUBBenchFree}
+	};
+
+	return RunBenchmark(pAllocators, sizeof(pAllocators) / sizeof(BenchAllocator_t), 0, uMaxThreads);
+}
 
+#endif /* ENABLE_VUBMemoryPool */
@@ -15,6 +15,81 @@
 
 #ifdef ENABLE_VULMemoryPool
 
+/**
+ * @brief Tester for MallocBatch/FreeBatch of VULMemoryPool, blocks got by a batch must be distinct and
+ * writable, also when got again after they are backed.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VULMemoryPoolBatchTester()
+{
+	void *pPtrs[TEST_BATCH_BLOCKS];
+	const size_t uSize = MALLOC_MAX_LEN / 3;
+	int ret = 0;
+
+	PrintLog("Now testing memory pool MallocBatch/FreeBatch, VUL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	for (int i=0; (i<2) && (0 == ret); ++i)
+	{
+		unsigned int uGot = MallocBatch(pPool, uSize, pPtrs, TEST_BATCH_BLOCKS);
+		if (TEST_BATCH_BLOCKS != uGot)
+		{
+			PrintError("MallocBatch got less blocks than wanted.");
+			ret = -1;
+		}
+		else
+		{
+			ret = CheckBlocks(pPtrs, uGot, uSize);
+		}
+		FreeBatch(pPool, pPtrs, uGot);
+	}
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool MallocBatch/FreeBatch tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
+/**
+ * @brief Tester for Realloc of VULMemoryPool, string grows in its size class, moves to bigger classes and
+ * big blocks, is remapped when mapped, then shrinks back to pool, and keeps its content all the time.
+ *
+ * @return 0 if succeed, -1 if failed.
+ */
+int VULMemoryPoolReallocTester()
+{
+	// 10 and 16 bytes are in the same size class, 64 KiB is mapped, so 1 MiB is remapped.
+	const size_t aSizes[] = {10, 16, 100, MALLOC_MAX_LEN, 2 * MALLOC_MAX_LEN, 64 * 1024, 1024 * 1024, 100};
+	const unsigned int uSteps = sizeof(aSizes) / sizeof(size_t);
+	int ret = 0;
+
+	PrintLog("Now testing memory pool Realloc, VUL memory pool.");
+	MemoryPool_t *pPool = CreateMemoryPool(MALLOC_MAX_LEN);
+	void *pPtr = Malloc(pPool, aSizes[0]);
+	FillPattern(pPtr, aSizes[0]);
+	for (unsigned int i=1; (i<uSteps) && (0 == ret); ++ i)
+	{
+		void *pNewPtr = Realloc(pPool, pPtr, aSizes[i]);
+		if ((NULL == pNewPtr)
+				|| (0 != CheckPattern(pNewPtr, (aSizes[i] < aSizes[i - 1]) ? aSizes[i] : aSizes[i - 1])))
+		{
+			PrintError("Realloc lost string in memory block.");
+			ret = -1;
+		}
+		else if ((1 == i) && (pNewPtr != pPtr))
+		{
+			PrintError("Realloc moved string in the same size class.");
+			ret = -1;
+		}
+		pPtr = (NULL == pNewPtr) ? pPtr : pNewPtr;
+		(0 == ret) ? FillPattern(pPtr, aSizes[i]) : (void)0;
+	}
+	Free(pPool, pPtr);
+	DestroyMemoryPool(&pPool);
+	printf("Memory pool Realloc tested, %s.\n", (0 == ret) ? "succeed" : "failed");
+
+	return ret;
+}
+
 /**
  * @brief Tester for VULMemoryPool.
  */
@@ -67,7 +142,26 @@ int VULMemoryPoolTester()
 			TEST_MALLOC_TIMES, TEST_RETRY_TIMES, costTime);
 
 	free(pStrings);
-	return 0;
+	return ((0 == VULMemoryPoolBatchTester()) && (0 == VULMemoryPoolReallocTester())) ? 0 : -1;
+}
+
+/**
+ * @brief VUL memory pool shared by threads behind a lock, for benchmark.
+ */
+DEFINE_LOCKED_ALLOCATOR(VUL, CreateMemoryPool(MALLOC_MAX_LEN), Malloc(pPool, uSize))
+
+/**
+ * @brief Benchmark of VULMemoryPool with threads, pool is shared behind a lock.
+ *
+ * @param uMaxThreads Most threads to run with.
+ */
+int VULMemoryPoolBenchmark(unsigned int uMaxThreads)
+{
+	const BenchAllocator_t pAllocators[] = {
+			{"VUL pool, locked", VULBenchCreate, VULBenchDestroy, VULBenchMalloc, VULBenchFree}
+	};
+
+	return RunBenchmark(pAllocators, sizeof(pAllocators) / sizeof(BenchAllocator_t), 0, uMaxThreads);
 }
 
 #endif /* ENABLE_VULMemoryPool */
@@ -0,0 +1,604 @@
+/**
+ * @file   VABMemoryPool/MemoryPool.c
+ *
+ * @date   Oct 19, 2011
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Variable length, Able to recycle, Block store style memory pool.
+ */
+
+// The following macro designed for test purpose only, delete it when using.
+#include "../MemoryPoolTester.h"
+#ifdef ENABLE_VABMemoryPool
+
+#include "MemoryPool.h"
+
+/**
+ * @brief Get slot a big block should be in, the first slot of its probe sequence in hash table.
+ *
+ * @param pPool Which pool the hash table in.
+ * @param pPtr Address of big block.
+ * @return Index of slot.
+ */
+inline unsigned int GetBigBlockHome(MemoryPool_t *pPool, void *pPtr)
+{
+	return (unsigned int)((((unsigned long long)(unsigned long)pPtr >> 4) * 0x9E3779B97F4A7C15ULL)
+			>> (sizeof(unsigned long long) * CHAR_BIT - __builtin_ctz(pPool->uBigSlots)));
+}
+
+/**
+ * @brief Get slot of a big block in hash table, or the empty slot it should be put in.
+ *
+ * @param pPool Which pool the hash table in.
+ * @param pPtr Address of big block.
+ * @return Index of slot.
+ */
+inline unsigned int GetBigBlockSlot(MemoryPool_t *pPool, void *pPtr)
+{
+	unsigned int uMask = pPool->uBigSlots - 1;
+	unsigned int uSlot = GetBigBlockHome(pPool, pPtr);
+	while ((NULL != pPool->pBigTable[uSlot]) && ((void *)pPool->pBigTable[uSlot] + BIG_HEAD_SIZE != pPtr))
+	{
+		uSlot = (uSlot + 1) & uMask;
+	}
+
+	return uSlot;
+}
+
+/**
+ * @brief Find information of a big block by its address.
+ *
+ * @param pPool Which pool the block in.
+ * @param pPtr Address of memory block.
+ * @return Information of big block, NULL if block is not a big block.
+ */
+inline BigBlock_t *FindBigBlock(MemoryPool_t *pPool, void *pPtr)
+{
+	return (0 == pPool->uBigBlocks) ? NULL : pPool->pBigTable[GetBigBlockSlot(pPool, pPtr)];
+}
+
+/**
+ * @brief Put a big block into hash table, table is doubled if half of it is used.
+ *
+ * @param pPool Which pool the hash table in.
+ * @param pBigBlock Information of big block.
+ * @return 1 if succeed, 0 if failed.
+ */
+inline char AddBigBlock(MemoryPool_t *pPool, BigBlock_t *pBigBlock)
+{
+	if ((pPool->uBigBlocks + 1) * 2 > pPool->uBigSlots)
+	{
+		unsigned int uOldSlots = pPool->uBigSlots;
+		BigBlock_t **pOldTable = pPool->pBigTable;
+		unsigned int uSlots = (0 == uOldSlots) ? BIG_TABLE_SIZE : (uOldSlots << 1);
+		BigBlock_t **pTable = (BigBlock_t **)calloc(uSlots, sizeof(BigBlock_t *));
+		if (NULL == pTable)
+		{
+			PrintError("Failed to malloc memory from system.");
+			return 0;
+		}
+		pPool->pBigTable = pTable;
+		pPool->uBigSlots = uSlots;
+		for (unsigned int i=0; i<uOldSlots; ++ i)
+		{
+			(NULL != pOldTable[i])
+					? (pTable[GetBigBlockSlot(pPool, (void *)pOldTable[i] + BIG_HEAD_SIZE)] = pOldTable[i]) : 0;
+		}
+		free(pOldTable);
+	}
+	pPool->pBigTable[GetBigBlockSlot(pPool, (void *)pBigBlock + BIG_HEAD_SIZE)] = pBigBlock;
+	++ (pPool->uBigBlocks);
+
+	return 1;
+}
+
+/**
+ * @brief Take a big block out of hash table, following blocks of the same probe sequence are moved back,
+ * so that searching doesn't stop at the hole.
+ *
+ * @param pPool Which pool the hash table in.
+ * @param pBigBlock Information of big block, it must be in table.
+ */
+inline void RemoveBigBlock(MemoryPool_t *pPool, BigBlock_t *pBigBlock)
+{
+	unsigned int uMask = pPool->uBigSlots - 1;
+	unsigned int uHole = GetBigBlockSlot(pPool, (void *)pBigBlock + BIG_HEAD_SIZE);
+	unsigned int uNext = uHole;
+	unsigned int uHome = 0;
+
+	pPool->pBigTable[uHole] = NULL;
+	-- (pPool->uBigBlocks);
+	while (NULL != pPool->pBigTable[uNext = ((uNext + 1) & uMask)])
+	{
+		// Block can fill the hole if the hole is not before its first slot.
+		uHome = GetBigBlockHome(pPool, (void *)pPool->pBigTable[uNext] + BIG_HEAD_SIZE);
+		if (((uNext - uHome) & uMask) >= ((uNext - uHole) & uMask))
+		{
+			pPool->pBigTable[uHole] = pPool->pBigTable[uNext];
+			pPool->pBigTable[uNext] = NULL;
+			uHole = uNext;
+		}
+	}
+}
+
+/**
+ * @brief Create memory pool, so can allocate memory after that.
+ *
+ * It doesn't means can't get memory if bigger than given size, pool will deliver to system functions,
+ * so that performance is equal as system. When destroy pool, all chunks and big blocks will be released,
+ * no matter they are using or not.
+ *
+ * @param uMaxStrLen Max length of string this pool can allocate.
+ * @return Created memory pool.
+ */
+MemoryPool_t *CreateMemoryPool(unsigned short uMaxStrLen)
+{
+	uMaxStrLen = (uMaxStrLen > MAX_STRING_LEN) ? MAX_STRING_LEN : uMaxStrLen;
+	uMaxStrLen = (0 == uMaxStrLen) ? 1 : uMaxStrLen;
+	unsigned short uFreeTableLen = GetIndex(uMaxStrLen) + 1;
+
+	MemoryPool_t *pPool = (MemoryPool_t *)malloc(sizeof(MemoryPool_t) + (sizeof(BlockTable_t) * uFreeTableLen));
+	if (NULL == pPool)
+	{
+		PrintError("Failed to malloc memory pool from system.");
+		return NULL;
+	}
+	pPool->uMaxSize = uMaxStrLen;
+	pPool->uEmptyChunks = 0;
+	pPool->pEmptyChunk = NULL;
+	pPool->pFirstBigBlock = NULL;
+	pPool->pBigTable = NULL;
+	pPool->uBigSlots = 0;
+	pPool->uBigBlocks = 0;
+	pPool->pTable = (BlockTable_t *)((void *)pPool + sizeof(MemoryPool_t));
+	for (int i=0; i<uFreeTableLen; ++i)
+	{
+		pPool->pTable[i].pPartialChunk = NULL;
+		pPool->pTable[i].pFullChunk = NULL;
+	}
+
+	return pPool;
+}
+
+/**
+ * @brief Release all chunks in a chunk list.
+ *
+ * @param pChunk First chunk of list.
+ */
+inline void ReleaseChunkList(MemoryChunk_t *pChunk)
+{
+	MemoryChunk_t *pPreChunk = NULL;
+	while(NULL != pChunk)
+	{
+		pPreChunk = pChunk;
+		pChunk = pChunk->pNextChunk;
+		free(pPreChunk);
+	}
+}
+
+/**
+ * @brief Destroy memory pool, release all chunks and all blocks bigger than max size pool can allocate.
+ *
+ * @param pPool Which pool to destroy, set to NULL when finished to destroy.
+ */
+void DestroyMemoryPool(MemoryPool_t **pPool)
+{
+	assert(NULL != *pPool);
+	BigBlock_t *pCurrBlock = NULL;
+	BigBlock_t *pPreBlock = NULL;
+
+	// Release chunks of all size classes.
+	unsigned short uFreeTableLen = GetIndex((*pPool)->uMaxSize) + 1;
+	for (int i=0; i<uFreeTableLen; ++i)
+	{
+		ReleaseChunkList((*pPool)->pTable[i].pPartialChunk);
+		ReleaseChunkList((*pPool)->pTable[i].pFullChunk);
+	}
+
+	// Release idle chunks.
+	ReleaseChunkList((*pPool)->pEmptyChunk);
+
+	// Release blocks bigger than pool can allocate.
+	pCurrBlock = (*pPool)->pFirstBigBlock;
+	while(NULL != pCurrBlock)
+	{
+		pPreBlock = pCurrBlock;
+		pCurrBlock = pCurrBlock->pNext;
+		free(pPreBlock);
+	}
+	free((*pPool)->pBigTable);
+
+	// Release pool.
+	free(*pPool);
+	*pPool = NULL;
+}
+
+/**
+ * @brief Link a chunk at the head of a chunk list.
+ *
+ * @param pList Address of first chunk pointer of list.
+ * @param pChunk Chunk to link.
+ */
+inline void LinkChunk(MemoryChunk_t **pList, MemoryChunk_t *pChunk)
+{
+	pChunk->pPreChunk = NULL;
+	pChunk->pNextChunk = *pList;
+	(NULL != *pList) ? ((*pList)->pPreChunk = pChunk) : 0;
+	*pList = pChunk;
+}
+
+/**
+ * @brief Unlink a chunk from a chunk list.
+ *
+ * @param pList Address of first chunk pointer of list.
+ * @param pChunk Chunk to unlink, must be in this list.
+ */
+inline void UnlinkChunk(MemoryChunk_t **pList, MemoryChunk_t *pChunk)
+{
+	(NULL == pChunk->pPreChunk) ? (*pList = pChunk->pNextChunk)
+	                            : (pChunk->pPreChunk->pNextChunk = pChunk->pNextChunk);
+	(NULL != pChunk->pNextChunk) ? (pChunk->pNextChunk->pPreChunk = pChunk->pPreChunk) : 0;
+}
+
+/**
+ * @brief Allocate a chunk aligned to CHUNK_SIZE from system.
+ *
+ * @param pPool Which pool the chunk belongs to.
+ * @param uLen Length of chunk, include chunk information.
+ * @return Allocated chunk, NULL if failed.
+ */
+inline MemoryChunk_t *AllocateChunk(MemoryPool_t *pPool, size_t uLen)
+{
+	MemoryChunk_t *pChunk = NULL;
+	if (0 != posix_memalign((void **)&pChunk, CHUNK_SIZE, uLen))
+	{
+		PrintError("Failed to malloc memory from system.");
+		return NULL;
+	}
+	pChunk->pPool = pPool;
+
+	return pChunk;
+}
+
+/**
+ * @brief Get an idle chunk or allocate a new one, and make it a chunk of given size class.
+ *
+ * @param pPool Which pool the chunk belongs to.
+ * @param uIndex Size class of blocks in chunk.
+ * @return Chunk which all blocks are available, NULL if failed.
+ */
+inline MemoryChunk_t *GetChunkForClass(MemoryPool_t *pPool, unsigned short uIndex)
+{
+	MemoryChunk_t *pChunk = pPool->pEmptyChunk;
+	if (NULL != pChunk)
+	{
+		UnlinkChunk(&(pPool->pEmptyChunk), pChunk);
+		--pPool->uEmptyChunks;
+	}
+	else if (NULL == (pChunk = AllocateChunk(pPool, CHUNK_SIZE)))
+	{
+		return NULL;
+	}
+
+	pChunk->uIndex = uIndex;
+	pChunk->uBlocks = (CHUNK_SIZE - sizeof(MemoryChunk_t)) / ((uIndex + 1) * ALIGN_SIZE);
+	pChunk->uBlocksAvailable_ = pChunk->uBlocks;
+	pChunk->uFirstNeverUsed_ = 0;
+	pChunk->pFirstNode_ = NULL;
+
+	return pChunk;
+}
+
+/**
+ * @brief Get the chunk to allocate blocks of a size class from, it is the first partial chunk of class,
+ * if class has no partial chunk, get a chunk for this class.
+ *
+ * @param pPool Which pool the size class in.
+ * @param uIndex Index of size class.
+ * @return Chunk which has available blocks, NULL if failed.
+ */
+inline MemoryChunk_t *GetAvailableChunk(MemoryPool_t *pPool, unsigned short uIndex)
+{
+	SizeClass_t *pClass = &(pPool->pTable[uIndex]);
+	MemoryChunk_t *pChunk = pClass->pPartialChunk;
+	if (NULL == pChunk)
+	{
+		pChunk = GetChunkForClass(pPool, uIndex);
+		if (NULL == pChunk)
+		{
+			return NULL;
+		}
+		LinkChunk(&(pClass->pPartialChunk), pChunk);
+	}
+
+	return pChunk;
+}
+
+/**
+ * @biref Get a memory block from pool.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory.
+ */
+void *Malloc(MemoryPool_t *pPool, unsigned short uSize)
+{
+	assert(NULL != pPool);
+	assert(0 != uSize);
+	MemoryChunk_t *pChunk = NULL;
+	BigBlock_t *pBigBlock = NULL;
+	void *pPtr = NULL;
+
+	// If user want to allocate a memory bigger than pool can do, deliver this to system and record it.
+	if (uSize > pPool->uMaxSize)
+	{
+		pBigBlock = (BigBlock_t *)malloc(BIG_HEAD_SIZE + uSize);
+		if (NULL == pBigBlock)
+		{
+			PrintError("Failed to malloc memory from system.");
+			return NULL;
+		}
+		if (!AddBigBlock(pPool, pBigBlock))
+		{
+			free(pBigBlock);
+			return NULL;
+		}
+		pBigBlock->pPre = NULL;
+		pBigBlock->pNext = pPool->pFirstBigBlock;
+		(NULL != pPool->pFirstBigBlock) ? (pPool->pFirstBigBlock->pPre = pBigBlock) : 0;
+		pPool->pFirstBigBlock = pBigBlock;
+
+		return (void *)pBigBlock + BIG_HEAD_SIZE;
+	}
+
+	// Get block from the first partial chunk of this class.
+	unsigned short uIndex = GetIndex(uSize);
+	SizeClass_t *pClass = &(pPool->pTable[uIndex]);
+	pChunk = GetAvailableChunk(pPool, uIndex);
+	if (NULL == pChunk)
+	{
+		return NULL;
+	}
+
+	// Idle blocks given back by Free() are used first, then never used blocks.
+	if (NULL != pChunk->pFirstNode_)
+	{
+		pPtr = (void *)pChunk->pFirstNode_;
+		pChunk->pFirstNode_ = pChunk->pFirstNode_->pNext;
+	}
+	else
+	{
+		pPtr = (void *)pChunk + sizeof(MemoryChunk_t) + (size_t)pChunk->uFirstNeverUsed_ * (uIndex + 1) * ALIGN_SIZE;
+		++pChunk->uFirstNeverUsed_;
+	}
+
+	// If chunk is used up, move it to full list.
+	if (0 == --pChunk->uBlocksAvailable_)
+	{
+		UnlinkChunk(&(pClass->pPartialChunk), pChunk);
+		LinkChunk(&(pClass->pFullChunk), pChunk);
+	}
+
+	return pPtr;
+}
+
+/**
+ * @brief Get chunk of a block by masking its address, chunks are aligned to CHUNK_SIZE.
+ *
+ * @param pPtr Address of block.
+ * @return Chunk the block in.
+ */
+inline MemoryChunk_t *GetChunkOfBlock(void *pPtr)
+{
+	return (MemoryChunk_t *)((unsigned long)pPtr & ~((unsigned long)CHUNK_SIZE - 1));
+}
+
+/**
+ * @brief All blocks of chunk are back, it leaves its class, keep it for any class to use, or release it
+ * to system if there are enough idle chunks.
+ *
+ * @param pPool Which pool the chunk in.
+ * @param pChunk Chunk whose blocks are all available, it is in partial list of its class.
+ */
+inline void RecycleEmptyChunk(MemoryPool_t *pPool, MemoryChunk_t *pChunk)
+{
+	UnlinkChunk(&(pPool->pTable[pChunk->uIndex].pPartialChunk), pChunk);
+	if (pPool->uEmptyChunks < RECYCLE_IF_MORETHAN_CHUNKS)
+	{
+		LinkChunk(&(pPool->pEmptyChunk), pChunk);
+		++pPool->uEmptyChunks;
+	}
+	else
+	{
+		free(pChunk);
+	}
+}
+
+/**
+ * @brief Back a memory block to pool, if all blocks of its chunk are back, the chunk is recycled.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtr Address of memory block to back.
+ */
+void Free(MemoryPool_t *pPool, void *pPtr)
+{
+	if (NULL == pPool)
+	{
+		PrintWarning("A ptr will be freed but memory pool already been destroy.");
+		return;
+	}
+	if (NULL == pPtr)
+	{
+		return;
+	}
+
+	// Check if big blocks allocated from system directly, if so, release it to system, pool won't use it.
+	BigBlock_t *pBigBlock = FindBigBlock(pPool, pPtr);
+	if (NULL != pBigBlock)
+	{
+		RemoveBigBlock(pPool, pBigBlock);
+		(NULL == pBigBlock->pPre) ? (pPool->pFirstBigBlock = pBigBlock->pNext)
+		                          : (pBigBlock->pPre->pNext = pBigBlock->pNext);
+		(NULL != pBigBlock->pNext) ? (pBigBlock->pNext->pPre = pBigBlock->pPre) : 0;
+		free(pBigBlock);
+		return;
+	}
+
+	MemoryChunk_t *pChunk = GetChunkOfBlock(pPtr);
+	if (pChunk->pPool != pPool)
+	{
+		PrintWarning("Not found this memory block in pool.");
+		return;
+	}
+
+	// Back the memory block to its chunk, a full chunk has available block again.
+	SizeClass_t *pClass = &(pPool->pTable[pChunk->uIndex]);
+	if (0 == pChunk->uBlocksAvailable_)
+	{
+		UnlinkChunk(&(pClass->pFullChunk), pChunk);
+		LinkChunk(&(pClass->pPartialChunk), pChunk);
+	}
+	Node_t *pNode = (Node_t *)pPtr;
+	pNode->pNext = pChunk->pFirstNode_;
+	pChunk->pFirstNode_ = pNode;
+
+	// If all blocks of chunk are back, recycle it.
+	if (++pChunk->uBlocksAvailable_ == pChunk->uBlocks)
+	{
+		RecycleEmptyChunk(pPool, pChunk);
+	}
+}
+
+/**
+ * @brief Get many memory blocks of the same size from pool at once, blocks are taken from a chunk in one
+ * pass, and chunk lists are updated once for every chunk instead of once for every block.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @param pPtrs Where to save addresses of allocated memory.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, unsigned short uSize, void **pPtrs, unsigned int uCount)
+{
+	assert(NULL != pPool);
+	assert(0 != uSize);
+	unsigned int uGot = 0;
+	MemoryChunk_t *pChunk = NULL;
+
+	// Big blocks are allocated from system and recorded one by one.
+	if (uSize > pPool->uMaxSize)
+	{
+		for (; uGot < uCount; ++ uGot)
+		{
+			pPtrs[uGot] = Malloc(pPool, uSize);
+			if (NULL == pPtrs[uGot])
+			{
+				break;
+			}
+		}
+		return uGot;
+	}
+
+	unsigned short uIndex = GetIndex(uSize);
+	unsigned short uLen = (uIndex + 1) * ALIGN_SIZE;
+	SizeClass_t *pClass = &(pPool->pTable[uIndex]);
+	while (uGot < uCount)
+	{
+		pChunk = GetAvailableChunk(pPool, uIndex);
+		if (NULL == pChunk)
+		{
+			break;
+		}
+
+		unsigned short uTake = pChunk->uBlocksAvailable_;
+		uTake = ((uCount - uGot) < uTake) ? (unsigned short)(uCount - uGot) : uTake;
+		pChunk->uBlocksAvailable_ -= uTake;
+
+		// Idle blocks given back by Free() are used first, then never used blocks following each other.
+		for (; (0 != uTake) && (NULL != pChunk->pFirstNode_); -- uTake)
+		{
+			pPtrs[uGot ++] = (void *)pChunk->pFirstNode_;
+			pChunk->pFirstNode_ = pChunk->pFirstNode_->pNext;
+		}
+		void *pBlock = (void *)pChunk + sizeof(MemoryChunk_t) + (size_t)pChunk->uFirstNeverUsed_ * uLen;
+		pChunk->uFirstNeverUsed_ += uTake;
+		for (; 0 != uTake; -- uTake)
+		{
+			pPtrs[uGot ++] = pBlock;
+			pBlock += uLen;
+		}
+
+		// If chunk is used up, move it to full list.
+		if (0 == pChunk->uBlocksAvailable_)
+		{
+			UnlinkChunk(&(pClass->pPartialChunk), pChunk);
+			LinkChunk(&(pClass->pFullChunk), pChunk);
+		}
+	}
+
+	return uGot;
+}
+
+/**
+ * @brief Back many memory blocks to pool at once. Blocks following each other in the same chunk are
+ * linked to the chunk in one pass, and chunk lists are updated once for them instead of once for every
+ * block, so give back blocks grouped by chunk, such as in the order MallocBatch() allocated them.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtrs Addresses of memory blocks to back.
+ * @param uCount Number of memory blocks to back.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	unsigned int i = 0;
+	MemoryChunk_t *pChunk = NULL;
+	Node_t *pNode = NULL;
+
+	if (NULL == pPool)
+	{
+		PrintWarning("Ptrs will be freed but memory pool already been destroy.");
+		return;
+	}
+
+	while (i < uCount)
+	{
+		// Big blocks and blocks not belong to this pool are given back one by one, big blocks are not in
+		// chunks, so they are looked up before masking.
+		if ((NULL != FindBigBlock(pPool, pPtrs[i])) || ((pChunk = GetChunkOfBlock(pPtrs[i]))->pPool != pPool))
+		{
+			Free(pPool, pPtrs[i ++]);
+			continue;
+		}
+
+		// Link all following blocks of this chunk to its idle list.
+		Node_t *pFirstNode = pChunk->pFirstNode_;
+		unsigned short uBack = 0;
+		for (; (i < uCount) && (GetChunkOfBlock(pPtrs[i]) == pChunk); ++ i)
+		{
+			pNode = (Node_t *)pPtrs[i];
+			pNode->pNext = pFirstNode;
+			pFirstNode = pNode;
+			++ uBack;
+		}
+
+		// A full chunk has available blocks again.
+		SizeClass_t *pClass = &(pPool->pTable[pChunk->uIndex]);
+		if (0 == pChunk->uBlocksAvailable_)
+		{
+			UnlinkChunk(&(pClass->pFullChunk), pChunk);
+			LinkChunk(&(pClass->pPartialChunk), pChunk);
+		}
+		pChunk->pFirstNode_ = pFirstNode;
+		pChunk->uBlocksAvailable_ += uBack;
+
+		// If all blocks of chunk are back, recycle it.
+		if (pChunk->uBlocksAvailable_ == pChunk->uBlocks)
+		{
+			RecycleEmptyChunk(pPool, pChunk);
+		}
+	}
+}
+
+#endif /* ENABLE_VABMemoryPool */
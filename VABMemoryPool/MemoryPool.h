@@ -0,0 +1,221 @@
+/**
+ * @file   VABMemoryPool/MemoryPool.h
+ *
+ * @date   Oct 19, 2011
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Variable length, Able to recycle, Block store style memory pool.
+ *
+ * Data structure:
+ *
+ * MemoryPool_t             0      align   2*align   3*align           (n-1)*align
+ * +--------+          ~align   ~2*align  ~3*align  ~4*align    ...    ~n*align
+ * |        |       +---------+---------+---------+---------+---------+-----------+
+ * | pTable |  -->  |  Class  |  Class  |  Class  |  Class  |   ...   |   Class   |
+ * |        |       +---------+---------+---------+---------+---------+-----------+
+ * +--------+          |    |
+ * |        |          |    |  pFullChunk      MemoryChunk_t        MemoryChunk_t
+ * |  uMax  |          |    ------------->  +-----------------+  +-----------------+
+ * |  Size  |          |                    |  uIndex/uBlocks |  |  uIndex/uBlocks |
+ * |        |          |                    +-----------------+  +-----------------+
+ * +--------+          |  pPartialChunk     |ThisBlockIsUsingN|  |ThisBlockIsUsingN|
+ * |        |          ---------------->    +-----------------+  +-----------------+
+ * | pEmpty |                               |     ......      |  |     ......      |
+ * | Chunk  | ---> idle chunks, any class   +-----------------+  +-----------------+
+ * |        |
+ * +--------+
+ * |  pBig  |
+ * |  Block | ---> blocks bigger than pool can allocate
+ * +--------+
+ *
+ *   Every size class (ALIGN_SIZE steps) takes blocks from its own chunks, which are kept in a partial list
+ * and a full list of the class as FABMemoryPool does. A chunk is CHUNK_SIZE bytes and aligned to CHUNK_SIZE,
+ * blocks in it have the same size and are taken from idle list of chunk first, then never used blocks are
+ * taken one by one. Blocks have no header, Free() masks address of block to get its chunk.
+ *
+ *   Big blocks bigger than pool can allocate are allocated from system by malloc() with a BigBlock_t in
+ * front of them, and kept in a hash table by address, Free() looks up it first when pool has big blocks.
+ *
+ *   When all blocks of a chunk are back, the chunk leaves its class. Since all chunks have the same size,
+ * at most RECYCLE_IF_MORETHAN_CHUNKS idle chunks are kept for any class to use, others are released to
+ * system, so memory of pool is bounded by blocks really using.
+ */
+
+#ifndef MEMORYPOOL_H_
+#define MEMORYPOOL_H_
+
+#include "../CProjectDfn.h"
+#include <limits.h>
+
+/**
+ * @brief Size of every chunk, must be 2^n, every chunk is aligned to this size.
+ */
+#define CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Max length of string pool can allocate, if bigger than this when creating, down to this size.
+ * A chunk can at least have two blocks following its information.
+ */
+#define MAX_STRING_LEN (((CHUNK_SIZE - sizeof(MemoryChunk_t)) / 2) & ~(ALIGN_SIZE - 1))
+
+/**
+ * @brief Align size, must be 2^n
+ */
+#define ALIGN_SIZE 8
+
+/**
+ * @brief Initial number of slots in hash table of big blocks, must be 2^n.
+ */
+#define BIG_TABLE_SIZE 16
+
+/**
+ * @brief Maximum number of idle chunks in memory pool, if more than these, release them.
+ * Released memory has to be got from system again when using more, so don't make it too small.
+ */
+#define RECYCLE_IF_MORETHAN_CHUNKS 16
+
+/**
+ * @brief Allocate size of memory, if it not used, let the first four block save the pointer pointed to
+ * next free allocated memory, if this memory are using, [data] is the first address of this memory.
+ */
+typedef union Node
+{
+	union Node *pNext;    ///< If this memory is idle, this pointed to next free memory block.
+	char data[1];         ///< If this memory is using, this is the address of this block.
+}Node_t;
+
+/**
+ * @brief Memory chunk information, it is at the beginning of a chunk, blocks of a size class follow it.
+ */
+typedef struct MemoryChunk
+{
+	unsigned short uIndex;              ///< Size class of blocks in this chunk.
+	unsigned short uBlocks;             ///< Number of blocks in this chunk.
+	unsigned short uBlocksAvailable_;   ///< Number of available blocks, include never used blocks.
+	unsigned short uFirstNeverUsed_;    ///< Index of first block never used since chunk joined its class.
+	Node_t *pFirstNode_;                ///< First idle block given back by Free().
+	struct MemoryPoolInf *pPool;        ///< Pool this chunk belongs to, to check block given back by Free().
+	struct MemoryChunk *pNextChunk;     ///< Next chunk, this make up a chunk list.
+	struct MemoryChunk *pPreChunk;      ///< Previous chunk, to unlink chunk without search.
+}MemoryChunk_t;
+
+/**
+ * @brief Information of big block bigger than pool can allocate, it is in front of the big block.
+ */
+typedef struct BigBlock
+{
+	struct BigBlock *pNext;   ///< Next allocated big block if this not the last one.
+	struct BigBlock *pPre;    ///< Previous allocated big block if that exists.
+}BigBlock_t;
+
+/**
+ * @brief Size of information in front of big block, keeps block aligned as malloc() does.
+ */
+#define BIG_HEAD_SIZE ((sizeof(BigBlock_t) + 15) & ~15)
+
+/**
+ * @brief Size class, lists chunks which have blocks of the same size.
+ */
+typedef struct SizeClass
+{
+	MemoryChunk_t *pPartialChunk;   ///< Chunks which have available blocks, Malloc() gets from the first.
+	MemoryChunk_t *pFullChunk;      ///< Chunks without available blocks.
+}SizeClass_t;
+
+/**
+ * @brief Block table is an array, each elements describes blocks of a size class.
+ */
+typedef SizeClass_t BlockTable_t;
+
+/**
+ * @biref Information about memory pool.
+ */
+typedef struct MemoryPoolInf
+{
+	unsigned int uMaxSize;          ///< Longest block memory pool can allocate, if bigger, deliver to system.
+	BlockTable_t *pTable;           ///< An array, each describes blocks of a size class.
+	unsigned int uEmptyChunks;      ///< Number of idle chunks in pEmptyChunk.
+	MemoryChunk_t *pEmptyChunk;     ///< Idle chunks whose blocks are all available, not belong to any class.
+	BigBlock_t *pFirstBigBlock;     ///< If bigger than pool can allocate, pointed to list which contains them.
+	BigBlock_t **pBigTable;         ///< Hash table of big blocks by address, open addressing.
+	unsigned int uBigSlots;         ///< Number of slots in pBigTable, 2^n.
+	unsigned int uBigBlocks;        ///< Number of big blocks in pBigTable.
+}MemoryPool_t;
+
+/**
+ * @brief Align function, convert it to aligned size.
+ */
+inline unsigned short RoundUp(unsigned short size)
+{
+	return (((size) + (ALIGN_SIZE - 1)) & ~(ALIGN_SIZE - 1));
+}
+
+/**
+ * @brief Get index from block table by given size.
+ */
+inline unsigned short GetIndex(unsigned short size)
+{
+	return (((size) + (ALIGN_SIZE - 1)) / (ALIGN_SIZE) - 1);
+}
+
+/**
+ * @brief Create memory pool, so can allocate memory after that.
+ *
+ * It doesn't means can't get memory if bigger than given size, pool will deliver to system functions,
+ * so that performance is equal as system. When destroy pool, all chunks and big blocks will be released,
+ * no matter they are using or not.
+ *
+ * @param uMaxStrLen Max length of string this pool can allocate.
+ * @return Created memory pool.
+ */
+MemoryPool_t *CreateMemoryPool(unsigned short uMaxStrLen);
+
+/**
+ * @brief Destroy memory pool, release all chunks and all blocks bigger than max size pool can allocate.
+ *
+ * @param pPool Which pool to destroy, set to NULL when finished to destroy.
+ */
+void DestroyMemoryPool(MemoryPool_t **pPool);
+
+/**
+ * @biref Get a memory block from pool.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory.
+ */
+void *Malloc(MemoryPool_t *pPool, unsigned short uSize);
+
+/**
+ * @brief Back a memory block to pool, if all blocks of its chunk are back, the chunk is recycled.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtr Address of memory block to back.
+ */
+void Free(MemoryPool_t *pPool, void *pPtr);
+
+/**
+ * @brief Get many memory blocks of the same size from pool at once, blocks are taken from a chunk in one
+ * pass, and chunk lists are updated once for every chunk instead of once for every block.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @param pPtrs Where to save addresses of allocated memory.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, unsigned short uSize, void **pPtrs, unsigned int uCount);
+
+/**
+ * @brief Back many memory blocks to pool at once. Blocks following each other in the same chunk are
+ * linked to the chunk in one pass, and chunk lists are updated once for them instead of once for every
+ * block, so give back blocks grouped by chunk, such as in the order MallocBatch() allocated them.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtrs Addresses of memory blocks to back.
+ * @param uCount Number of memory blocks to back.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
+#endif /* MEMORYPOOL_H_ */
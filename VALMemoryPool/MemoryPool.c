@@ -18,65 +18,117 @@
  * @brief Create memory pool, so can allocate memory after that.
  *
  * It doesn't means can't get memory if bigger than given size, pool will deliver to system functions,
- * so that performance is equal as system. When destroy pool, make sure you have release all memory block
- * smaller than [uMaxStrLen], pool doesn't track them, if bigger than [uMaxStrLen], pool will release all
- * of them to prevent memory leak.
+ * so that performance is equal as system. When destroy pool, all slabs and big blocks will be released,
+ * no matter they are using or not.
  *
  * @param uMaxStrLen Max length of string this pool can allocate.
  * @return Created memory pool.
  */
-MemoryPool_t *CreateMemoryPool(unsigned short uMaxStrLen)
+MemoryPool_t *CreateMemoryPool(size_t uMaxStrLen)
 {
 	uMaxStrLen = (uMaxStrLen > MAX_STRING_LEN) ? MAX_STRING_LEN : uMaxStrLen;
+	uMaxStrLen = (0 == uMaxStrLen) ? 1 : uMaxStrLen;
 	unsigned short uFreeTableLen = GetIndex(uMaxStrLen) + 1;
+	unsigned short uBitmapLen = (uFreeTableLen + BITS_OF_WORD - 1) / BITS_OF_WORD;
 
-	MemoryPool_t *pPool = (MemoryPool_t *)malloc(sizeof(MemoryPool_t) + (sizeof(Head_t) * uFreeTableLen));
+	MemoryPool_t *pPool = (MemoryPool_t *)malloc(sizeof(MemoryPool_t) + (sizeof(Head_t) * uFreeTableLen)
+			+ (sizeof(unsigned long) * uBitmapLen));
+	if (NULL == pPool)
+	{
+		PrintError("Failed to malloc memory pool from system.");
+		return NULL;
+	}
 	pPool->uMaxSize = uMaxStrLen;
+	pPool->uSlabSize = SLAB_SIZE;
+	pPool->uOps = 0;
+	pPool->uUsing = 0;
+	pPool->uHighWater = 0;
+	pPool->uIdleBytes = 0;
+	pPool->uMaxIdleBytes = MAX_IDLE_BYTES;
+	pPool->uBorrowRatio = BORROW_MAX_RATIO;
 	pPool->pFirstBigBlock = NULL;
+	pPool->uBigBlocks = 0;
+	pPool->uBigBlockBytes = 0;
 	pPool->pTable = (BlockTable_t *)((void *)pPool + sizeof(MemoryPool_t));
 	for (int i=0; i<uFreeTableLen; ++i)
 	{
 		pPool->pTable[i].pFirstNode = NULL;
+		pPool->pTable[i].uBlockSize = GetClassSize(i);
 		pPool->pTable[i].uIdleNum = 0;
+		pPool->pTable[i].uIdleCap = MIN_IDLE_CAP;
+		pPool->pTable[i].uUsing = 0;
+		pPool->pTable[i].uLowWater = 0;
+		pPool->pTable[i].uHighWater = 0;
+		pPool->pTable[i].pFirstSlab = NULL;
+		pPool->pTable[i].pNextNeverUsed = NULL;
+		pPool->pTable[i].pEndOfSlab = NULL;
+	}
+	pPool->pNonEmpty = (unsigned long *)((void *)pPool->pTable + sizeof(Head_t) * uFreeTableLen);
+	for (int i=0; i<uBitmapLen; ++i)
+	{
+		pPool->pNonEmpty[i] = 0;
 	}
 
 	return pPool;
 }
 
 /**
- * @brief Destroy memory pool, release all idle memory block smaller than max size pool can allocate, and
- * release all blocks bigger than this size not matter using or not.
+ * @brief Release all slabs in a slab list.
+ *
+ * @param pSlab First slab of list.
+ */
+inline void ReleaseSlabList(Slab_t *pSlab)
+{
+	Slab_t *pPreSlab = NULL;
+	while(NULL != pSlab)
+	{
+		pPreSlab = pSlab;
+		pSlab = pSlab->pNextSlab;
+		free(pPreSlab);
+	}
+}
+
+/**
+ * @brief Release a big block to system, unmap it if it is mapped.
+ *
+ * @param pBigBlock Big block.
+ */
+inline void ReleaseBigBlock(Slab_t *pBigBlock)
+{
+	if (pBigBlock->uLength >= MMAP_THRESHOLD)
+	{
+		munmap(pBigBlock, pBigBlock->uLength);
+	}
+	else
+	{
+		free(pBigBlock);
+	}
+}
+
+/**
+ * @brief Destroy memory pool, release all slabs and all blocks bigger than max size pool can allocate.
  *
  * @param pPool Which pool to destroy, set to NULL when finished to destroy.
  */
 void DestroyMemoryPool(MemoryPool_t **pPool)
 {
 	assert(NULL != *pPool);
-	Node_t *pCurrNode = NULL;
-	Node_t *pPreNode = NULL;
-	BigBlock_t *pCurrBlock = NULL;
-	BigBlock_t *pPreBlock = NULL;
 
-	// Release idle blocks in pool.
+	// Release slabs of all size classes, idle blocks are in them.
 	unsigned short uFreeTableLen = GetIndex((*pPool)->uMaxSize) + 1;
 	for (int i=0; i<uFreeTableLen; ++i)
 	{
-		pCurrNode = (*pPool)->pTable[i].pFirstNode;
-		while(NULL != pCurrNode)
-		{
-			pPreNode = pCurrNode;
-			pCurrNode = pCurrNode->pNext;
-			free(pPreNode);
-		}
+		ReleaseSlabList((*pPool)->pTable[i].pFirstSlab);
 	}
 
 	// Release block which bigger than pool can allocate.
-	pCurrBlock = (*pPool)->pFirstBigBlock;
-	while(NULL != pCurrBlock)
+	Slab_t *pBigBlock = (*pPool)->pFirstBigBlock;
+	Slab_t *pPreBlock = NULL;
+	while(NULL != pBigBlock)
 	{
-		pPreBlock = pCurrBlock;
-		pCurrBlock = pCurrBlock->pNext;
-		free(pPreBlock);
+		pPreBlock = pBigBlock;
+		pBigBlock = pBigBlock->pNextSlab;
+		ReleaseBigBlock(pPreBlock);
 	}
 
 	// Release pool.
@@ -84,6 +136,457 @@ void DestroyMemoryPool(MemoryPool_t **pPool)
 	*pPool = NULL;
 }
 
+/**
+ * @brief Link a slab at the head of a slab list.
+ *
+ * @param pList Address of first slab pointer of list.
+ * @param pSlab Slab to link.
+ */
+inline void LinkSlab(Slab_t **pList, Slab_t *pSlab)
+{
+	pSlab->pPreSlab = NULL;
+	pSlab->pNextSlab = *pList;
+	(NULL != *pList) ? ((*pList)->pPreSlab = pSlab) : 0;
+	*pList = pSlab;
+}
+
+/**
+ * @brief Unlink a slab from a slab list.
+ *
+ * @param pList Address of first slab pointer of list.
+ * @param pSlab Slab to unlink, must be in this list.
+ */
+inline void UnlinkSlab(Slab_t **pList, Slab_t *pSlab)
+{
+	(NULL == pSlab->pPreSlab) ? (*pList = pSlab->pNextSlab)
+	                          : (pSlab->pPreSlab->pNextSlab = pSlab->pNextSlab);
+	(NULL != pSlab->pNextSlab) ? (pSlab->pNextSlab->pPreSlab = pSlab->pPreSlab) : 0;
+}
+
+/**
+ * @brief Allocate a slab aligned to slab size of pool from system.
+ *
+ * @param pPool Which pool the slab belongs to.
+ * @param uLen Length of slab, include slab information.
+ * @return Allocated slab, NULL if failed.
+ */
+inline Slab_t *AllocateSlab(MemoryPool_t *pPool, size_t uLen)
+{
+	Slab_t *pSlab = NULL;
+	if (0 != posix_memalign((void **)&pSlab, pPool->uSlabSize, uLen))
+	{
+		PrintError("Failed to malloc memory from system.");
+		return NULL;
+	}
+	pSlab->pPool = pPool;
+	pSlab->uLength = uLen;
+
+	return pSlab;
+}
+
+/**
+ * @brief Round length up to whole pages.
+ */
+inline size_t RoundUpToPage(size_t uLen)
+{
+	size_t uPageSize = sysconf(_SC_PAGESIZE);
+	return (uLen + uPageSize - 1) & ~(uPageSize - 1);
+}
+
+/**
+ * @brief Map memory aligned to slab size of pool from system. More than needed is mapped, then the parts
+ * before and after aligned memory are unmapped.
+ *
+ * @param pPool Which pool the memory belongs to.
+ * @param uLen Length of memory, whole pages.
+ * @return Mapped memory, NULL if failed.
+ */
+inline void *MapAligned(MemoryPool_t *pPool, size_t uLen)
+{
+	size_t uMapLen = uLen + pPool->uSlabSize - RoundUpToPage(1);
+	void *pMap = mmap(NULL, uMapLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == pMap)
+	{
+		PrintError("Failed to mmap memory from system.");
+		return NULL;
+	}
+	unsigned long uMask = (unsigned long)pPool->uSlabSize - 1;
+	void *pStart = (void *)(((unsigned long)pMap + uMask) & ~uMask);
+	(pStart != pMap) ? munmap(pMap, pStart - pMap) : 0;
+	(pStart + uLen != pMap + uMapLen) ? munmap(pStart + uLen, (pMap + uMapLen) - (pStart + uLen)) : 0;
+
+	return pStart;
+}
+
+/**
+ * @brief Map a big block aligned to slab size of pool from system in whole pages.
+ *
+ * @param pPool Which pool the big block belongs to.
+ * @param uLen Length of big block, include its information.
+ * @return Mapped big block, NULL if failed.
+ */
+inline Slab_t *MapBigBlock(MemoryPool_t *pPool, size_t uLen)
+{
+	uLen = RoundUpToPage(uLen);
+	Slab_t *pBigBlock = (Slab_t *)MapAligned(pPool, uLen);
+	if (NULL == pBigBlock)
+	{
+		return NULL;
+	}
+	pBigBlock->pPool = pPool;
+	pBigBlock->uLength = uLen;
+
+	return pBigBlock;
+}
+
+/**
+ * @brief Change length of a mapped big block by remapping its pages. If it can't grow in place, pages are
+ * moved to new memory aligned to slab size of pool without copy.
+ *
+ * @param pPool Which pool the big block belongs to.
+ * @param pBigBlock Mapped big block.
+ * @param uLen New length of big block, include its information, not smaller than MMAP_THRESHOLD.
+ * @return Remapped big block, NULL if failed and big block is not changed.
+ */
+inline Slab_t *RemapBigBlock(MemoryPool_t *pPool, Slab_t *pBigBlock, size_t uLen)
+{
+	size_t uOldLen = pBigBlock->uLength;
+	void *pStart = NULL;
+	void *pNew = NULL;
+
+	uLen = RoundUpToPage(uLen);
+	UnlinkSlab(&(pPool->pFirstBigBlock), pBigBlock);
+	pNew = mremap(pBigBlock, uOldLen, uLen, 0);
+	if (MAP_FAILED == pNew)
+	{
+		// Can't grow in place, move pages to new aligned memory.
+		pStart = MapAligned(pPool, uLen);
+		pNew = (NULL == pStart) ? MAP_FAILED
+		                        : mremap(pBigBlock, uOldLen, uLen, MREMAP_MAYMOVE | MREMAP_FIXED, pStart);
+		if (MAP_FAILED == pNew)
+		{
+			PrintError("Failed to mremap memory from system.");
+			(NULL != pStart) ? munmap(pStart, uLen) : 0;
+			LinkSlab(&(pPool->pFirstBigBlock), pBigBlock);
+			return NULL;
+		}
+	}
+	pBigBlock = (Slab_t *)pNew;
+	pBigBlock->uLength = uLen;
+	LinkSlab(&(pPool->pFirstBigBlock), pBigBlock);
+	pPool->uBigBlockBytes += uLen - uOldLen;
+
+	return pBigBlock;
+}
+
+/**
+ * @brief Allocate a big block from system and record it, if it is not smaller than MMAP_THRESHOLD, map it.
+ *
+ * @param pPool Which pool the big block belongs to.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory, NULL if failed.
+ */
+inline void *MallocBigBlock(MemoryPool_t *pPool, size_t uSize)
+{
+	if (uSize > SIZE_MAX - SLAB_HEAD_SIZE - pPool->uSlabSize)
+	{
+		PrintError("Size of string is too big to allocate.");
+		return NULL;
+	}
+	size_t uLen = SLAB_HEAD_SIZE + uSize;
+	Slab_t *pBigBlock = (uLen >= MMAP_THRESHOLD) ? MapBigBlock(pPool, uLen) : AllocateSlab(pPool, uLen);
+	if (NULL == pBigBlock)
+	{
+		return NULL;
+	}
+	pBigBlock->uIndex = BIG_BLOCK_INDEX;
+	LinkSlab(&(pPool->pFirstBigBlock), pBigBlock);
+	++ (pPool->uBigBlocks);
+	pPool->uBigBlockBytes += pBigBlock->uLength;
+
+	return (void *)pBigBlock + SLAB_HEAD_SIZE;
+}
+
+/**
+ * @brief Unlink a big block from big block list without search, and release it to system.
+ *
+ * @param pPool Which pool the big block belongs to.
+ * @param pBigBlock Big block.
+ */
+inline void FreeBigBlock(MemoryPool_t *pPool, Slab_t *pBigBlock)
+{
+	UnlinkSlab(&(pPool->pFirstBigBlock), pBigBlock);
+	-- (pPool->uBigBlocks);
+	pPool->uBigBlockBytes -= pBigBlock->uLength;
+	ReleaseBigBlock(pBigBlock);
+}
+
+/**
+ * @brief Get size of a block, the size of its class, or the length of big block without its information.
+ *
+ * @param pPool Which pool the block in.
+ * @param pSlab Slab the block in.
+ * @return Size of block user can use.
+ */
+inline size_t GetBlockSize(MemoryPool_t *pPool, Slab_t *pSlab)
+{
+	return (BIG_BLOCK_INDEX == pSlab->uIndex) ? (pSlab->uLength - SLAB_HEAD_SIZE)
+	                                          : pPool->pTable[pSlab->uIndex].uBlockSize;
+}
+
+/**
+ * @brief Allocate a new slab for a size class, following blocks never used are cut from it. Slab of blocks
+ * longer than LARGE_CLASS_SIZE has only one block.
+ *
+ * @param pPool Which pool the size class in.
+ * @param uIndex Index of size class.
+ * @return 1 if succeed, 0 if failed.
+ */
+inline char GrowSizeClass(MemoryPool_t *pPool, unsigned short uIndex)
+{
+	Head_t *pHead = &(pPool->pTable[uIndex]);
+	size_t uLen = (pHead->uBlockSize > LARGE_CLASS_SIZE) ? (SLAB_HEAD_SIZE + pHead->uBlockSize)
+	                                                     : pPool->uSlabSize;
+	Slab_t *pSlab = AllocateSlab(pPool, uLen);
+	if (NULL == pSlab)
+	{
+		return 0;
+	}
+	pSlab->uIndex = uIndex;
+	pSlab->uBlocks = (uLen - SLAB_HEAD_SIZE) / pHead->uBlockSize;
+	pSlab->uUsing_ = 0;
+	LinkSlab(&(pHead->pFirstSlab), pSlab);
+
+	pHead->pNextNeverUsed = (void *)pSlab + SLAB_HEAD_SIZE;
+	pHead->pEndOfSlab = pHead->pNextNeverUsed + (size_t)pSlab->uBlocks * pHead->uBlockSize;
+
+	return 1;
+}
+
+/**
+ * @brief Mark a size class has idle blocks in bitmap of pool.
+ *
+ * @param pPool Which pool the size class in.
+ * @param uIndex Index of size class.
+ */
+inline void SetNonEmpty(MemoryPool_t *pPool, unsigned short uIndex)
+{
+	pPool->pNonEmpty[uIndex / BITS_OF_WORD] |= 1UL << (uIndex % BITS_OF_WORD);
+}
+
+/**
+ * @brief Mark a size class has no idle block in bitmap of pool.
+ *
+ * @param pPool Which pool the size class in.
+ * @param uIndex Index of size class.
+ */
+inline void ClearNonEmpty(MemoryPool_t *pPool, unsigned short uIndex)
+{
+	pPool->pNonEmpty[uIndex / BITS_OF_WORD] &= ~(1UL << (uIndex % BITS_OF_WORD));
+}
+
+/**
+ * @brief Find the first size class has idle blocks in a range by bitmap of pool.
+ *
+ * @param pPool Which pool the size classes in.
+ * @param uFrom Index of the first size class to check.
+ * @param uTo Index of the last size class to check, must be in pool.
+ * @return Index of size class found, BIG_BLOCK_INDEX if none.
+ */
+inline unsigned short FindNonEmpty(MemoryPool_t *pPool, unsigned short uFrom, unsigned short uTo)
+{
+	unsigned long uWord = 0;
+	for (unsigned int i=uFrom/BITS_OF_WORD; i<=uTo/BITS_OF_WORD; ++ i)
+	{
+		uWord = pPool->pNonEmpty[i];
+		(i == uFrom / BITS_OF_WORD) ? (uWord &= ~0UL << (uFrom % BITS_OF_WORD)) : 0;
+		if (0 != uWord)
+		{
+			uFrom = i * BITS_OF_WORD + __builtin_ctzl(uWord);
+			return (uFrom <= uTo) ? uFrom : BIG_BLOCK_INDEX;
+		}
+	}
+
+	return BIG_BLOCK_INDEX;
+}
+
+/**
+ * @brief Take the first idle block out of list of a size class.
+ *
+ * @param pPool Which pool the size class in.
+ * @param uIndex Index of size class, it must have idle block.
+ * @return The first idle block.
+ */
+inline Node_t *PopNode(MemoryPool_t *pPool, unsigned short uIndex)
+{
+	Head_t *pHead = &(pPool->pTable[uIndex]);
+	Node_t *pNode = pHead->pFirstNode;
+	pHead->pFirstNode = pNode->pNext;
+	if (NULL != pHead->pFirstNode)
+	{
+		pHead->pFirstNode->pPre = NULL;
+	}
+	else
+	{
+		ClearNonEmpty(pPool, uIndex);
+	}
+	-- (pHead->uIdleNum);
+	pPool->uIdleBytes -= pHead->uBlockSize;
+
+	return pNode;
+}
+
+/**
+ * @brief Put an idle block at the head of list of a size class.
+ *
+ * @param pFirstNode Address of first idle block pointer of list.
+ * @param pNode Idle block.
+ */
+inline void PushNode(Node_t **pFirstNode, Node_t *pNode)
+{
+	pNode->pPre = NULL;
+	pNode->pNext = *pFirstNode;
+	(NULL != *pFirstNode) ? ((*pFirstNode)->pPre = pNode) : 0;
+	*pFirstNode = pNode;
+}
+
+/**
+ * @brief Take all blocks of an idle slab out of idle list of its size class, then release slab to system.
+ *
+ * @param pPool Which pool the slab in.
+ * @param pSlab Slab whose blocks are all idle, not the one blocks are cut from.
+ */
+inline void ReleaseEmptySlab(MemoryPool_t *pPool, Slab_t *pSlab)
+{
+	Head_t *pHead = &(pPool->pTable[pSlab->uIndex]);
+	size_t uLen = pHead->uBlockSize;
+	Node_t *pNode = (Node_t *)((void *)pSlab + SLAB_HEAD_SIZE);
+	for (unsigned int i=0; i<pSlab->uBlocks; ++ i)
+	{
+		(NULL == pNode->pPre) ? (pHead->pFirstNode = pNode->pNext) : (pNode->pPre->pNext = pNode->pNext);
+		(NULL != pNode->pNext) ? (pNode->pNext->pPre = pNode->pPre) : 0;
+		pNode = (Node_t *)((void *)pNode + uLen);
+	}
+	(NULL == pHead->pFirstNode) ? ClearNonEmpty(pPool, pSlab->uIndex) : (void)0;
+	pHead->uIdleNum -= pSlab->uBlocks;
+	pPool->uIdleBytes -= pSlab->uBlocks * uLen;
+	UnlinkSlab(&(pHead->pFirstSlab), pSlab);
+	free(pSlab);
+}
+
+/**
+ * @brief All blocks of slab are idle, release it to system if its size class still has uIdleCap idle
+ * blocks without it, or pool has too many idle blocks. The slab blocks are cut from is kept.
+ *
+ * @param pPool Which pool the slab in.
+ * @param pSlab Slab whose blocks are all idle.
+ */
+inline void RecycleEmptySlab(MemoryPool_t *pPool, Slab_t *pSlab)
+{
+	Head_t *pHead = &(pPool->pTable[pSlab->uIndex]);
+	if ((pSlab != pHead->pFirstSlab) && (((pHead->uIdleNum - pSlab->uBlocks) >= pHead->uIdleCap)
+			|| (pPool->uIdleBytes > pPool->uMaxIdleBytes)))
+	{
+		ReleaseEmptySlab(pPool, pSlab);
+	}
+}
+
+/**
+ * @brief Release idle slabs of a size class until it has no more than uIdleCap idle blocks, or pool is not
+ * above uMaxIdleBytes.
+ *
+ * @param pPool Which pool the size class in.
+ * @param uIndex Index of size class.
+ */
+inline void TrimSizeClass(MemoryPool_t *pPool, unsigned short uIndex)
+{
+	Head_t *pHead = &(pPool->pTable[uIndex]);
+	Slab_t *pSlab = (NULL == pHead->pFirstSlab) ? NULL : pHead->pFirstSlab->pNextSlab;
+	Slab_t *pNextSlab = NULL;
+	for (; (NULL != pSlab) && (pHead->uIdleNum > pHead->uIdleCap); pSlab = pNextSlab)
+	{
+		pNextSlab = pSlab->pNextSlab;
+		(0 == pSlab->uUsing_) ? ReleaseEmptySlab(pPool, pSlab) : (void)0;
+	}
+}
+
+/**
+ * @brief Adapt uIdleCap of every size class to the range blocks using went up and down since last time,
+ * or half of it if that is bigger, then release idle slabs more than it. Pool calls it by itself, call it
+ * to adapt at once, such as after uMaxIdleBytes is changed.
+ *
+ * @param pPool Which pool to adapt.
+ */
+void AdaptIdleCaps(MemoryPool_t *pPool)
+{
+	unsigned short uFreeTableLen = GetIndex(pPool->uMaxSize) + 1;
+	char bOverflow = (pPool->uIdleBytes > pPool->uMaxIdleBytes);
+	Head_t *pHead = NULL;
+	unsigned int uCap = 0;
+
+	pPool->uOps = 0;
+	pPool->uHighWater = pPool->uUsing;
+	for (int i=0; i<uFreeTableLen; ++i)
+	{
+		pHead = &(pPool->pTable[i]);
+		uCap = pHead->uHighWater - pHead->uLowWater;
+		uCap = (uCap > pHead->uIdleCap / 2) ? uCap : (pHead->uIdleCap / 2);
+		uCap = bOverflow ? (uCap / 2) : uCap;
+		pHead->uIdleCap = (uCap < MIN_IDLE_CAP) ? MIN_IDLE_CAP : uCap;
+		pHead->uLowWater = pHead->uUsing;
+		pHead->uHighWater = pHead->uUsing;
+		(pHead->uIdleNum > pHead->uIdleCap) ? TrimSizeClass(pPool, i) : (void)0;
+	}
+}
+
+/**
+ * @brief Check if it is time to adapt idle caps, blocks using should have had time to go up and down.
+ *
+ * @param pPool Which pool to check.
+ */
+inline void CheckAdaptIdleCaps(MemoryPool_t *pPool)
+{
+	if ((pPool->uOps >= ADAPT_EVERY_OPS) && ((pPool->uOps / 2) >= pPool->uHighWater))
+	{
+		AdaptIdleCaps(pPool);
+	}
+}
+
+/**
+ * @brief Count blocks of a size class got by user, adapt idle caps if it is time.
+ *
+ * @param pPool Which pool the size class in.
+ * @param uIndex Index of size class.
+ * @param uCount Number of blocks.
+ */
+inline void CountMalloc(MemoryPool_t *pPool, unsigned short uIndex, unsigned int uCount)
+{
+	Head_t *pHead = &(pPool->pTable[uIndex]);
+	pHead->uUsing += uCount;
+	(pHead->uUsing > pHead->uHighWater) ? (pHead->uHighWater = pHead->uUsing) : 0;
+	pPool->uUsing += uCount;
+	(pPool->uUsing > pPool->uHighWater) ? (pPool->uHighWater = pPool->uUsing) : 0;
+	pPool->uOps += uCount;
+	CheckAdaptIdleCaps(pPool);
+}
+
+/**
+ * @brief Count blocks of a size class given back by user, adapt idle caps if it is time.
+ *
+ * @param pPool Which pool the size class in.
+ * @param uIndex Index of size class.
+ * @param uCount Number of blocks.
+ */
+inline void CountFree(MemoryPool_t *pPool, unsigned short uIndex, unsigned int uCount)
+{
+	Head_t *pHead = &(pPool->pTable[uIndex]);
+	pHead->uUsing -= uCount;
+	(pHead->uUsing < pHead->uLowWater) ? (pHead->uLowWater = pHead->uUsing) : 0;
+	pPool->uUsing -= uCount;
+	pPool->uOps += uCount;
+	CheckAdaptIdleCaps(pPool);
+}
+
 /**
  * @biref Get a memory block from pool.
  *
@@ -91,50 +594,56 @@ void DestroyMemoryPool(MemoryPool_t **pPool)
  * @param uSize Size of string want to allocate.
  * @return Allocated memory.
  */
-void *Malloc(MemoryPool_t *pPool, unsigned short uSize)
+void *Malloc(MemoryPool_t *pPool, size_t uSize)
 {
 	assert(NULL != pPool);
 	assert(0 != uSize);
-	unsigned short uIndex = GetIndex(uSize);
 	void *pPtr = NULL;
 
 	// If user want to allocate a memory bigger than pool can do, deliver this to system and record it.
 	if (uSize > pPool->uMaxSize)
 	{
-		pPtr = malloc(sizeof(BigBlock_t) + sizeof(unsigned short) + uSize);
-		*((unsigned short *)(pPtr + sizeof(BigBlock_t))) = uSize;
-		BigBlock_t *pBigBlock = (BigBlock_t *)pPtr;
-		pBigBlock->data = pPtr + sizeof(BigBlock_t) + sizeof(unsigned short);
-		pBigBlock->pNext = pPool->pFirstBigBlock;
-		pBigBlock->pPre = NULL;
-		(NULL != pPool->pFirstBigBlock) ? (pPool->pFirstBigBlock->pPre = pBigBlock) : 0;
-		pPool->pFirstBigBlock = pBigBlock;
-
-		return pBigBlock->data;
+		return MallocBigBlock(pPool, uSize);
 	}
 
-	// Check if there are idle blocks can be use again, or allocate new blocks from system.
-	if (NULL != (pPool->pTable[uIndex].pFirstNode))
+	// Check if there are idle blocks can be use again, or cut a never used block from slab.
+	unsigned short uIndex = GetIndex(uSize);
+	Head_t *pHead = &(pPool->pTable[uIndex]);
+	if (NULL != pHead->pFirstNode)
+	{
+		pPtr = (void *)PopNode(pPool, uIndex);
+	}
+	else if (pHead->pNextNeverUsed != pHead->pEndOfSlab)
 	{
-		pPtr = (void *)&(pPool->pTable[uIndex].pFirstNode->data);
-		pPool->pTable[uIndex].pFirstNode = pPool->pTable[uIndex].pFirstNode->pNext;
-		-- (pPool->pTable[uIndex].uIdleNum);
-		*(unsigned short *)pPtr = uSize;
-		pPtr += sizeof(unsigned short);
+		pPtr = pHead->pNextNeverUsed;
+		pHead->pNextNeverUsed += pHead->uBlockSize;
 	}
 	else
 	{
-		unsigned short uLen = sizeof(unsigned short) + RoundUp(uSize);
-		uLen = (uLen > sizeof(Node_t)) ? uLen : sizeof(Node_t);
-		pPtr = malloc(uLen);
-		if (NULL == pPtr)
+		// Use idle block of a bigger class at most uBorrowRatio times as big before allocating a new slab.
+		size_t uLimit = pHead->uBlockSize * pPool->uBorrowRatio;
+		uLimit = (uLimit < pPool->uMaxSize) ? uLimit : pPool->uMaxSize;
+		unsigned short uLast = (uLimit > pHead->uBlockSize) ? GetIndex(uLimit) : uIndex;
+		unsigned short uFound = BIG_BLOCK_INDEX;
+		((uLast > uIndex) && (GetClassSize(uLast) > uLimit)) ? -- uLast : 0;
+		(uIndex < uLast) ? (uFound = FindNonEmpty(pPool, uIndex + 1, uLast)) : 0;
+		if (BIG_BLOCK_INDEX != uFound)
 		{
-			PrintError("Failed to malloc memory from system.");
-			return NULL;
+			pPtr = (void *)PopNode(pPool, uFound);
+		}
+		else
+		{
+			if (!GrowSizeClass(pPool, uIndex))
+			{
+				return NULL;
+			}
+			pPtr = pHead->pNextNeverUsed;
+			pHead->pNextNeverUsed += pHead->uBlockSize;
 		}
-		*(unsigned short *)pPtr = uSize;
-		pPtr += sizeof(unsigned short);
 	}
+	Slab_t *pSlab = GetSlabOfBlock(pPool, pPtr);
+	++ (pSlab->uUsing_);
+	CountMalloc(pPool, pSlab->uIndex, 1);
 
 	return pPtr;
 }
@@ -150,35 +659,365 @@ void Free(MemoryPool_t *pPool, void *pPtr)
 	if (NULL == pPool)
 	{
 		PrintWarning("A ptr will be freed but memory pool already been destroy.");
-		free(pPtr);
+		return;
+	}
+	if (NULL == pPtr)
+	{
+		return;
+	}
+
+	Slab_t *pSlab = GetSlabOfBlock(pPool, pPtr);
+	if (pSlab->pPool != pPool)
+	{
+		PrintWarning("Not found this memory block in pool.");
 		return;
 	}
 
 	// Check if big blocks allocated from system directly, if so, release it to system, pool won't use it.
-	pPtr -= sizeof(unsigned short);
-	unsigned short uSize = *((unsigned short *)pPtr);
-	if (uSize > pPool->uMaxSize)
+	if (BIG_BLOCK_INDEX == pSlab->uIndex)
 	{
-		pPtr -= sizeof(BigBlock_t);
-		BigBlock_t *pBigBlock = (BigBlock_t *)pPtr;
-		(NULL == pBigBlock->pPre) ? (pPool->pFirstBigBlock = pBigBlock->pNext)
-				                  : (pBigBlock->pPre->pNext = pBigBlock->pNext);
-		free(pPtr);
+		FreeBigBlock(pPool, pSlab);
 		return;
 	}
 
-	// Check if needs to release it due to too many idle blocks in list.
+	// Back the memory block to pool so that can use it again, if all blocks of slab are idle, recycle it.
+	Head_t *pHead = &(pPool->pTable[pSlab->uIndex]);
+	PushNode(&(pHead->pFirstNode), (Node_t *)pPtr);
+	++ (pHead->uIdleNum);
+	pPool->uIdleBytes += pHead->uBlockSize;
+	SetNonEmpty(pPool, pSlab->uIndex);
+	unsigned short uIndex = pSlab->uIndex;
+	if (0 == -- (pSlab->uUsing_))
+	{
+		RecycleEmptySlab(pPool, pSlab);
+	}
+	CountFree(pPool, uIndex, 1);
+}
+
+/**
+ * @brief Change size of a memory block. If new size still fits in block, such as in the same size class,
+ * the same block is returned, otherwise string is moved to a block of new size. Mapped big block is
+ * remapped without copy.
+ *
+ * @param pPool Which pool the block in.
+ * @param pPtr Address of memory block, NULL to allocate a new one.
+ * @param uSize New size of string, 0 to back the block to pool.
+ * @return Address of memory block, NULL if failed and the old one is not changed, or uSize is 0.
+ */
+void *Realloc(MemoryPool_t *pPool, void *pPtr, size_t uSize)
+{
+	assert(NULL != pPool);
+	if (NULL == pPtr)
+	{
+		return Malloc(pPool, uSize);
+	}
+	if (0 == uSize)
+	{
+		Free(pPool, pPtr);
+		return NULL;
+	}
+
+	Slab_t *pSlab = GetSlabOfBlock(pPool, pPtr);
+	if (pSlab->pPool != pPool)
+	{
+		PrintWarning("Not found this memory block in pool.");
+		return NULL;
+	}
+
+	// String still fits in block, big block only keeps it if it is still bigger than pool can allocate.
+	char bBig = (BIG_BLOCK_INDEX == pSlab->uIndex);
+	size_t uBlockSize = GetBlockSize(pPool, pSlab);
+	if ((uSize <= uBlockSize) && (!bBig || (uSize > pPool->uMaxSize)))
+	{
+		return pPtr;
+	}
+
+	// Mapped big block grows by remapping its pages, if string is too big, Malloc() below fails.
+	if (bBig && (pSlab->uLength >= MMAP_THRESHOLD) && (uSize > pPool->uMaxSize)
+			&& (uSize <= SIZE_MAX - SLAB_HEAD_SIZE - pPool->uSlabSize))
+	{
+		pSlab = RemapBigBlock(pPool, pSlab, SLAB_HEAD_SIZE + uSize);
+		return (NULL == pSlab) ? NULL : ((void *)pSlab + SLAB_HEAD_SIZE);
+	}
+
+	// Move string to a block of new size.
+	void *pNewPtr = Malloc(pPool, uSize);
+	if (NULL == pNewPtr)
+	{
+		return NULL;
+	}
+	memcpy(pNewPtr, pPtr, (uSize < uBlockSize) ? uSize : uBlockSize);
+	Free(pPool, pPtr);
+
+	return pNewPtr;
+}
+
+/**
+ * @brief Get many memory blocks of the same size from pool at once, idle blocks are taken from list in one
+ * pass and list is updated once, if not enough, the rest are cut from slabs.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @param pPtrs Where to save addresses of allocated memory.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, size_t uSize, void **pPtrs, unsigned int uCount)
+{
+	assert(NULL != pPool);
+	assert(0 != uSize);
+	unsigned int uGot = 0;
+
+	// Big blocks are allocated from system and recorded one by one.
+	if (uSize > pPool->uMaxSize)
+	{
+		for (; uGot < uCount; ++ uGot)
+		{
+			pPtrs[uGot] = Malloc(pPool, uSize);
+			if (NULL == pPtrs[uGot])
+			{
+				break;
+			}
+		}
+		return uGot;
+	}
+
+	// Take idle blocks from list of this size.
 	unsigned short uIndex = GetIndex(uSize);
-	if ((pPool->pTable[uIndex].uIdleNum + 1) > RECYCLE_IF_MORETHAN_BLOCKS)
+	Head_t *pHead = &(pPool->pTable[uIndex]);
+	Node_t *pNode = pHead->pFirstNode;
+	for (; (uGot < uCount) && (NULL != pNode); ++ uGot)
+	{
+		pPtrs[uGot] = (void *)pNode;
+		pNode = pNode->pNext;
+		++ (GetSlabOfBlock(pPool, pPtrs[uGot])->uUsing_);
+	}
+	pHead->pFirstNode = pNode;
+	if (NULL != pNode)
+	{
+		pNode->pPre = NULL;
+	}
+	else
+	{
+		ClearNonEmpty(pPool, uIndex);
+	}
+	pHead->uIdleNum -= uGot;
+	pPool->uIdleBytes -= uGot * pHead->uBlockSize;
+
+	// Cut the rest from slabs, blocks following each other.
+	size_t uLen = pHead->uBlockSize;
+	while (uGot < uCount)
 	{
-		free(pPtr);
+		if ((pHead->pNextNeverUsed == pHead->pEndOfSlab) && !GrowSizeClass(pPool, uIndex))
+		{
+			break;
+		}
+		unsigned int uTake = (pHead->pEndOfSlab - pHead->pNextNeverUsed) / uLen;
+		uTake = ((uCount - uGot) < uTake) ? (uCount - uGot) : uTake;
+		pHead->pFirstSlab->uUsing_ += uTake;
+		for (; 0 != uTake; -- uTake)
+		{
+			pPtrs[uGot ++] = pHead->pNextNeverUsed;
+			pHead->pNextNeverUsed += uLen;
+		}
+	}
+	CountMalloc(pPool, uIndex, uGot);
+
+	return uGot;
+}
+
+/**
+ * @brief Back many memory blocks to pool at once. Blocks following each other in the same slab are
+ * linked together and joined to list of their size class once, so give back blocks grouped by slab, such
+ * as in the order MallocBatch() allocated them.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtrs Addresses of memory blocks to back.
+ * @param uCount Number of memory blocks to back.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	unsigned int i = 0;
+	Slab_t *pSlab = NULL;
+
+	if (NULL == pPool)
+	{
+		PrintWarning("Ptrs will be freed but memory pool already been destroy.");
 		return;
 	}
-	// Back the memory block to pool so that can use it again.
-	Node_t *pNode = (Node_t *)pPtr;
-	pNode->pNext = pPool->pTable[uIndex].pFirstNode;
-	pPool->pTable[uIndex].pFirstNode = pNode;
-	++ (pPool->pTable[uIndex].uIdleNum);
+
+	while (i < uCount)
+	{
+		// Big blocks and blocks not belong to this pool are given back one by one.
+		pSlab = GetSlabOfBlock(pPool, pPtrs[i]);
+		if ((pSlab->pPool != pPool) || (BIG_BLOCK_INDEX == pSlab->uIndex))
+		{
+			Free(pPool, pPtrs[i ++]);
+			continue;
+		}
+
+		// Link all following blocks of this slab to idle list of its size class.
+		Head_t *pHead = &(pPool->pTable[pSlab->uIndex]);
+		Node_t *pFirstNode = pHead->pFirstNode;
+		unsigned int uBack = 0;
+		for (; (i < uCount) && (GetSlabOfBlock(pPool, pPtrs[i]) == pSlab); ++ i)
+		{
+			PushNode(&pFirstNode, (Node_t *)pPtrs[i]);
+			++ uBack;
+		}
+		pHead->pFirstNode = pFirstNode;
+		pHead->uIdleNum += uBack;
+		pPool->uIdleBytes += uBack * pHead->uBlockSize;
+		SetNonEmpty(pPool, pSlab->uIndex);
+
+		// If all blocks of slab are idle, recycle it.
+		unsigned short uIndex = pSlab->uIndex;
+		pSlab->uUsing_ -= uBack;
+		if (0 == pSlab->uUsing_)
+		{
+			RecycleEmptySlab(pPool, pSlab);
+		}
+		CountFree(pPool, uIndex, uBack);
+	}
+}
+
+/**
+ * @brief Get where length of a pool string is saved, it is the last aligned bytes of its block.
+ *
+ * @param pPool Which pool the string in.
+ * @param pStr Address of string, got from PoolStrDup() and so on.
+ * @return Address of length of string.
+ */
+inline size_t *GetLengthOfString(MemoryPool_t *pPool, const char *pStr)
+{
+	size_t uBlockSize = GetBlockSize(pPool, GetSlabOfBlock(pPool, (void *)pStr));
+	return (size_t *)(((unsigned long)pStr + uBlockSize - sizeof(size_t)) & ~(sizeof(size_t) - 1));
+}
+
+/**
+ * @brief Get size of block a string needs, string is followed by its length aligned to size_t.
+ *
+ * @param uLen Length of string, without '\0', not bigger than SIZE_MAX - 2 * sizeof(size_t).
+ * @return Size of block.
+ */
+inline size_t GetStringBlockSize(size_t uLen)
+{
+	return ((uLen + sizeof(size_t)) & ~(sizeof(size_t) - 1)) + sizeof(size_t);
+}
+
+/**
+ * @brief Get a block for a string and save its length, the string is not copied.
+ *
+ * @param pPool From which pool to get.
+ * @param uLen Length of string, without '\0'.
+ * @return Allocated string, NULL if failed.
+ */
+inline char *MallocString(MemoryPool_t *pPool, size_t uLen)
+{
+	if (uLen > SIZE_MAX - 2 * sizeof(size_t))
+	{
+		PrintError("Size of string is too big to allocate.");
+		return NULL;
+	}
+	char *pStr = (char *)Malloc(pPool, GetStringBlockSize(uLen));
+	if (NULL == pStr)
+	{
+		return NULL;
+	}
+	*GetLengthOfString(pPool, pStr) = uLen;
+
+	return pStr;
+}
+
+/**
+ * @brief Copy a string into pool, its length is saved with it.
+ *
+ * @param pPool From which pool to get.
+ * @param pSrc String to copy.
+ * @return Copied string, give it back by Free(), NULL if failed.
+ */
+char *PoolStrDup(MemoryPool_t *pPool, const char *pSrc)
+{
+	assert(NULL != pPool);
+	assert(NULL != pSrc);
+	size_t uLen = strlen(pSrc);
+	char *pStr = MallocString(pPool, uLen);
+	(NULL != pStr) ? memcpy(pStr, pSrc, uLen + 1) : 0;
+
+	return pStr;
+}
+
+/**
+ * @brief Copy at most uMaxLen characters of a string into pool, its length is saved with it.
+ *
+ * @param pPool From which pool to get.
+ * @param pSrc String to copy.
+ * @param uMaxLen Most characters to copy, without '\0'.
+ * @return Copied string ended with '\0', give it back by Free(), NULL if failed.
+ */
+char *PoolStrNDup(MemoryPool_t *pPool, const char *pSrc, size_t uMaxLen)
+{
+	assert(NULL != pPool);
+	assert(NULL != pSrc);
+	size_t uLen = strnlen(pSrc, uMaxLen);
+	char *pStr = MallocString(pPool, uLen);
+	if (NULL != pStr)
+	{
+		memcpy(pStr, pSrc, uLen);
+		pStr[uLen] = '\0';
+	}
+
+	return pStr;
+}
+
+/**
+ * @brief Append a string to a pool string, pool string is moved if its block is not long enough.
+ *
+ * @param pPool Which pool the string in.
+ * @param pDest Pool string, got from PoolStrDup() and so on.
+ * @param pSrc String to append, may be a part of pDest.
+ * @return Address of appended string, NULL if failed and pDest is not changed.
+ */
+char *PoolStrCat(MemoryPool_t *pPool, char *pDest, const char *pSrc)
+{
+	assert(NULL != pPool);
+	assert(NULL != pDest);
+	assert(NULL != pSrc);
+	size_t uLen = *GetLengthOfString(pPool, pDest);
+	size_t uSrcLen = strlen(pSrc);
+	if (uSrcLen > SIZE_MAX - 2 * sizeof(size_t) - uLen)
+	{
+		PrintError("Size of string is too big to allocate.");
+		return NULL;
+	}
+
+	// String appended may be in block moved by Realloc(), find it by its offset then.
+	char bInside = (pSrc >= pDest) && (pSrc <= pDest + uLen);
+	size_t uOffset = pSrc - pDest;
+	char *pStr = (char *)Realloc(pPool, pDest, GetStringBlockSize(uLen + uSrcLen));
+	if (NULL == pStr)
+	{
+		return NULL;
+	}
+	memmove(pStr + uLen, bInside ? (pStr + uOffset) : pSrc, uSrcLen + 1);
+	*GetLengthOfString(pPool, pStr) = uLen + uSrcLen;
+
+	return pStr;
+}
+
+/**
+ * @brief Get length of a pool string without scanning it.
+ *
+ * @param pPool Which pool the string in.
+ * @param pStr Pool string, got from PoolStrDup() and so on.
+ * @return Length of string, without '\0'.
+ */
+size_t PoolStrLen(MemoryPool_t *pPool, const char *pStr)
+{
+	assert(NULL != pPool);
+	assert(NULL != pStr);
+
+	return *GetLengthOfString(pPool, pStr);
 }
 
 #endif /* ENABLE_VALMemoryPool */
@@ -9,32 +9,58 @@
  *
  * Data structure:
  *
- * MemoryPool_t             0      align   2*align   3*align   4*align   5*align           (n-1)*align
- * +--------+          ~align   ~2*align  ~3*align  ~4*align  ~5*align  ~6*align    ...    ~n*align
+ * MemoryPool_t           1~16     17~32   ...   1009~1024  1025~1280 1281~1536  ...  917505~1048576
+ * +--------+
  * |        |       +---------+---------+---------+---------+---------+---------+---------+-----------+
- * | pTable |  -->  |   Head  |   Head  |   Head  |   Head  |   Head  |   Head  |   ...   |    Head   |
+ * | pTable |  -->  |   Head  |   Head  |   ...   |   Head  |   Head  |   Head  |   ...   |    Head   |
  * |        |       +---------+---------+---------+---------+---------+---------+---------+-----------+
- * |        |           |          |         |         |         |         |                    |
- * +--------+        +------+  +------+   +------+  +------+   NULL      NULL               +------+
- * |        |        | Not  |  | Not  |   | Not  |  | Not  |                                | Not  |
- * |  uMax  |        | Used |  | Used |   | Used |  | Used |                                | Used |
- * |  Size  |        +------+  +------+   +------+  +------+                                +------+
- * |        |           |          |         |         |                                        |
- * +--------+        +------+    NULL      NULL                                               NULL
- * |        |        | Not  |                         ...
- * |  pBig  |        | Used |
- * |  Block |----    +------+                          |
- * |        |   |       |                           +------+
- * +--------+   |     NULL                          | Not  |
- *              |                                   | Used |
- *              |                                   +------+
- *              |                                      |
- *              |                                     NULL
- *              |
- *              |
- *              |     +-------+    +-------+    +-------+              +-------+
- *              ----> | Using | -- | Using | -- | Using | --  ...  --  | Using |  --  NULL
- *                    +-------+    +-------+    +-------+              +-------+
+ * +--------+          |    |
+ * |        |          |    |  pFirstSlab          Slab_t               Slab_t
+ * |  uMax  |          |    ------------->  +-----------------+  +-----------------+
+ * |  Size  |          |                    | uIndex/uUsing_  |  | uIndex/uUsing_  |
+ * |        |          |                    +-----------------+  +-----------------+
+ * +--------+          |  pFirstNode        |  Not  |  Using  |  |  Using  |  Not  |
+ * |        |          ---------------->    |  Used |         |  |         |  Used |
+ * | uSlab  |                               +-----------------+  +-----------------+
+ * |  Size  |                               |     ......      |  |     ......      |
+ * +--------+                               +-----------------+  +-----------------+
+ * |  pBig  |
+ * |  Block | ---> blocks bigger than pool can allocate
+ * +--------+
+ *
+ *   Size classes are ALIGN_SIZE steps up to 2^LINEAR_SIZE_BITS bytes, then every power of two is split into
+ * 2^CLASS_BITS classes, so a class wastes at most 1/2^CLASS_BITS of its block and nearby sizes share idle
+ * blocks, pool of 65535 bytes strings has 88 size classes only, and pool of 1 MiB strings has 104.
+ *
+ *   If a size class has no idle block and its slab is used up, an idle block of a bigger class at most
+ * uBorrowRatio times as big is used before allocating a new slab. Bit i of pNonEmpty is set if class i has
+ * idle blocks, so the class is found by find-first-set. Free() gives the block back to its own class.
+ *
+ *   Every size class cuts its blocks from its own slabs, a slab is SLAB_SIZE bytes and aligned to
+ * SLAB_SIZE, all blocks in it have the same size and follow Slab_t. Blocks have no header, Free() masks
+ * address of block to get its slab, and gets size class from it. Blocks are aligned to ALIGN_SIZE. Blocks
+ * longer than LARGE_CLASS_SIZE have a slab of their own, as long as Slab_t and the block, still aligned to
+ * SLAB_SIZE, so slabs of short strings stay small however long strings of pool are.
+ *
+ *   Big blocks bigger than pool can allocate have a Slab_t in front of them too, and are aligned to SLAB_SIZE
+ * as well, so Free() finds them the same way and unlinks them from big block list without search. Big block
+ * not smaller than MMAP_THRESHOLD is mapped from system by mmap() in whole pages and unmapped when it is
+ * given back, so long strings don't stay in heap of process.
+ *
+ *   Idle blocks of a size class make up one list, no matter which slab they are in, so the block freed last
+ * is allocated first. When all blocks of a slab are idle and the class still has uIdleCap idle blocks
+ * without them, or idle blocks of pool are more than uMaxIdleBytes, they are taken out of list and slab is
+ * released.
+ *
+ *   Pool strings got from PoolStrDup(), PoolStrNDup() and PoolStrCat() save their length in the last
+ * sizeof(size_t) bytes of their block, so PoolStrLen() doesn't scan them and PoolStrCat() copies only the
+ * string appended. Their blocks are a size_t longer, and other blocks have no length.
+ *
+ *   uIdleCap of every class adapts to how it is used. After ADAPT_EVERY_OPS Malloc()/Free() of pool, and
+ * twice the most blocks pool had using, so that blocks using had time to go up and down, it is set to the
+ * range blocks using of the class went up and down, so blocks a hot class frees and gets again stay in it,
+ * or to half of it if that is bigger, so a cold class gives back idle blocks step by step. It is not smaller
+ * than MIN_IDLE_CAP, and halved again while pool is above uMaxIdleBytes.
  */
 
 #ifndef MEMORYPOOL_H_
@@ -42,42 +68,142 @@
 
 #include "../CProjectDfn.h"
 #include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
 
 /**
  * @brief Max length of string pool can allocate, if bigger than this when creating, down to this size.
+ * Define it when compiling to change it, blocks longer than LARGE_CLASS_SIZE have a slab each.
  */
+#ifndef MAX_STRING_LEN
+#define MAX_STRING_LEN (1024 * 1024)
+#endif
+
 #ifndef USHRT_MAX
 #define USHRT_MAX 65535
 #endif
-#define MAX_STRING_LEN USHRT_MAX
 
 /**
- * @brief Align size, must be 2^n
+ * @brief Align size, must be 2^n, the same as malloc() on 64 bits system.
+ */
+#define ALIGN_SIZE 16
+
+/**
+ * @brief Sizes not bigger than 2^LINEAR_SIZE_BITS have a size class every ALIGN_SIZE bytes.
+ */
+#define LINEAR_SIZE_BITS 10
+
+/**
+ * @brief Every power of two bigger than 2^LINEAR_SIZE_BITS is split into 2^CLASS_BITS size classes.
+ * ALIGN_SIZE << CLASS_BITS must not be bigger than 2^LINEAR_SIZE_BITS.
+ */
+#define CLASS_BITS 2
+
+/**
+ * @brief Number of size classes every ALIGN_SIZE bytes.
+ */
+#define LINEAR_CLASSES ((1 << LINEAR_SIZE_BITS) / ALIGN_SIZE)
+
+/**
+ * @brief Default uBorrowRatio of pool. If a size class has no block to allocate, take an idle block of a
+ * bigger class at most these times as big, so 2 wastes at most half of block, 1 to disable.
  */
-#define ALIGN_SIZE 8
+#define BORROW_MAX_RATIO 2
 
 /**
- * @brief Maximum number of idle block in memory pool, if more than these, release them.
+ * @brief Bits of a word in bitmap of size classes which have idle blocks.
  */
-#define RECYCLE_IF_MORETHAN_BLOCKS 16
+#define BITS_OF_WORD (sizeof(unsigned long) * CHAR_BIT)
 
 /**
- * @brief Allocate size of memory, if it not used, let the first four block save the pointer pointed to
- * next free allocated memory, if this memory are using, [data] is the first address of this memory.
+ * @brief Size of slab, must be 2^n, every slab and big block is aligned to it.
  */
-typedef union Node
+#define SLAB_SIZE (64 * 1024)
+
+/**
+ * @brief A slab has at least these blocks, size classes of longer blocks have a slab for every block.
+ */
+#define MIN_BLOCKS_IN_SLAB 4
+
+/**
+ * @brief Big block not smaller than this, include its information, is mapped from system by mmap().
+ * Define it when compiling to change it, 0 maps every big block.
+ */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (32 * 1024)
+#endif
+
+/**
+ * @brief Size class index of big block, which is allocated from system directly.
+ */
+#define BIG_BLOCK_INDEX USHRT_MAX
+
+/**
+ * @brief Number of idle blocks a size class can keep at least, uIdleCap of class is not smaller than it.
+ */
+#define MIN_IDLE_CAP 16
+
+/**
+ * @brief Number of Malloc()/Free() of pool at least between adapting uIdleCap of size classes.
+ */
+#define ADAPT_EVERY_OPS 4096
+
+/**
+ * @brief Default bytes of idle blocks pool keeps at most, uMaxIdleBytes of pool can be changed after created.
+ */
+#define MAX_IDLE_BYTES (16 * 1024 * 1024)
+
+/**
+ * @brief Idle memory block, the first two pointers of it link it into idle list of its size class, if
+ * this memory are using, all of it belongs to user.
+ */
+typedef struct Node
 {
-	union Node *pNext;    ///< If this memory is idle, this pointed to next free memory block.
-	char data[1];         ///< If this memory is using, this is the address of this block.
+	struct Node *pNext;    ///< If this memory is idle, this pointed to next free memory block.
+	struct Node *pPre;     ///< If this memory is idle, this pointed to previous free memory block.
 }Node_t;
 
 /**
- * @brief Head of list of each idle memory block. If more than a given number of idle blocks, release them.
+ * @brief Slab information, it is at the beginning of a slab, blocks of a size class follow it.
+ * Big block allocated from system have it too, with uIndex BIG_BLOCK_INDEX.
+ */
+typedef struct Slab
+{
+	unsigned short uIndex;          ///< Size class of blocks in this slab, or BIG_BLOCK_INDEX.
+	unsigned int uBlocks;           ///< Number of blocks in this slab.
+	unsigned int uUsing_;           ///< Number of blocks allocated and not back yet.
+	size_t uLength;                 ///< Length got from system, of slab or big block.
+	struct MemoryPoolInf *pPool;    ///< Pool this slab belongs to, to check block given back by Free().
+	struct Slab *pNextSlab;         ///< Next slab, this make up a slab list.
+	struct Slab *pPreSlab;          ///< Previous slab, to unlink slab without search.
+}Slab_t;
+
+/**
+ * @brief Size of slab information, blocks follow it and keep aligned to ALIGN_SIZE.
+ */
+#define SLAB_HEAD_SIZE ((sizeof(Slab_t) + (ALIGN_SIZE - 1)) & ~(ALIGN_SIZE - 1))
+
+/**
+ * @brief Blocks longer than this are too long to have MIN_BLOCKS_IN_SLAB in a slab, every one of them has
+ * a slab of its own, just as long as slab information and the block.
+ */
+#define LARGE_CLASS_SIZE ((SLAB_SIZE - SLAB_HEAD_SIZE) / MIN_BLOCKS_IN_SLAB)
+
+/**
+ * @brief Head of list of each idle memory block, and slabs blocks of this size cut from.
  */
 typedef struct ListHead
 {
 	Node_t *pFirstNode;      ///< First idle memory block.
+	size_t uBlockSize;       ///< Size of blocks in this size class.
 	unsigned int uIdleNum;   ///< Number of idle memory blocks in list.
+	unsigned int uIdleCap;   ///< Number of idle blocks to keep, a slab of them is released if more.
+	unsigned int uUsing;     ///< Number of blocks using.
+	unsigned int uLowWater;  ///< Fewest blocks using since uIdleCap adapted last time.
+	unsigned int uHighWater; ///< Most blocks using since uIdleCap adapted last time.
+	Slab_t *pFirstSlab;      ///< Slabs of this size class, the first one is the one blocks are cut from.
+	void *pNextNeverUsed;    ///< Next block never used in the first slab.
+	void *pEndOfSlab;        ///< End of the first slab.
 }Head_t;
 
 /**
@@ -85,60 +211,91 @@ typedef struct ListHead
  */
 typedef Head_t BlockTable_t;
 
-/**
- * @brief Memory pool have it's biggest size, if user asked to allocate a big block bigger than memory
- * can be, pool will deliver this command to system and record this, when destroy the pool, all allocated
- * big block will be released.
- */
-typedef struct BigBlock
-{
-	void *data;               ///< Start address of allocated big block.
-	struct BigBlock *pNext;   ///< Next allocated big block if this not the last one.
-	struct BigBlock *pPre;    ///< Previous allocated big block if that exists.
-}BigBlock_t;
-
 /**
  * @biref Information about memory pool.
  */
 typedef struct MemoryPoolInf
 {
-	unsigned int uMaxSize;       ///< Longest block memory pool can allocate, if bigger, deliver to system.
+	size_t uMaxSize;             ///< Longest block memory pool can allocate, if bigger, deliver to system.
+	size_t uSlabSize;            ///< SLAB_SIZE, every slab and big block is aligned to it.
 	BlockTable_t *pTable;        ///< An array, each pointed to a list which describes the free memory block.
-	BigBlock_t *pFirstBigBlock;  ///< If bigger than pool can allocate, pointed to list which contains them.
+	unsigned long *pNonEmpty;    ///< Bitmap, bit i is set if size class i has idle blocks.
+	unsigned int uOps;           ///< Number of Malloc()/Free() since uIdleCap of classes adapted last time.
+	unsigned int uUsing;         ///< Number of blocks using in all size classes.
+	unsigned int uHighWater;     ///< Most blocks using in all size classes since adapted last time.
+	size_t uIdleBytes;           ///< Bytes of idle blocks in all size classes.
+	size_t uMaxIdleBytes;        ///< Bytes of idle blocks pool keeps at most, can be changed.
+	unsigned int uBorrowRatio;   ///< Borrowed block is at most these times as big as wanted, can be changed.
+	Slab_t *pFirstBigBlock;      ///< If bigger than pool can allocate, pointed to list which contains them.
+	unsigned int uBigBlocks;     ///< Number of big blocks in pFirstBigBlock.
+	size_t uBigBlockBytes;       ///< Bytes got from system for big blocks in pFirstBigBlock.
 }MemoryPool_t;
 
 /**
- * @brief Align function, convert it to aligned size.
+ * @brief Get index from block table by given size.
  */
-inline unsigned short RoundUp(unsigned short size)
+inline unsigned short GetIndex(size_t size)
 {
-	return (((size) + (ALIGN_SIZE - 1)) & ~(ALIGN_SIZE - 1));
+	if (size <= (1 << LINEAR_SIZE_BITS))
+	{
+		return (((size) + (ALIGN_SIZE - 1)) / (ALIGN_SIZE) - 1);
+	}
+
+	// Power of two size belongs to, then which part of it.
+	unsigned int uBits = (sizeof(unsigned long) * CHAR_BIT - 1) - __builtin_clzl((unsigned long)size - 1);
+	return LINEAR_CLASSES + ((uBits - LINEAR_SIZE_BITS) << CLASS_BITS)
+			+ (((unsigned long)size - 1) >> (uBits - CLASS_BITS)) - (1 << CLASS_BITS);
 }
 
 /**
- * @brief Get index from block table by given size.
+ * @brief Get size of blocks in a size class.
+ */
+inline size_t GetClassSize(unsigned short uIndex)
+{
+	if (uIndex < LINEAR_CLASSES)
+	{
+		return ((size_t)uIndex + 1) * ALIGN_SIZE;
+	}
+
+	unsigned int uGroup = uIndex - LINEAR_CLASSES;
+	unsigned int uBits = LINEAR_SIZE_BITS + (uGroup >> CLASS_BITS);
+	return ((size_t)(1 << CLASS_BITS) + (uGroup & ((1 << CLASS_BITS) - 1)) + 1) << (uBits - CLASS_BITS);
+}
+
+/**
+ * @brief Align function, convert it to size of block which size class it belongs to.
  */
-inline unsigned short GetIndex(unsigned short size)
+inline size_t RoundUp(size_t size)
 {
-	return (((size) + (ALIGN_SIZE - 1)) / (ALIGN_SIZE) - 1);
+	return GetClassSize(GetIndex(size));
+}
+
+/**
+ * @brief Get slab of a block by masking its address, slabs are aligned to slab size of pool.
+ *
+ * @param pPool Which pool the block in.
+ * @param pPtr Address of block.
+ * @return Slab the block in.
+ */
+inline Slab_t *GetSlabOfBlock(MemoryPool_t *pPool, void *pPtr)
+{
+	return (Slab_t *)((unsigned long)pPtr & ~((unsigned long)pPool->uSlabSize - 1));
 }
 
 /**
  * @brief Create memory pool, so can allocate memory after that.
  *
  * It doesn't means can't get memory if bigger than given size, pool will deliver to system functions,
- * so that performance is equal as system. When destroy pool, make sure you have release all memory block
- * smaller than [uMaxStrLen], pool doesn't track them, if bigger than [uMaxStrLen], pool will release all
- * of them to prevent memory leak.
+ * so that performance is equal as system. When destroy pool, all slabs and big blocks will be released,
+ * no matter they are using or not.
  *
  * @param uMaxStrLen Max length of string this pool can allocate.
  * @return Created memory pool.
  */
-MemoryPool_t *CreateMemoryPool(unsigned short uMaxStrLen);
+MemoryPool_t *CreateMemoryPool(size_t uMaxStrLen);
 
 /**
- * @brief Destroy memory pool, release all idle memory block smaller than max size pool can allocate, and
- * release all blocks bigger than this size not matter using or not.
+ * @brief Destroy memory pool, release all slabs and all blocks bigger than max size pool can allocate.
  *
  * @param pPool Which pool to destroy, set to NULL when finished to destroy.
  */
@@ -151,7 +308,7 @@ void DestroyMemoryPool(MemoryPool_t **pPool);
  * @param uSize Size of string want to allocate.
  * @return Allocated memory.
  */
-void *Malloc(MemoryPool_t *pPool, unsigned short uSize);
+void *Malloc(MemoryPool_t *pPool, size_t uSize);
 
 /**
  * @brief Back a memory block to pool so that it can be use again.
@@ -161,4 +318,86 @@ void *Malloc(MemoryPool_t *pPool, unsigned short uSize);
  */
 void Free(MemoryPool_t *pPool, void *pPtr);
 
+/**
+ * @brief Change size of a memory block. If new size still fits in block, such as in the same size class,
+ * the same block is returned, otherwise string is moved to a block of new size. Mapped big block is
+ * remapped without copy.
+ *
+ * @param pPool Which pool the block in.
+ * @param pPtr Address of memory block, NULL to allocate a new one.
+ * @param uSize New size of string, 0 to back the block to pool.
+ * @return Address of memory block, NULL if failed and the old one is not changed, or uSize is 0.
+ */
+void *Realloc(MemoryPool_t *pPool, void *pPtr, size_t uSize);
+
+/**
+ * @brief Adapt uIdleCap of every size class to the range blocks using went up and down since last time,
+ * or half of it if that is bigger, then release idle slabs more than it. Pool calls it by itself, call it
+ * to adapt at once, such as after uMaxIdleBytes is changed.
+ *
+ * @param pPool Which pool to adapt.
+ */
+void AdaptIdleCaps(MemoryPool_t *pPool);
+
+/**
+ * @brief Get many memory blocks of the same size from pool at once, idle blocks are taken from list in one
+ * pass and list is updated once, if not enough, the rest are cut from slabs.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @param pPtrs Where to save addresses of allocated memory.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, size_t uSize, void **pPtrs, unsigned int uCount);
+
+/**
+ * @brief Back many memory blocks to pool at once. Blocks following each other in the same slab are
+ * linked together and joined to list of their size class once, so give back blocks grouped by slab, such
+ * as in the order MallocBatch() allocated them.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtrs Addresses of memory blocks to back.
+ * @param uCount Number of memory blocks to back.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
+/**
+ * @brief Copy a string into pool, its length is saved with it.
+ *
+ * @param pPool From which pool to get.
+ * @param pSrc String to copy.
+ * @return Copied string, give it back by Free(), NULL if failed.
+ */
+char *PoolStrDup(MemoryPool_t *pPool, const char *pSrc);
+
+/**
+ * @brief Copy at most uMaxLen characters of a string into pool, its length is saved with it.
+ *
+ * @param pPool From which pool to get.
+ * @param pSrc String to copy.
+ * @param uMaxLen Most characters to copy, without '\0'.
+ * @return Copied string ended with '\0', give it back by Free(), NULL if failed.
+ */
+char *PoolStrNDup(MemoryPool_t *pPool, const char *pSrc, size_t uMaxLen);
+
+/**
+ * @brief Append a string to a pool string, pool string is moved if its block is not long enough.
+ *
+ * @param pPool Which pool the string in.
+ * @param pDest Pool string, got from PoolStrDup() and so on.
+ * @param pSrc String to append, may be a part of pDest.
+ * @return Address of appended string, NULL if failed and pDest is not changed.
+ */
+char *PoolStrCat(MemoryPool_t *pPool, char *pDest, const char *pSrc);
+
+/**
+ * @brief Get length of a pool string without scanning it.
+ *
+ * @param pPool Which pool the string in.
+ * @param pStr Pool string, got from PoolStrDup() and so on.
+ * @return Length of string, without '\0'.
+ */
+size_t PoolStrLen(MemoryPool_t *pPool, const char *pStr);
+
 #endif /* MEMORYPOOL_H_ */
@@ -0,0 +1,174 @@
+/**
+ * @file   VALMemoryPool/ShardedPool.c
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  VAL memory pool sharded by CPU, so that threads share pools without a cache in every thread.
+ */
+
+// The following macro designed for test purpose only, delete it when using.
+#include "../MemoryPoolTester.h"
+#ifdef ENABLE_VALMemoryPool
+
+#include "ShardedPool.h"
+#include <sched.h>
+#include <unistd.h>
+
+/**
+ * @brief Get shard of the CPU this thread runs on, shard 0 if CPU can't be found.
+ *
+ * @param pShardedPool Which pool the shard in.
+ * @return Shard of this CPU.
+ */
+inline Shard_t *GetShardOfCpu(ShardedPool_t *pShardedPool)
+{
+	int iCpu = sched_getcpu();
+
+	return &(pShardedPool->pShards[(iCpu < 0) ? 0 : ((unsigned int)iCpu % pShardedPool->uShards)]);
+}
+
+/**
+ * @brief Get shard a memory block was allocated from, by pool saved in its slab.
+ *
+ * @param pShardedPool Which pool the block in.
+ * @param pShard Shard to check first, mostly block is freed on the CPU allocated it.
+ * @param pPtr Address of memory block.
+ * @return Shard of block, NULL if block not belongs to any shard.
+ */
+inline Shard_t *GetShardOfBlock(ShardedPool_t *pShardedPool, Shard_t *pShard, void *pPtr)
+{
+	// Slabs of all shards have the same size, so any of them finds slab of block.
+	MemoryPool_t *pPool = GetSlabOfBlock(pShard->pPool, pPtr)->pPool;
+	if (pShard->pPool == pPool)
+	{
+		return pShard;
+	}
+	for (unsigned int i=0; i<pShardedPool->uShards; ++ i)
+	{
+		if (pShardedPool->pShards[i].pPool == pPool)
+		{
+			return &(pShardedPool->pShards[i]);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Destroy pools of the first uShards shards.
+ *
+ * @param pShards Shards to destroy.
+ * @param uShards Number of shards.
+ */
+inline void DestroyShards(Shard_t *pShards, unsigned int uShards)
+{
+	for (unsigned int i=0; i<uShards; ++ i)
+	{
+		DestroyMemoryPool(&(pShards[i].pPool));
+		pthread_mutex_destroy(&(pShards[i].lock));
+	}
+	free(pShards);
+}
+
+/**
+ * @brief Create a VAL memory pool can be shared by threads, with a shard for every CPU.
+ *
+ * @param uMaxStrLen Max length of string this pool can allocate.
+ * @return Created pool, NULL if failed.
+ */
+ShardedPool_t *CreateShardedPool(size_t uMaxStrLen)
+{
+	long iCpus = sysconf(_SC_NPROCESSORS_CONF);
+	unsigned int uShards = (iCpus > 0) ? (unsigned int)iCpus : 1;
+	ShardedPool_t *pShardedPool = (ShardedPool_t *)malloc(sizeof(ShardedPool_t));
+	Shard_t *pShards = NULL;
+	if ((NULL == pShardedPool) || (0 != posix_memalign((void **)&pShards, CACHE_LINE_SIZE,
+			sizeof(Shard_t) * uShards)))
+	{
+		PrintError("Failed to malloc memory pool from system.");
+		free(pShardedPool);
+		return NULL;
+	}
+
+	for (unsigned int i=0; i<uShards; ++ i)
+	{
+		pShards[i].pPool = CreateMemoryPool(uMaxStrLen);
+		if (NULL == pShards[i].pPool)
+		{
+			DestroyShards(pShards, i);
+			free(pShardedPool);
+			return NULL;
+		}
+		pthread_mutex_init(&(pShards[i].lock), NULL);
+	}
+	pShardedPool->uShards = uShards;
+	pShardedPool->pShards = pShards;
+
+	return pShardedPool;
+}
+
+/**
+ * @brief Destroy pool, no thread can use it then, all slabs and big blocks of all shards will be released.
+ *
+ * @param pShardedPool Which pool to destroy, set to NULL when finished to destroy.
+ */
+void DestroyShardedPool(ShardedPool_t **pShardedPool)
+{
+	assert(NULL != *pShardedPool);
+
+	DestroyShards((*pShardedPool)->pShards, (*pShardedPool)->uShards);
+	free(*pShardedPool);
+	*pShardedPool = NULL;
+}
+
+/**
+ * @brief Get a memory block from shard of the CPU this thread runs on.
+ *
+ * @param pShardedPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory, NULL if failed.
+ */
+void *ShardedMalloc(ShardedPool_t *pShardedPool, size_t uSize)
+{
+	assert(NULL != pShardedPool);
+	Shard_t *pShard = GetShardOfCpu(pShardedPool);
+
+	pthread_mutex_lock(&(pShard->lock));
+	void *pPtr = Malloc(pShard->pPool, uSize);
+	pthread_mutex_unlock(&(pShard->lock));
+
+	return pPtr;
+}
+
+/**
+ * @brief Back a memory block to shard it was allocated from, it can be freed by any thread on any CPU.
+ *
+ * @param pShardedPool Back to which pool.
+ * @param pPtr Address of memory block to back.
+ */
+void ShardedFree(ShardedPool_t *pShardedPool, void *pPtr)
+{
+	if (NULL == pShardedPool)
+	{
+		PrintWarning("A ptr will be freed but memory pool already been destroy.");
+		return;
+	}
+	if (NULL == pPtr)
+	{
+		return;
+	}
+
+	Shard_t *pShard = GetShardOfBlock(pShardedPool, GetShardOfCpu(pShardedPool), pPtr);
+	if (NULL == pShard)
+	{
+		PrintWarning("Not found this memory block in pool.");
+		return;
+	}
+	pthread_mutex_lock(&(pShard->lock));
+	Free(pShard->pPool, pPtr);
+	pthread_mutex_unlock(&(pShard->lock));
+}
+
+#endif /* ENABLE_VALMemoryPool */
@@ -0,0 +1,92 @@
+/**
+ * @file   VALMemoryPool/ShardedPool.h
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  VAL memory pool sharded by CPU, so that threads share pools without a cache in every thread.
+ *
+ * Data structure:
+ *
+ * ShardedPool_t            Shard 0          Shard 1                     Shard n-1
+ * +----------+       +--------------+--------------+-------+--------------+
+ * | uShards  |       |    pPool     |    pPool     |  ...  |    pPool     |  a VAL memory pool each
+ * +----------+       |    lock      |    lock      |       |    lock      |  mutex each
+ * | pShards  | ----> +--------------+--------------+-------+--------------+
+ * +----------+        a cache line each, so that CPUs don't write the same line
+ *
+ *   Pool has a shard for every CPU, ShardedMalloc() allocates from shard of the CPU thread runs on, found by
+ * sched_getcpu(), which reads it from restartable sequences area if kernel supports them. Thread can move
+ * to another CPU after that, so shard is still locked, by a mutex which is almost never taken by other
+ * CPUs, so it is taken without system call, and only held for one Malloc or Free of VAL pool. A thread
+ * preempted holding it makes others sleep instead of spin, when there are more threads than CPUs. If CPU
+ * can't be found, shard 0 is used.
+ *
+ *   ShardedFree() gives block back to the shard allocated it, found by pool saved in its slab, so blocks
+ * freed on other CPUs don't mix shards up. Memory used is in proportion to number of CPUs, not threads,
+ * so it suits many threads which are idle mostly, ThreadCache.h is faster for a few busy threads.
+ */
+
+#ifndef SHARDEDPOOL_H_
+#define SHARDEDPOOL_H_
+
+#include "MemoryPool.h"
+#include <pthread.h>
+
+/**
+ * @brief Size of cache line, every shard is aligned to it.
+ */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief VAL memory pool of a CPU.
+ */
+typedef struct Shard
+{
+	MemoryPool_t *pPool;             ///< Pool of this shard, only used with lock taken.
+	pthread_mutex_t lock;            ///< Lock of pool, held for one Malloc or Free.
+}__attribute__((aligned(CACHE_LINE_SIZE))) Shard_t;
+
+/**
+ * @brief VAL memory pool shared by threads, with a shard for every CPU.
+ */
+typedef struct ShardedPool
+{
+	unsigned int uShards;            ///< Number of shards, number of CPUs.
+	Shard_t *pShards;                ///< An array of shards.
+}ShardedPool_t;
+
+/**
+ * @brief Create a VAL memory pool can be shared by threads, with a shard for every CPU.
+ *
+ * @param uMaxStrLen Max length of string this pool can allocate.
+ * @return Created pool, NULL if failed.
+ */
+ShardedPool_t *CreateShardedPool(size_t uMaxStrLen);
+
+/**
+ * @brief Destroy pool, no thread can use it then, all slabs and big blocks of all shards will be released.
+ *
+ * @param pShardedPool Which pool to destroy, set to NULL when finished to destroy.
+ */
+void DestroyShardedPool(ShardedPool_t **pShardedPool);
+
+/**
+ * @brief Get a memory block from shard of the CPU this thread runs on.
+ *
+ * @param pShardedPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory, NULL if failed.
+ */
+void *ShardedMalloc(ShardedPool_t *pShardedPool, size_t uSize);
+
+/**
+ * @brief Back a memory block to shard it was allocated from, it can be freed by any thread on any CPU.
+ *
+ * @param pShardedPool Back to which pool.
+ * @param pPtr Address of memory block to back.
+ */
+void ShardedFree(ShardedPool_t *pShardedPool, void *pPtr);
+
+#endif /* SHARDEDPOOL_H_ */
@@ -0,0 +1,309 @@
+/**
+ * @file   VALMemoryPool/StringTable.c
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  String interning table on top of VAL memory pool.
+ */
+
+// The following macro designed for test purpose only, delete it when using.
+#include "../MemoryPoolTester.h"
+#ifdef ENABLE_VALMemoryPool
+
+#include "StringTable.h"
+#include <stddef.h>
+
+/**
+ * @brief Hash a string by FNV-1a.
+ *
+ * @param pStr String to hash.
+ * @param uLen Length of string.
+ * @return Hash of string.
+ */
+inline unsigned int HashString(const char *pStr, size_t uLen)
+{
+	unsigned int uHash = 2166136261U;
+	for (size_t i=0; i<uLen; ++ i)
+	{
+		uHash = (uHash ^ (unsigned char)pStr[i]) * 16777619U;
+	}
+
+	return uHash;
+}
+
+/**
+ * @brief Get interned string by address of its characters.
+ */
+inline Interned_t *GetInterned(const char *pStr)
+{
+	return (Interned_t *)(pStr - offsetof(Interned_t, data));
+}
+
+/**
+ * @brief Get slot a string should be in, the first slot of its probe sequence in table.
+ *
+ * @param pTable Which table the string in.
+ * @param uHash Hash of string.
+ * @return Index of slot.
+ */
+inline unsigned int GetStringHome(StringTable_t *pTable, unsigned int uHash)
+{
+	return (unsigned int)(((unsigned long long)uHash * 0x9E3779B97F4A7C15ULL)
+			>> (sizeof(unsigned long long) * CHAR_BIT - __builtin_ctz(pTable->uSlots)));
+}
+
+/**
+ * @brief Get slot of a string in table, or the empty slot it should be put in.
+ *
+ * @param pTable Which table to search.
+ * @param pStr String to search.
+ * @param uLen Length of string.
+ * @param uHash Hash of string.
+ * @return Index of slot.
+ */
+inline unsigned int GetStringSlot(StringTable_t *pTable, const char *pStr, size_t uLen, unsigned int uHash)
+{
+	unsigned int uMask = pTable->uSlots - 1;
+	unsigned int uSlot = GetStringHome(pTable, uHash);
+	InternSlot_t *pSlot = NULL;
+	for (;; uSlot = (uSlot + 1) & uMask)
+	{
+		pSlot = &(pTable->pSlots[uSlot]);
+		if ((NULL == pSlot->pString) || ((pSlot->uHash == uHash) && (pSlot->pString->uLength == uLen)
+				&& (0 == memcmp(pSlot->pString->data, pStr, uLen))))
+		{
+			return uSlot;
+		}
+	}
+}
+
+/**
+ * @brief Get slot of an interned string in table by its address.
+ *
+ * @param pTable Which table the string in.
+ * @param pString Interned string, it must be in table.
+ * @return Index of slot.
+ */
+inline unsigned int FindStringSlot(StringTable_t *pTable, Interned_t *pString)
+{
+	unsigned int uMask = pTable->uSlots - 1;
+	unsigned int uSlot = GetStringHome(pTable, pString->uHash);
+	while (pTable->pSlots[uSlot].pString != pString)
+	{
+		uSlot = (uSlot + 1) & uMask;
+	}
+
+	return uSlot;
+}
+
+/**
+ * @brief Double slots of table, strings are put into new slots by their saved hash.
+ *
+ * @param pTable Which table to grow.
+ * @return 1 if succeed, 0 if failed.
+ */
+inline char GrowStringTable(StringTable_t *pTable)
+{
+	unsigned int uOldSlots = pTable->uSlots;
+	InternSlot_t *pOldSlots = pTable->pSlots;
+	InternSlot_t *pSlots = (InternSlot_t *)calloc(uOldSlots << 1, sizeof(InternSlot_t));
+	if (NULL == pSlots)
+	{
+		PrintError("Failed to malloc memory from system.");
+		return 0;
+	}
+	pTable->pSlots = pSlots;
+	pTable->uSlots = uOldSlots << 1;
+
+	unsigned int uMask = pTable->uSlots - 1;
+	unsigned int uSlot = 0;
+	for (unsigned int i=0; i<uOldSlots; ++ i)
+	{
+		if (NULL != pOldSlots[i].pString)
+		{
+			uSlot = GetStringHome(pTable, pOldSlots[i].uHash);
+			while (NULL != pSlots[uSlot].pString)
+			{
+				uSlot = (uSlot + 1) & uMask;
+			}
+			pSlots[uSlot] = pOldSlots[i];
+		}
+	}
+	free(pOldSlots);
+
+	return 1;
+}
+
+/**
+ * @brief Create string table, its strings are allocated from given pool.
+ *
+ * @param pPool VAL pool strings are allocated from, it must not be destroyed before table.
+ * @return Created string table, NULL if failed.
+ */
+StringTable_t *CreateStringTable(MemoryPool_t *pPool)
+{
+	assert(NULL != pPool);
+	StringTable_t *pTable = (StringTable_t *)malloc(sizeof(StringTable_t));
+	InternSlot_t *pSlots = (InternSlot_t *)calloc(STRING_TABLE_SIZE, sizeof(InternSlot_t));
+	if ((NULL == pTable) || (NULL == pSlots))
+	{
+		PrintError("Failed to malloc string table from system.");
+		free(pTable);
+		free(pSlots);
+		return NULL;
+	}
+	pTable->pPool = pPool;
+	pTable->pSlots = pSlots;
+	pTable->uSlots = STRING_TABLE_SIZE;
+	pTable->uStrings = 0;
+
+	return pTable;
+}
+
+/**
+ * @brief Destroy string table, all strings in it are given back to pool, no matter they are referenced
+ * or not.
+ *
+ * @param pTable Which table to destroy, set to NULL when finished to destroy.
+ */
+void DestroyStringTable(StringTable_t **pTable)
+{
+	assert(NULL != *pTable);
+
+	for (unsigned int i=0; i<(*pTable)->uSlots; ++ i)
+	{
+		(NULL != (*pTable)->pSlots[i].pString) ? Free((*pTable)->pPool, (*pTable)->pSlots[i].pString) : (void)0;
+	}
+	free((*pTable)->pSlots);
+	free(*pTable);
+	*pTable = NULL;
+}
+
+/**
+ * @brief Intern a string, if the same string is in table, it is referenced once more, otherwise it is
+ * copied into pool.
+ *
+ * @param pTable Which table to intern into.
+ * @param pStr String to intern.
+ * @return Interned string, give it back by ReleaseString(), NULL if failed.
+ */
+const char *InternString(StringTable_t *pTable, const char *pStr)
+{
+	assert(NULL != pStr);
+
+	return InternStringN(pTable, pStr, strlen(pStr));
+}
+
+/**
+ * @brief Intern the first uLen characters of a string, it doesn't need to be ended with '\0'.
+ *
+ * @param pTable Which table to intern into.
+ * @param pStr String to intern.
+ * @param uLen Length of string.
+ * @return Interned string ended with '\0', give it back by ReleaseString(), NULL if failed.
+ */
+const char *InternStringN(StringTable_t *pTable, const char *pStr, size_t uLen)
+{
+	assert(NULL != pTable);
+	assert(NULL != pStr);
+	unsigned int uHash = HashString(pStr, uLen);
+
+	// The same string is in table, reference it once more.
+	unsigned int uSlot = GetStringSlot(pTable, pStr, uLen, uHash);
+	if (NULL != pTable->pSlots[uSlot].pString)
+	{
+		++ (pTable->pSlots[uSlot].pString->uRefs);
+		return pTable->pSlots[uSlot].pString->data;
+	}
+
+	// Copy a new string into pool, table is doubled first if half of it will be used.
+	if (uLen > SIZE_MAX - sizeof(Interned_t) - 1)
+	{
+		PrintError("Size of string is too big to allocate.");
+		return NULL;
+	}
+	if ((pTable->uStrings + 1) * 2 > pTable->uSlots)
+	{
+		if (!GrowStringTable(pTable))
+		{
+			return NULL;
+		}
+		uSlot = GetStringSlot(pTable, pStr, uLen, uHash);
+	}
+	Interned_t *pString = (Interned_t *)Malloc(pTable->pPool, sizeof(Interned_t) + uLen + 1);
+	if (NULL == pString)
+	{
+		return NULL;
+	}
+	pString->uLength = uLen;
+	pString->uHash = uHash;
+	pString->uRefs = 1;
+	memcpy(pString->data, pStr, uLen);
+	pString->data[uLen] = '\0';
+	pTable->pSlots[uSlot].uHash = uHash;
+	pTable->pSlots[uSlot].pString = pString;
+	++ (pTable->uStrings);
+
+	return pString->data;
+}
+
+/**
+ * @brief Reference an interned string once more without looking up table.
+ *
+ * @param pStr Interned string.
+ * @return The same interned string.
+ */
+const char *RetainString(const char *pStr)
+{
+	assert(NULL != pStr);
+	++ (GetInterned(pStr)->uRefs);
+
+	return pStr;
+}
+
+/**
+ * @brief Give back a reference of interned string, if it is the last one, string is taken out of table
+ * and given back to pool. Following strings of the same probe sequence are moved back, so that searching
+ * doesn't stop at the hole.
+ *
+ * @param pTable Which table the string in.
+ * @param pStr Interned string.
+ */
+void ReleaseString(StringTable_t *pTable, const char *pStr)
+{
+	assert(NULL != pTable);
+	if (NULL == pStr)
+	{
+		return;
+	}
+
+	Interned_t *pString = GetInterned(pStr);
+	if (0 != -- (pString->uRefs))
+	{
+		return;
+	}
+
+	unsigned int uMask = pTable->uSlots - 1;
+	unsigned int uHole = FindStringSlot(pTable, pString);
+	unsigned int uNext = uHole;
+	unsigned int uHome = 0;
+
+	pTable->pSlots[uHole].pString = NULL;
+	-- (pTable->uStrings);
+	while (NULL != pTable->pSlots[uNext = ((uNext + 1) & uMask)].pString)
+	{
+		// String can fill the hole if the hole is not before its first slot.
+		uHome = GetStringHome(pTable, pTable->pSlots[uNext].uHash);
+		if (((uNext - uHome) & uMask) >= ((uNext - uHole) & uMask))
+		{
+			pTable->pSlots[uHole] = pTable->pSlots[uNext];
+			pTable->pSlots[uNext].pString = NULL;
+			uHole = uNext;
+		}
+	}
+	Free(pTable->pPool, pString);
+}
+
+#endif /* ENABLE_VALMemoryPool */
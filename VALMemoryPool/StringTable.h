@@ -0,0 +1,130 @@
+/**
+ * @file   VALMemoryPool/StringTable.h
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  String interning table on top of VAL memory pool.
+ *
+ * Data structure:
+ *
+ * StringTable_t              0         1         2         3                  uSlots-1
+ * +--------+          +---------+---------+---------+---------+---------+---------+
+ * | pSlots |  ----->  |  uHash  |  Empty  |  uHash  |  uHash  |   ...   |  Empty  |
+ * +--------+          | pString |         | pString | pString |         |         |
+ * | pPool  |          +---------+---------+---------+---------+---------+---------+
+ * +--------+               |                   |         |
+ *                          v                   v         v
+ *                   +-----------+       +-----------+  +-----------+
+ *                   | uLength   |       | uLength   |  | uLength   |   Interned_t, blocks of VAL pool
+ *                   | uHash     |       | uHash     |  | uHash     |
+ *                   | uRefs     |       | uRefs     |  | uRefs     |
+ *                   | data\0    |       | data\0    |  | data\0    |
+ *                   +-----------+       +-----------+  +-----------+
+ *
+ *   Every different string is saved once in a block of VAL pool, with its length, hash and number of
+ * references in front of it. InternString() returns the same address for the same string, so strings
+ * interned from the same table are equal only if their addresses are equal.
+ *
+ *   Slots are an open addressing table with linear probing, a slot keeps hash of its string beside the
+ * pointer, so probing compares hashes in the table and reads a string only if its hash is the same. Table
+ * is doubled if half of it is used, and a released slot is filled by following strings of the same probe
+ * sequence, so no deleted mark is needed.
+ */
+
+#ifndef STRINGTABLE_H_
+#define STRINGTABLE_H_
+
+#include "MemoryPool.h"
+
+/**
+ * @brief Initial number of slots in string table, must be 2^n.
+ */
+#define STRING_TABLE_SIZE 64
+
+/**
+ * @brief Interned string, it is at the beginning of a block of VAL pool, the string follows it.
+ */
+typedef struct Interned
+{
+	size_t uLength;          ///< Length of string, without '\0'.
+	unsigned int uHash;      ///< Hash of string.
+	unsigned int uRefs;      ///< Number of references, string is given back to pool when it is 0.
+	char data[];             ///< String, ended with '\0'.
+}Interned_t;
+
+/**
+ * @brief Slot of string table, empty if pString is NULL.
+ */
+typedef struct InternSlot
+{
+	unsigned int uHash;      ///< Hash of string, compared before string is read.
+	Interned_t *pString;     ///< Interned string.
+}InternSlot_t;
+
+/**
+ * @brief Information about string table.
+ */
+typedef struct StringTable
+{
+	MemoryPool_t *pPool;     ///< Pool strings are allocated from.
+	InternSlot_t *pSlots;    ///< An array of slots, open addressing.
+	unsigned int uSlots;     ///< Number of slots, 2^n.
+	unsigned int uStrings;   ///< Number of different strings in table.
+}StringTable_t;
+
+/**
+ * @brief Create string table, its strings are allocated from given pool.
+ *
+ * @param pPool VAL pool strings are allocated from, it must not be destroyed before table.
+ * @return Created string table, NULL if failed.
+ */
+StringTable_t *CreateStringTable(MemoryPool_t *pPool);
+
+/**
+ * @brief Destroy string table, all strings in it are given back to pool, no matter they are referenced
+ * or not.
+ *
+ * @param pTable Which table to destroy, set to NULL when finished to destroy.
+ */
+void DestroyStringTable(StringTable_t **pTable);
+
+/**
+ * @brief Intern a string, if the same string is in table, it is referenced once more, otherwise it is
+ * copied into pool.
+ *
+ * @param pTable Which table to intern into.
+ * @param pStr String to intern.
+ * @return Interned string, give it back by ReleaseString(), NULL if failed.
+ */
+const char *InternString(StringTable_t *pTable, const char *pStr);
+
+/**
+ * @brief Intern the first uLen characters of a string, it doesn't need to be ended with '\0'.
+ *
+ * @param pTable Which table to intern into.
+ * @param pStr String to intern.
+ * @param uLen Length of string.
+ * @return Interned string ended with '\0', give it back by ReleaseString(), NULL if failed.
+ */
+const char *InternStringN(StringTable_t *pTable, const char *pStr, size_t uLen);
+
+/**
+ * @brief Reference an interned string once more without looking up table.
+ *
+ * @param pStr Interned string.
+ * @return The same interned string.
+ */
+const char *RetainString(const char *pStr);
+
+/**
+ * @brief Give back a reference of interned string, if it is the last one, string is taken out of table
+ * and given back to pool.
+ *
+ * @param pTable Which table the string in.
+ * @param pStr Interned string.
+ */
+void ReleaseString(StringTable_t *pTable, const char *pStr);
+
+#endif /* STRINGTABLE_H_ */
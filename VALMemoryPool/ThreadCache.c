@@ -0,0 +1,238 @@
+/**
+ * @file   VALMemoryPool/ThreadCache.c
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Per thread caches in front of VAL memory pool, so that threads share a pool without taking its
+ * lock for every block.
+ */
+
+// The following macro designed for test purpose only, delete it when using.
+#include "../MemoryPoolTester.h"
+#ifdef ENABLE_VALMemoryPool
+
+#include "ThreadCache.h"
+
+/**
+ * @brief Give back all blocks of a cache to pool and release cache, it is called when thread exits.
+ *
+ * @param pCache Cache of a thread.
+ */
+void DrainThreadCache(void *pCache)
+{
+	ThreadCache_t *pThreadCache = (ThreadCache_t *)pCache;
+	CachedPool_t *pCachedPool = pThreadCache->pCachedPool;
+
+	pthread_mutex_lock(&(pCachedPool->lock));
+	Magazine_t *pMagazine = pThreadCache->pMagazines;
+	for (unsigned short i=0; i<pCachedPool->uClasses; ++ i, ++ pMagazine)
+	{
+		FreeBatch(pCachedPool->pPool, pMagazine->pBlocks, pMagazine->uCount);
+	}
+	pthread_mutex_unlock(&(pCachedPool->lock));
+	free(pThreadCache);
+}
+
+/**
+ * @brief Get cache of this thread, create it if this thread uses pool first time.
+ *
+ * @param pCachedPool Which pool the cache belongs to.
+ * @return Cache of this thread, NULL if failed.
+ */
+inline ThreadCache_t *GetThreadCache(CachedPool_t *pCachedPool)
+{
+	ThreadCache_t *pCache = (ThreadCache_t *)pthread_getspecific(pCachedPool->key);
+	if (NULL != pCache)
+	{
+		return pCache;
+	}
+
+	pCache = (ThreadCache_t *)malloc(sizeof(ThreadCache_t) + sizeof(Magazine_t) * pCachedPool->uClasses);
+	if (NULL == pCache)
+	{
+		PrintError("Failed to malloc thread cache from system.");
+		return NULL;
+	}
+	pCache->pCachedPool = pCachedPool;
+	size_t uCap = 0;
+	for (unsigned short i=0; i<pCachedPool->uClasses; ++ i)
+	{
+		uCap = MAGAZINE_BYTES / pCachedPool->pPool->pTable[i].uBlockSize;
+		uCap = (uCap > MAGAZINE_SIZE) ? MAGAZINE_SIZE : ((uCap < 2) ? 2 : (uCap & ~1UL));
+		pCache->pMagazines[i].uCount = 0;
+		pCache->pMagazines[i].uCap = (unsigned int)uCap;
+	}
+	if (0 != pthread_setspecific(pCachedPool->key, pCache))
+	{
+		PrintError("Failed to set thread cache.");
+		free(pCache);
+		return NULL;
+	}
+
+	return pCache;
+}
+
+/**
+ * @brief Create a VAL memory pool can be shared by threads.
+ *
+ * @param uMaxStrLen Max length of string this pool can allocate.
+ * @return Created pool, NULL if failed.
+ */
+CachedPool_t *CreateCachedPool(size_t uMaxStrLen)
+{
+	CachedPool_t *pCachedPool = (CachedPool_t *)malloc(sizeof(CachedPool_t));
+	if (NULL == pCachedPool)
+	{
+		PrintError("Failed to malloc memory pool from system.");
+		return NULL;
+	}
+	pCachedPool->pPool = CreateMemoryPool(uMaxStrLen);
+	if (NULL == pCachedPool->pPool)
+	{
+		free(pCachedPool);
+		return NULL;
+	}
+	if (0 != pthread_key_create(&(pCachedPool->key), DrainThreadCache))
+	{
+		PrintError("Failed to create key of thread cache.");
+		DestroyMemoryPool(&(pCachedPool->pPool));
+		free(pCachedPool);
+		return NULL;
+	}
+	pthread_mutex_init(&(pCachedPool->lock), NULL);
+	pCachedPool->uClasses = GetIndex(pCachedPool->pPool->uMaxSize) + 1;
+
+	return pCachedPool;
+}
+
+/**
+ * @brief Destroy pool, cache of this thread is drained first. Other threads must have exited or called
+ * FlushThreadCache(), and not use pool any more, all slabs and big blocks will be released.
+ *
+ * @param pCachedPool Which pool to destroy, set to NULL when finished to destroy.
+ */
+void DestroyCachedPool(CachedPool_t **pCachedPool)
+{
+	assert(NULL != *pCachedPool);
+
+	ThreadCache_t *pCache = (ThreadCache_t *)pthread_getspecific((*pCachedPool)->key);
+	if (NULL != pCache)
+	{
+		pthread_setspecific((*pCachedPool)->key, NULL);
+		DrainThreadCache(pCache);
+	}
+	pthread_key_delete((*pCachedPool)->key);
+	pthread_mutex_destroy(&((*pCachedPool)->lock));
+	DestroyMemoryPool(&((*pCachedPool)->pPool));
+	free(*pCachedPool);
+	*pCachedPool = NULL;
+}
+
+/**
+ * @brief Get a memory block from cache of this thread, refill it from pool if it is empty.
+ *
+ * @param pCachedPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory, NULL if failed.
+ */
+void *CachedMalloc(CachedPool_t *pCachedPool, size_t uSize)
+{
+	assert(NULL != pCachedPool);
+	assert(0 != uSize);
+	MemoryPool_t *pPool = pCachedPool->pPool;
+	ThreadCache_t *pCache = NULL;
+	void *pPtr = NULL;
+
+	// Big blocks and blocks of thread failed to create cache are allocated from pool directly.
+	if ((uSize > pPool->uMaxSize) || (NULL == (pCache = GetThreadCache(pCachedPool))))
+	{
+		pthread_mutex_lock(&(pCachedPool->lock));
+		pPtr = Malloc(pPool, uSize);
+		pthread_mutex_unlock(&(pCachedPool->lock));
+		return pPtr;
+	}
+
+	// Refill half of magazine if it is empty.
+	unsigned short uIndex = GetIndex(uSize);
+	Magazine_t *pMagazine = &(pCache->pMagazines[uIndex]);
+	if (0 == pMagazine->uCount)
+	{
+		pthread_mutex_lock(&(pCachedPool->lock));
+		pMagazine->uCount = MallocBatch(pPool, uSize, pMagazine->pBlocks, pMagazine->uCap / 2);
+		pthread_mutex_unlock(&(pCachedPool->lock));
+		if (0 == pMagazine->uCount)
+		{
+			return NULL;
+		}
+	}
+
+	return pMagazine->pBlocks[-- (pMagazine->uCount)];
+}
+
+/**
+ * @brief Back a memory block to cache of this thread, half of cache is given back to pool if it is full.
+ * Block can be got by any thread.
+ *
+ * @param pCachedPool Back to which pool.
+ * @param pPtr Address of memory block to back.
+ */
+void CachedFree(CachedPool_t *pCachedPool, void *pPtr)
+{
+	if (NULL == pCachedPool)
+	{
+		PrintWarning("A ptr will be freed but memory pool already been destroy.");
+		return;
+	}
+	if (NULL == pPtr)
+	{
+		return;
+	}
+
+	// Big blocks, blocks not belong to pool and blocks of thread failed to create cache are given back to
+	// pool directly.
+	MemoryPool_t *pPool = pCachedPool->pPool;
+	Slab_t *pSlab = GetSlabOfBlock(pPool, pPtr);
+	ThreadCache_t *pCache = NULL;
+	if ((pSlab->pPool != pPool) || (BIG_BLOCK_INDEX == pSlab->uIndex)
+			|| (NULL == (pCache = GetThreadCache(pCachedPool))))
+	{
+		pthread_mutex_lock(&(pCachedPool->lock));
+		Free(pPool, pPtr);
+		pthread_mutex_unlock(&(pCachedPool->lock));
+		return;
+	}
+
+	// Give back the older half of magazine if it is full, blocks freed lately are used first.
+	Magazine_t *pMagazine = &(pCache->pMagazines[pSlab->uIndex]);
+	if (pMagazine->uCount == pMagazine->uCap)
+	{
+		unsigned int uHalf = pMagazine->uCap / 2;
+		pthread_mutex_lock(&(pCachedPool->lock));
+		FreeBatch(pPool, pMagazine->pBlocks, uHalf);
+		pthread_mutex_unlock(&(pCachedPool->lock));
+		memmove(pMagazine->pBlocks, pMagazine->pBlocks + uHalf, sizeof(void *) * (pMagazine->uCount - uHalf));
+		pMagazine->uCount -= uHalf;
+	}
+	pMagazine->pBlocks[(pMagazine->uCount) ++] = pPtr;
+}
+
+/**
+ * @brief Give back all blocks cached by this thread to pool, such as before thread sleeps for long.
+ *
+ * @param pCachedPool Which pool the cache belongs to.
+ */
+void FlushThreadCache(CachedPool_t *pCachedPool)
+{
+	assert(NULL != pCachedPool);
+
+	ThreadCache_t *pCache = (ThreadCache_t *)pthread_getspecific(pCachedPool->key);
+	if (NULL != pCache)
+	{
+		pthread_setspecific(pCachedPool->key, NULL);
+		DrainThreadCache(pCache);
+	}
+}
+
+#endif /* ENABLE_VALMemoryPool */
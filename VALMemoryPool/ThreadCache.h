@@ -0,0 +1,121 @@
+/**
+ * @file   VALMemoryPool/ThreadCache.h
+ *
+ * @date   Oct 17, 2026
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Per thread caches in front of VAL memory pool, so that threads share a pool without taking its
+ * lock for every block.
+ *
+ * Data structure:
+ *
+ * CachedPool_t                          ThreadCache_t of a thread
+ * +--------+                            +--------------+-------------+-------------+-----+-------------+
+ * | pPool  | ---> VAL memory pool       | pCachedPool  |  Magazine 0 |  Magazine 1 | ... |  Magazine n |
+ * +--------+                            +--------------+-------------+-------------+-----+-------------+
+ * | lock   | <--- taken to refill and                         |
+ * +--------+      flush magazines                      +-------------+
+ * |  key   | ---> pthread key of                       | uCount/uCap |
+ * +--------+      ThreadCache_t                        | pBlocks[]   |  stack of idle blocks of class 0
+ *                                                      +-------------+
+ *
+ *   Every thread has a magazine for every size class, a small stack of idle blocks. CachedMalloc() pops a
+ * block from magazine of its class, and CachedFree() pushes it back, none of them takes lock of pool. An
+ * empty magazine is refilled with half of it by MallocBatch() of pool, and a full one gives back half of it
+ * by FreeBatch(), so pool is locked once every uCap / 2 Malloc or Free of a size class at most. Blocks bigger
+ * than pool can allocate don't go through magazines.
+ *
+ *   Magazine keeps MAGAZINE_BYTES of blocks, not more than MAGAZINE_SIZE and not less than two blocks, so
+ * long strings don't stay in threads. Cache of a thread is created when it first uses pool, and its blocks
+ * are given back to pool when thread exits, or FlushThreadCache() is called.
+ */
+
+#ifndef THREADCACHE_H_
+#define THREADCACHE_H_
+
+#include "MemoryPool.h"
+#include <pthread.h>
+
+/**
+ * @brief Most blocks a magazine can keep, must be even.
+ */
+#define MAGAZINE_SIZE 32
+
+/**
+ * @brief Bytes of blocks a magazine keeps, magazines of long blocks keep fewer blocks.
+ */
+#define MAGAZINE_BYTES (64 * 1024)
+
+/**
+ * @brief Idle blocks of a size class cached by a thread.
+ */
+typedef struct Magazine
+{
+	unsigned int uCount;             ///< Number of blocks in magazine.
+	unsigned int uCap;               ///< Most blocks magazine keeps, even.
+	void *pBlocks[MAGAZINE_SIZE];    ///< Stack of blocks, the last one is allocated first.
+}Magazine_t;
+
+/**
+ * @brief Cache of a thread, magazines of all size classes of pool.
+ */
+typedef struct ThreadCache
+{
+	struct CachedPool *pCachedPool;  ///< Pool this cache belongs to.
+	Magazine_t pMagazines[];         ///< Magazine of every size class.
+}ThreadCache_t;
+
+/**
+ * @brief VAL memory pool shared by threads, with a cache in every thread.
+ */
+typedef struct CachedPool
+{
+	MemoryPool_t *pPool;             ///< Shared pool, only used with lock taken.
+	pthread_mutex_t lock;            ///< Lock of shared pool.
+	pthread_key_t key;               ///< Key of cache of every thread, cache is drained when thread exits.
+	unsigned short uClasses;         ///< Number of size classes of pool.
+}CachedPool_t;
+
+/**
+ * @brief Create a VAL memory pool can be shared by threads.
+ *
+ * @param uMaxStrLen Max length of string this pool can allocate.
+ * @return Created pool, NULL if failed.
+ */
+CachedPool_t *CreateCachedPool(size_t uMaxStrLen);
+
+/**
+ * @brief Destroy pool, cache of this thread is drained first. Other threads must have exited or called
+ * FlushThreadCache(), and not use pool any more, all slabs and big blocks will be released.
+ *
+ * @param pCachedPool Which pool to destroy, set to NULL when finished to destroy.
+ */
+void DestroyCachedPool(CachedPool_t **pCachedPool);
+
+/**
+ * @brief Get a memory block from cache of this thread, refill it from pool if it is empty.
+ *
+ * @param pCachedPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory, NULL if failed.
+ */
+void *CachedMalloc(CachedPool_t *pCachedPool, size_t uSize);
+
+/**
+ * @brief Back a memory block to cache of this thread, half of cache is given back to pool if it is full.
+ * Block can be got by any thread.
+ *
+ * @param pCachedPool Back to which pool.
+ * @param pPtr Address of memory block to back.
+ */
+void CachedFree(CachedPool_t *pCachedPool, void *pPtr);
+
+/**
+ * @brief Give back all blocks cached by this thread to pool, such as before thread sleeps for long.
+ *
+ * @param pCachedPool Which pool the cache belongs to.
+ */
+void FlushThreadCache(CachedPool_t *pCachedPool);
+
+#endif /* THREADCACHE_H_ */
@@ -0,0 +1,255 @@
+/**
+ * @file   VUBMemoryPool/MemoryPool.h
+ *
+ * @date   Oct 19, 2011
+ * @author WangLiang
+ * @email  WangLiangCN@live.com
+ *
+ * @brief  Variable length, Unable to recycle, Block store style memory pool.
+ *
+ * Data structure:
+ *
+ * MemoryPool_t           1~8      9~16     17~24     25~32     33~40     41~48      ...  24577~28672
+ * +--------+
+ * |        |       +---------+---------+---------+---------+---------+---------+---------+-----------+
+ * | pTable |  -->  |  Class  |  Class  |  Class  |  Class  |  Class  |  Class  |   ...   |   Class   |
+ * |        |       +---------+---------+---------+---------+---------+---------+---------+-----------+
+ * |        |            |                             |
+ * +--------+            |  pNextNeverUsed             |  pNextNeverUsed
+ * |        |            |                             |
+ * |  uMax  |            |    MemoryChunk_t            |    MemoryChunk_t
+ * |  Size  |            |  +-----------------+        |  +-----------------+
+ * |        |            |  |     uIndex      |        |  |     uIndex      |
+ * +--------+            |  +-----------------+        |  +-----------------+
+ * |        |            |  |     Block[0]    |        |  |     Block[0]    |
+ * | pFirst |            |  +-----------------+        |  +-----------------+
+ * | Chunk  |            |  |     ......      |        |  |     ......      |
+ * |        |            |  +-----------------+        |  +-----------------+
+ * +--------+            -> |     Block[m]    |        -> |     Block[n]    |
+ * |        |               +-----------------+           +-----------------+
+ * |  pBig  |               |     ......      |           |     ......      |
+ * |  Block |               +-----------------+           +-----------------+
+ * |        |
+ * +--------+
+ *
+ *   Size classes are ALIGN_SIZE steps up to 2^LINEAR_SIZE_BITS bytes, then every power of two is split into
+ * 2^CLASS_BITS classes, the same as size lists of VULMemoryPool, so pool of the longest strings has 147
+ * classes only, and a block wastes at most 1/2^CLASS_BITS of it.
+ *
+ *   Every size class takes blocks from its own chunks, a chunk is CHUNK_SIZE bytes and aligned to
+ * CHUNK_SIZE, blocks in it have the same size and follow chunk information. Never used blocks are taken
+ * from the current chunk of class one by one, blocks given back by Free() make up an idle list of class
+ * and are used first. Chunks are never released to system until pool is destroyed.
+ *
+ *   Blocks have no header, Free() masks address of block to get its chunk, and gets size class from the
+ * chunk. Big blocks bigger than pool can allocate are allocated from system by malloc() with a BigBlock_t
+ * in front of them, and kept in a hash table by address, Free() looks up it first when pool has big
+ * blocks. All big blocks are in one doubly linked list, so they are unlinked without search.
+ */
+
+#ifndef MEMORYPOOL_H_
+#define MEMORYPOOL_H_
+
+#include "../CProjectDfn.h"
+#include <limits.h>
+
+/**
+ * @brief Size of every chunk, must be 2^n, every chunk is aligned to this size.
+ */
+#define CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Align size, must be 2^n
+ */
+#define ALIGN_SIZE 8
+
+/**
+ * @brief Sizes not bigger than 2^LINEAR_SIZE_BITS have a size class every ALIGN_SIZE bytes.
+ */
+#define LINEAR_SIZE_BITS 10
+
+/**
+ * @brief Every power of two bigger than 2^LINEAR_SIZE_BITS is split into 2^CLASS_BITS size classes.
+ * ALIGN_SIZE << CLASS_BITS must not be bigger than 2^LINEAR_SIZE_BITS.
+ */
+#define CLASS_BITS 2
+
+/**
+ * @brief Number of size classes every ALIGN_SIZE bytes.
+ */
+#define LINEAR_CLASSES ((1 << LINEAR_SIZE_BITS) / ALIGN_SIZE)
+
+/**
+ * @brief Max length of string pool can allocate, if bigger than this when creating, down to this size.
+ * It is the longest size class smaller than half of chunk, so a chunk can at least have two blocks
+ * following its information.
+ */
+#define MAX_STRING_LEN ((CHUNK_SIZE / 2) - (CHUNK_SIZE >> (CLASS_BITS + 2)))
+
+/**
+ * @brief Initial number of slots in hash table of big blocks, must be 2^n.
+ */
+#define BIG_TABLE_SIZE 16
+
+/**
+ * @brief Allocate size of memory, if it not used, let the first four block save the pointer pointed to
+ * next free allocated memory, if this memory are using, [data] is the first address of this memory.
+ */
+typedef union Node
+{
+	union Node *pNext;    ///< If this memory is idle, this pointed to next free memory block.
+	char data[1];         ///< If this memory is using, this is the address of this block.
+}Node_t;
+
+/**
+ * @brief Memory chunk information, it is at the beginning of a chunk, blocks of a size class follow it.
+ */
+typedef struct MemoryChunk
+{
+	unsigned short uIndex;              ///< Size class of blocks in this chunk.
+	struct MemoryPoolInf *pPool;        ///< Pool this chunk belongs to, to check block given back by Free().
+	struct MemoryChunk *pNextChunk;     ///< Next chunk, this make up a chunk list.
+}MemoryChunk_t;
+
+/**
+ * @brief Information of big block bigger than pool can allocate, it is in front of the big block.
+ */
+typedef struct BigBlock
+{
+	struct BigBlock *pNext;   ///< Next allocated big block if this not the last one.
+	struct BigBlock *pPre;    ///< Previous allocated big block if that exists.
+}BigBlock_t;
+
+/**
+ * @brief Size of information in front of big block, keeps block aligned as malloc() does.
+ */
+#define BIG_HEAD_SIZE ((sizeof(BigBlock_t) + 15) & ~15)
+
+/**
+ * @brief Size class, blocks of the same size are taken from idle list first, then from current chunk.
+ */
+typedef struct SizeClass
+{
+	Node_t *pFirstNode;        ///< First idle memory block given back by Free().
+	void *pNextNeverUsed;      ///< Next never used block in current chunk of this class.
+	void *pEndOfChunk;         ///< End address of current chunk of this class.
+}SizeClass_t;
+
+/**
+ * @brief Block table is an array, each elements describes blocks of a size class.
+ */
+typedef SizeClass_t BlockTable_t;
+
+/**
+ * @biref Information about memory pool.
+ */
+typedef struct MemoryPoolInf
+{
+	unsigned int uMaxSize;          ///< Longest block memory pool can allocate, if bigger, deliver to system.
+	BlockTable_t *pTable;           ///< An array, each describes blocks of a size class.
+	MemoryChunk_t *pFirstChunk;     ///< All chunks of all size classes, release them when destroy.
+	BigBlock_t *pFirstBigBlock;     ///< If bigger than pool can allocate, pointed to list which contains them.
+	BigBlock_t **pBigTable;         ///< Hash table of big blocks by address, open addressing.
+	unsigned int uBigSlots;         ///< Number of slots in pBigTable, 2^n.
+	unsigned int uBigBlocks;        ///< Number of big blocks in pBigTable.
+}MemoryPool_t;
+
+/**
+ * @brief Get index from block table by given size.
+ */
+inline unsigned short GetIndex(unsigned short size)
+{
+	if (size <= (1 << LINEAR_SIZE_BITS))
+	{
+		return (((size) + (ALIGN_SIZE - 1)) / (ALIGN_SIZE) - 1);
+	}
+
+	// Power of two size belongs to, then which part of it.
+	unsigned int uBits = (sizeof(unsigned int) * CHAR_BIT - 1) - __builtin_clz((unsigned int)size - 1);
+	return LINEAR_CLASSES + ((uBits - LINEAR_SIZE_BITS) << CLASS_BITS)
+			+ (((unsigned int)size - 1) >> (uBits - CLASS_BITS)) - (1 << CLASS_BITS);
+}
+
+/**
+ * @brief Get size of blocks of a size class.
+ */
+inline unsigned short GetClassSize(unsigned short uIndex)
+{
+	if (uIndex < LINEAR_CLASSES)
+	{
+		return (uIndex + 1) * ALIGN_SIZE;
+	}
+
+	unsigned int uGroup = uIndex - LINEAR_CLASSES;
+	unsigned int uBits = LINEAR_SIZE_BITS + (uGroup >> CLASS_BITS);
+	return ((1 << CLASS_BITS) + (uGroup & ((1 << CLASS_BITS) - 1)) + 1) << (uBits - CLASS_BITS);
+}
+
+/**
+ * @brief Align function, convert it to size of blocks of size class it belongs to.
+ */
+inline unsigned short RoundUp(unsigned short size)
+{
+	return GetClassSize(GetIndex(size));
+}
+
+/**
+ * @brief Create memory pool, so can allocate memory after that.
+ *
+ * It doesn't means can't get memory if bigger than given size, pool will deliver to system functions,
+ * so that performance is equal as system. When destroy pool, all chunks and big blocks will be released,
+ * no matter they are using or not.
+ *
+ * @param uMaxStrLen Max length of string this pool can allocate.
+ * @return Created memory pool.
+ */
+MemoryPool_t *CreateMemoryPool(unsigned short uMaxStrLen);
+
+/**
+ * @brief Destroy memory pool, release all chunks and all blocks bigger than max size pool can allocate.
+ *
+ * @param pPool Which pool to destroy, set to NULL when finished to destroy.
+ */
+void DestroyMemoryPool(MemoryPool_t **pPool);
+
+/**
+ * @biref Get a memory block from pool.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory.
+ */
+void *Malloc(MemoryPool_t *pPool, unsigned short uSize);
+
+/**
+ * @brief Back a memory block to pool so that it can be use again, chunk is not released to system.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtr Address of memory block to back.
+ */
+void Free(MemoryPool_t *pPool, void *pPtr);
+
+/**
+ * @brief Get many memory blocks of the same size from pool at once, idle blocks are taken from list in one
+ * pass, then never used blocks are taken from chunks one after another.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @param pPtrs Where to save addresses of allocated memory.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, unsigned short uSize, void **pPtrs, unsigned int uCount);
+
+/**
+ * @brief Back many memory blocks to pool at once. Blocks following each other in the same chunk are linked
+ * together and joined to idle list of size class once, so give back blocks grouped by chunk, such as in
+ * the order MallocBatch() allocated them.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtrs Addresses of memory blocks to back.
+ * @param uCount Number of memory blocks to back.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
+#endif /* MEMORYPOOL_H_ */
@@ -14,6 +14,291 @@
 
 #include "MemoryPool.h"
 
+/**
+ * @brief Get where size of string is saved, it is the last aligned bytes of usable memory of block, so that
+ * block address got from system can be returned to user directly and keeps its alignment.
+ *
+ * @param pPtr Address of block, got from system by malloc().
+ * @return Address of size of string.
+ */
+inline size_t *GetSizeOfBlock(void *pPtr)
+{
+	return (size_t *)(((unsigned long)pPtr + malloc_usable_size(pPtr) - sizeof(size_t))
+			& ~(sizeof(size_t) - 1));
+}
+
+/**
+ * @brief Get information of big block, it is just before size of string at the end of block, and aligned
+ * to pointer.
+ *
+ * @param pPtr Address of big block, got from system by malloc().
+ * @return Information of big block.
+ */
+inline BigBlock_t *GetBigBlockInfo(void *pPtr)
+{
+	return (BigBlock_t *)(((unsigned long)GetSizeOfBlock(pPtr) - sizeof(BigBlock_t)) & ~(sizeof(void *) - 1));
+}
+
+/**
+ * @brief Check if a big block is mapped from system, information of mapped block is in front of it.
+ *
+ * @param pBigBlock Information of big block.
+ * @return 1 if mapped, 0 if allocated by malloc().
+ */
+inline char IsMappedBlock(BigBlock_t *pBigBlock)
+{
+	return ((void *)pBigBlock + MAPPED_HEAD_SIZE) == pBigBlock->data;
+}
+
+/**
+ * @brief Get slot a mapped big block should be in, the first slot of its probe sequence in hash table.
+ *
+ * @param pPool Which pool the hash table in.
+ * @param pPtr Address of mapped big block.
+ * @return Index of slot.
+ */
+inline unsigned int GetMappedHome(MemoryPool_t *pPool, void *pPtr)
+{
+	return (unsigned int)((((unsigned long long)(unsigned long)pPtr >> 12) * 0x9E3779B97F4A7C15ULL)
+			>> (sizeof(unsigned long long) * CHAR_BIT - __builtin_ctz(pPool->uMappedSlots)));
+}
+
+/**
+ * @brief Get slot of a mapped big block in hash table, or the empty slot it should be put in.
+ *
+ * @param pPool Which pool the hash table in.
+ * @param pPtr Address of mapped big block.
+ * @return Index of slot.
+ */
+inline unsigned int GetMappedSlot(MemoryPool_t *pPool, void *pPtr)
+{
+	unsigned int uMask = pPool->uMappedSlots - 1;
+	unsigned int uSlot = GetMappedHome(pPool, pPtr);
+	while ((NULL != pPool->pMappedTable[uSlot]) && (pPool->pMappedTable[uSlot]->data != pPtr))
+	{
+		uSlot = (uSlot + 1) & uMask;
+	}
+
+	return uSlot;
+}
+
+/**
+ * @brief Find information of a mapped big block by its address.
+ *
+ * @param pPool Which pool the block in.
+ * @param pPtr Address of memory block.
+ * @return Information of mapped big block, NULL if block is not mapped.
+ */
+inline BigBlock_t *FindMappedBlock(MemoryPool_t *pPool, void *pPtr)
+{
+	return (0 == pPool->uMappedBlocks) ? NULL : pPool->pMappedTable[GetMappedSlot(pPool, pPtr)];
+}
+
+/**
+ * @brief Put a mapped big block into hash table, table is doubled if half of it is used.
+ *
+ * @param pPool Which pool the hash table in.
+ * @param pBigBlock Information of mapped big block.
+ * @return 1 if succeed, 0 if failed.
+ */
+inline char AddMappedBlock(MemoryPool_t *pPool, BigBlock_t *pBigBlock)
+{
+	if ((pPool->uMappedBlocks + 1) * 2 > pPool->uMappedSlots)
+	{
+		unsigned int uOldSlots = pPool->uMappedSlots;
+		BigBlock_t **pOldTable = pPool->pMappedTable;
+		unsigned int uSlots = (0 == uOldSlots) ? MAPPED_TABLE_SIZE : (uOldSlots << 1);
+		BigBlock_t **pTable = (BigBlock_t **)calloc(uSlots, sizeof(BigBlock_t *));
+		if (NULL == pTable)
+		{
+			PrintError("Failed to malloc memory from system.");
+			return 0;
+		}
+		pPool->pMappedTable = pTable;
+		pPool->uMappedSlots = uSlots;
+		for (unsigned int i=0; i<uOldSlots; ++ i)
+		{
+			(NULL != pOldTable[i]) ? (pTable[GetMappedSlot(pPool, pOldTable[i]->data)] = pOldTable[i]) : 0;
+		}
+		free(pOldTable);
+	}
+	pPool->pMappedTable[GetMappedSlot(pPool, pBigBlock->data)] = pBigBlock;
+	++ (pPool->uMappedBlocks);
+
+	return 1;
+}
+
+/**
+ * @brief Take a mapped big block out of hash table, following blocks of the same probe sequence are moved
+ * back, so that searching doesn't stop at the hole.
+ *
+ * @param pPool Which pool the hash table in.
+ * @param pBigBlock Information of mapped big block, it must be in table.
+ */
+inline void RemoveMappedBlock(MemoryPool_t *pPool, BigBlock_t *pBigBlock)
+{
+	unsigned int uMask = pPool->uMappedSlots - 1;
+	unsigned int uHole = GetMappedSlot(pPool, pBigBlock->data);
+	unsigned int uNext = uHole;
+	unsigned int uHome = 0;
+
+	pPool->pMappedTable[uHole] = NULL;
+	-- (pPool->uMappedBlocks);
+	while (NULL != pPool->pMappedTable[uNext = ((uNext + 1) & uMask)])
+	{
+		// Block can fill the hole if the hole is not before its first slot.
+		uHome = GetMappedHome(pPool, pPool->pMappedTable[uNext]->data);
+		if (((uNext - uHome) & uMask) >= ((uNext - uHole) & uMask))
+		{
+			pPool->pMappedTable[uHole] = pPool->pMappedTable[uNext];
+			pPool->pMappedTable[uNext] = NULL;
+			uHole = uNext;
+		}
+	}
+}
+
+/**
+ * @brief Link a big block at the head of big block list, and count it.
+ *
+ * @param pPool Which pool the block belongs to.
+ * @param pBigBlock Information of big block.
+ */
+inline void LinkBigBlock(MemoryPool_t *pPool, BigBlock_t *pBigBlock)
+{
+	pBigBlock->pNext = pPool->pFirstBigBlock;
+	pBigBlock->pPre = NULL;
+	(NULL != pPool->pFirstBigBlock) ? (pPool->pFirstBigBlock->pPre = pBigBlock) : 0;
+	pPool->pFirstBigBlock = pBigBlock;
+	++ (pPool->uBigBlocks);
+	pPool->uBigBlockBytes += pBigBlock->uLength;
+}
+
+/**
+ * @brief Unlink a big block from big block list without search.
+ *
+ * @param pPool Which pool the block belongs to.
+ * @param pBigBlock Information of big block, it must be in list.
+ */
+inline void UnlinkBigBlock(MemoryPool_t *pPool, BigBlock_t *pBigBlock)
+{
+	(NULL == pBigBlock->pPre) ? (pPool->pFirstBigBlock = pBigBlock->pNext)
+	                          : (pBigBlock->pPre->pNext = pBigBlock->pNext);
+	(NULL != pBigBlock->pNext) ? (pBigBlock->pNext->pPre = pBigBlock->pPre) : 0;
+	-- (pPool->uBigBlocks);
+	pPool->uBigBlockBytes -= pBigBlock->uLength;
+}
+
+/**
+ * @brief Release a big block to system, unmap it if it is mapped.
+ *
+ * @param pBigBlock Information of big block.
+ */
+inline void ReleaseBigBlock(BigBlock_t *pBigBlock)
+{
+	if (IsMappedBlock(pBigBlock))
+	{
+		munmap(pBigBlock, pBigBlock->uLength);
+	}
+	else
+	{
+		free(pBigBlock->data);
+	}
+}
+
+/**
+ * @brief Allocate a big block from system and record it, if it is not smaller than MMAP_THRESHOLD, map
+ * it by mmap() in whole pages.
+ *
+ * @param pPool Which pool the block belongs to.
+ * @param uSize Size of string want to allocate.
+ * @return Allocated memory, NULL if failed.
+ */
+inline void *MallocBigBlock(MemoryPool_t *pPool, size_t uSize)
+{
+	BigBlock_t *pBigBlock = NULL;
+	if (uSize > SIZE_MAX - MAPPED_HEAD_SIZE - sysconf(_SC_PAGESIZE))
+	{
+		PrintError("Size of string is too big to allocate.");
+		return NULL;
+	}
+	size_t uLen = MAPPED_HEAD_SIZE + uSize;
+	if (uLen >= MMAP_THRESHOLD)
+	{
+		size_t uPageSize = sysconf(_SC_PAGESIZE);
+		uLen = (uLen + uPageSize - 1) & ~(uPageSize - 1);
+		pBigBlock = (BigBlock_t *)mmap(NULL, uLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == (void *)pBigBlock)
+		{
+			PrintError("Failed to mmap memory from system.");
+			return NULL;
+		}
+		pBigBlock->data = (void *)pBigBlock + MAPPED_HEAD_SIZE;
+		if (!AddMappedBlock(pPool, pBigBlock))
+		{
+			munmap(pBigBlock, uLen);
+			return NULL;
+		}
+	}
+	else
+	{
+		uLen = uSize + sizeof(void *) + sizeof(BigBlock_t) + sizeof(size_t);
+		void *pPtr = malloc(uLen);
+		if (NULL == pPtr)
+		{
+			PrintError("Failed to malloc memory from system.");
+			return NULL;
+		}
+		*GetSizeOfBlock(pPtr) = uSize;
+		pBigBlock = GetBigBlockInfo(pPtr);
+		pBigBlock->data = pPtr;
+	}
+	pBigBlock->uLength = uLen;
+	LinkBigBlock(pPool, pBigBlock);
+
+	return pBigBlock->data;
+}
+
+/**
+ * @brief Change length of a mapped big block by remapping its pages, they are moved without copy if can't
+ * grow in place.
+ *
+ * @param pPool Which pool the block belongs to.
+ * @param pBigBlock Information of mapped big block.
+ * @param uSize New size of string.
+ * @return Address of remapped block, NULL if failed and block is not changed.
+ */
+inline void *RemapBigBlock(MemoryPool_t *pPool, BigBlock_t *pBigBlock, size_t uSize)
+{
+	size_t uPageSize = sysconf(_SC_PAGESIZE);
+	if (uSize > SIZE_MAX - MAPPED_HEAD_SIZE - uPageSize)
+	{
+		PrintError("Size of string is too big to allocate.");
+		return NULL;
+	}
+	size_t uLen = (MAPPED_HEAD_SIZE + uSize + uPageSize - 1) & ~(uPageSize - 1);
+
+	RemoveMappedBlock(pPool, pBigBlock);
+	UnlinkBigBlock(pPool, pBigBlock);
+	BigBlock_t *pNewBlock = (BigBlock_t *)mremap(pBigBlock, pBigBlock->uLength, uLen, MREMAP_MAYMOVE);
+	if (MAP_FAILED == (void *)pNewBlock)
+	{
+		PrintError("Failed to mremap memory from system.");
+		pNewBlock = NULL;
+	}
+	else
+	{
+		pBigBlock = pNewBlock;
+		pBigBlock->data = (void *)pBigBlock + MAPPED_HEAD_SIZE;
+		pBigBlock->uLength = uLen;
+	}
+
+	// Table doesn't grow since the block was just taken out.
+	AddMappedBlock(pPool, pBigBlock);
+	LinkBigBlock(pPool, pBigBlock);
+
+	return (NULL == pNewBlock) ? NULL : pBigBlock->data;
+}
+
 /**
  * @brief Create memory pool, so can allocate memory after that.
  *
@@ -25,14 +310,19 @@
  * @param uMaxStrLen Max length of string this pool can allocate.
  * @return Created memory pool.
  */
-MemoryPool_t *CreateMemoryPool(unsigned short uMaxStrLen)
+MemoryPool_t *CreateMemoryPool(size_t uMaxStrLen)
 {
 	uMaxStrLen = (uMaxStrLen > MAX_STRING_LEN) ? MAX_STRING_LEN : uMaxStrLen;
-	unsigned short uFreeTableLen = GetIndex(uMaxStrLen) + 1;
+	unsigned int uFreeTableLen = GetIndex(uMaxStrLen) + 1;
 
 	MemoryPool_t *pPool = (MemoryPool_t *)malloc(sizeof(MemoryPool_t) + (sizeof(BlockTable_t) * uFreeTableLen));
 	pPool->uMaxSize = uMaxStrLen;
 	pPool->pFirstBigBlock = NULL;
+	pPool->uBigBlocks = 0;
+	pPool->uBigBlockBytes = 0;
+	pPool->pMappedTable = NULL;
+	pPool->uMappedSlots = 0;
+	pPool->uMappedBlocks = 0;
 	pPool->pTable = (BlockTable_t *)((void *)pPool + sizeof(MemoryPool_t));
 	for (int i=0; i<uFreeTableLen; ++i)
 	{
@@ -57,7 +347,7 @@ void DestroyMemoryPool(MemoryPool_t **pPool)
 	BigBlock_t *pPreBlock = NULL;
 
 	// Release idle blocks in pool.
-	unsigned short uFreeTableLen = GetIndex((*pPool)->uMaxSize) + 1;
+	unsigned int uFreeTableLen = GetIndex((*pPool)->uMaxSize) + 1;
 	for (int i=0; i<uFreeTableLen; ++i)
 	{
 		pCurrNode = (*pPool)->pTable[i];
@@ -75,8 +365,9 @@ void DestroyMemoryPool(MemoryPool_t **pPool)
 	{
 		pPreBlock = pCurrBlock;
 		pCurrBlock = pCurrBlock->pNext;
-		free(pPreBlock);
+		ReleaseBigBlock(pPreBlock);
 	}
+	free((*pPool)->pMappedTable);
 
 	// Release pool.
 	free(*pPool);
@@ -90,26 +381,17 @@ void DestroyMemoryPool(MemoryPool_t **pPool)
  * @param uSize Size of string want to allocate.
  * @return Allocated memory.
  */
-void *Malloc(MemoryPool_t *pPool, unsigned short uSize)
+void *Malloc(MemoryPool_t *pPool, size_t uSize)
 {
 	assert(NULL != pPool);
 	assert(0 != uSize);
-	unsigned short uIndex = GetIndex(uSize);
+	unsigned int uIndex = GetIndex(uSize);
 	void *pPtr = NULL;
 
 	// If user want to allocate a memory bigger than pool can do, deliver this to system and record it.
 	if (uSize > pPool->uMaxSize)
 	{
-		pPtr = malloc(sizeof(BigBlock_t) + sizeof(unsigned short) + uSize);
-		*((unsigned short *)(pPtr + sizeof(BigBlock_t))) = uSize;
-		BigBlock_t *pBigBlock = (BigBlock_t *)pPtr;
-		pBigBlock->data = pPtr + sizeof(BigBlock_t) + sizeof(unsigned short);
-		pBigBlock->pNext = pPool->pFirstBigBlock;
-		pBigBlock->pPre = NULL;
-		(NULL != pPool->pFirstBigBlock) ? (pPool->pFirstBigBlock->pPre = pBigBlock) : 0;
-		pPool->pFirstBigBlock = pBigBlock;
-
-		return pBigBlock->data;
+		return MallocBigBlock(pPool, uSize);
 	}
 
 	// Check if there are idle blocks can be use again, or allocate new blocks from system.
@@ -117,21 +399,17 @@ void *Malloc(MemoryPool_t *pPool, unsigned short uSize)
 	{
 		pPtr = (void *)&(pPool->pTable[uIndex]->data);
 		pPool->pTable[uIndex] = pPool->pTable[uIndex]->pNext;
-		*(unsigned short *)pPtr = uSize;
-		pPtr += sizeof(unsigned short);
+		*GetSizeOfBlock(pPtr) = uSize;
 	}
 	else
 	{
-		unsigned short uLen = sizeof(unsigned short) + RoundUp(uSize);
-		uLen = (uLen > sizeof(Node_t)) ? uLen : sizeof(Node_t);
-		pPtr = malloc(uLen);
+		pPtr = malloc(RoundUp(uSize) + sizeof(size_t));
 		if (NULL == pPtr)
 		{
 			PrintError("Failed to malloc memory from system.");
 			return NULL;
 		}
-		*(unsigned short *)pPtr = uSize;
-		pPtr += sizeof(unsigned short);
+		*GetSizeOfBlock(pPtr) = uSize;
 	}
 
 	return pPtr;
@@ -152,23 +430,196 @@ void Free(MemoryPool_t *pPool, void *pPtr)
 		return;
 	}
 
+	// Mapped big blocks have no size of string at the end, find them by address first.
+	BigBlock_t *pBigBlock = FindMappedBlock(pPool, pPtr);
+	if (NULL != pBigBlock)
+	{
+		RemoveMappedBlock(pPool, pBigBlock);
+		UnlinkBigBlock(pPool, pBigBlock);
+		munmap(pBigBlock, pBigBlock->uLength);
+		return;
+	}
+
 	// Check if big blocks allocated from system directly, if so, release it to system, pool won't use it.
-	pPtr -= sizeof(unsigned short);
-	unsigned short uSize = *((unsigned short *)pPtr);
+	size_t uSize = *GetSizeOfBlock(pPtr);
 	if (uSize > pPool->uMaxSize)
 	{
-		pPtr -= sizeof(BigBlock_t);
-		BigBlock_t *pBigBlock = (BigBlock_t *)pPtr;
-		(NULL == pBigBlock->pPre) ? (pPool->pFirstBigBlock = pBigBlock->pNext)
-				                  : (pBigBlock->pPre->pNext = pBigBlock->pNext);
+		UnlinkBigBlock(pPool, GetBigBlockInfo(pPtr));
 		free(pPtr);
 		return;
 	}
 	// Back the memory block to pool so that can use it again.
-	unsigned short uIndex = GetIndex(uSize);
+	unsigned int uIndex = GetIndex(uSize);
 	Node_t *pNode = (Node_t *)pPtr;
 	pNode->pNext = pPool->pTable[uIndex];
 	pPool->pTable[uIndex] = pNode;
 }
 
+/**
+ * @brief Change size of a memory block. If new size is in the same size list, or big block is not
+ * longer, the same block is returned, otherwise string is moved to a block of new size. Mapped big block
+ * is remapped without copy.
+ *
+ * @param pPool Which pool the block in.
+ * @param pPtr Address of memory block, NULL to allocate a new one.
+ * @param uSize New size of string, 0 to back the block to pool.
+ * @return Address of memory block, NULL if failed and the old one is not changed, or uSize is 0.
+ */
+void *Realloc(MemoryPool_t *pPool, void *pPtr, size_t uSize)
+{
+	assert(NULL != pPool);
+	if (NULL == pPtr)
+	{
+		return Malloc(pPool, uSize);
+	}
+	if (0 == uSize)
+	{
+		Free(pPool, pPtr);
+		return NULL;
+	}
+
+	// Mapped big block is remapped if it is still bigger than pool can allocate.
+	BigBlock_t *pBigBlock = FindMappedBlock(pPool, pPtr);
+	if ((NULL != pBigBlock) && (uSize > pPool->uMaxSize))
+	{
+		return RemapBigBlock(pPool, pBigBlock, uSize);
+	}
+
+	// Block in the same size list, or big block not longer, only changes size of string.
+	size_t uOldSize = (NULL != pBigBlock) ? (pBigBlock->uLength - MAPPED_HEAD_SIZE) : *GetSizeOfBlock(pPtr);
+	if ((NULL == pBigBlock) && ((uOldSize > pPool->uMaxSize)
+			? ((uSize > pPool->uMaxSize) && (uSize <= uOldSize))
+			: ((uSize <= pPool->uMaxSize) && (GetIndex(uSize) == GetIndex(uOldSize)))))
+	{
+		*GetSizeOfBlock(pPtr) = uSize;
+		return pPtr;
+	}
+
+	// Move string to a block of new size.
+	void *pNewPtr = Malloc(pPool, uSize);
+	if (NULL == pNewPtr)
+	{
+		return NULL;
+	}
+	memcpy(pNewPtr, pPtr, (uSize < uOldSize) ? uSize : uOldSize);
+	Free(pPool, pPtr);
+
+	return pNewPtr;
+}
+
+/**
+ * @brief Get many memory blocks of the same size from pool at once, idle blocks are taken from list in one
+ * pass and list is updated once, if not enough, the rest are allocated from system.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @param pPtrs Where to save addresses of allocated memory.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, size_t uSize, void **pPtrs, unsigned int uCount)
+{
+	assert(NULL != pPool);
+	assert(0 != uSize);
+	unsigned int uGot = 0;
+
+	// Big blocks are allocated from system and recorded one by one.
+	if (uSize > pPool->uMaxSize)
+	{
+		for (; uGot < uCount; ++ uGot)
+		{
+			pPtrs[uGot] = Malloc(pPool, uSize);
+			if (NULL == pPtrs[uGot])
+			{
+				break;
+			}
+		}
+		return uGot;
+	}
+
+	// Take idle blocks from list of this size.
+	BlockTable_t *pHead = &(pPool->pTable[GetIndex(uSize)]);
+	Node_t *pNode = *pHead;
+	for (; (uGot < uCount) && (NULL != pNode); ++ uGot)
+	{
+		pPtrs[uGot] = (void *)&(pNode->data);
+		pNode = pNode->pNext;
+		*GetSizeOfBlock(pPtrs[uGot]) = uSize;
+	}
+	*pHead = pNode;
+
+	// Allocate the rest from system.
+	size_t uLen = RoundUp(uSize) + sizeof(size_t);
+	for (; uGot < uCount; ++ uGot)
+	{
+		pPtrs[uGot] = malloc(uLen);
+		if (NULL == pPtrs[uGot])
+		{
+			PrintError("Failed to malloc memory from system.");
+			break;
+		}
+		*GetSizeOfBlock(pPtrs[uGot]) = uSize;
+	}
+
+	return uGot;
+}
+
+/**
+ * @brief Back many memory blocks to pool at once. Blocks following each other in the same size list are
+ * linked together and joined to list once, so give back blocks grouped by size, such as in the order
+ * MallocBatch() allocated them.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtrs Addresses of memory blocks to back.
+ * @param uCount Number of memory blocks to back.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount)
+{
+	unsigned int i = 0;
+	size_t uSize = 0;
+	unsigned int uIndex = 0;
+	Node_t *pFirstNode = NULL;
+	Node_t *pNode = NULL;
+
+	// Blocks given back after pool destroyed are given back one by one.
+	if (NULL == pPool)
+	{
+		for (; i < uCount; ++ i)
+		{
+			Free(pPool, pPtrs[i]);
+		}
+		return;
+	}
+
+	while (i < uCount)
+	{
+		// Big blocks allocated from system directly are given back one by one.
+		if ((NULL != FindMappedBlock(pPool, pPtrs[i])) || (*GetSizeOfBlock(pPtrs[i]) > pPool->uMaxSize))
+		{
+			Free(pPool, pPtrs[i ++]);
+			continue;
+		}
+
+		// Link all following blocks of the same size list together.
+		uIndex = GetIndex(*GetSizeOfBlock(pPtrs[i]));
+		pFirstNode = pPool->pTable[uIndex];
+		for (; i < uCount; ++ i)
+		{
+			if (NULL != FindMappedBlock(pPool, pPtrs[i]))
+			{
+				break;
+			}
+			uSize = *GetSizeOfBlock(pPtrs[i]);
+			if ((uSize > pPool->uMaxSize) || (GetIndex(uSize) != uIndex))
+			{
+				break;
+			}
+			pNode = (Node_t *)pPtrs[i];
+			pNode->pNext = pFirstNode;
+			pFirstNode = pNode;
+		}
+		pPool->pTable[uIndex] = pFirstNode;
+	}
+}
+
 #endif /* ENABLE_VULMemoryPool */
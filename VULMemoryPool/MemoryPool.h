@@ -9,8 +9,8 @@
  *
  * Data structure:
  *
- * MemoryPool_t             0      align   2*align   3*align   4*align   5*align           (n-1)*align
- * +--------+          ~align   ~2*align  ~3*align  ~4*align  ~5*align  ~6*align    ...    ~n*align
+ * MemoryPool_t         1~8      9~16      17~24     25~32     33~40     41~48      ...  917505~1048576
+ * +--------+
  * |        |       +---------+---------+---------+---------+---------+---------+---------+-----------+
  * | pTable |  -->  | NotUsed | NotUsed | NotUsed | NotUsed |   NULL  | NotUsed |   ...   |  NotUsed  |
  * |        |       +---------+---------+---------+---------+---------+---------+---------+-----------+
@@ -35,6 +35,20 @@
  *              |     +-------+    +-------+    +-------+              +-------+
  *              ----> | Using | -- | Using | -- | Using | --  ...  --  | Using |  --  NULL
  *                    +-------+    +-------+    +-------+              +-------+
+ *
+ *   Size lists are ALIGN_SIZE steps up to 2^LINEAR_SIZE_BITS bytes, then every power of two is split into
+ * 2^CLASS_BITS lists, the same as size classes of VALMemoryPool, so a block wastes at most 1/2^CLASS_BITS
+ * of it, and pool of 1 MiB strings has 168 lists only. Block is got as long as the longest string of list.
+ *
+ *   Every block is got from system by malloc() and returned to user as it is, so it has the alignment of
+ * malloc(), at least 16 bytes on 64 bits system. Size of string is saved in the last sizeof(size_t)
+ * bytes of usable memory of block, found by malloc_usable_size(), big block saves its BigBlock_t just
+ * before it, so there is no header in front of block and overhead of block doesn't grow.
+ *
+ *   Big block not smaller than MMAP_THRESHOLD is mapped from system by mmap() with its BigBlock_t in front
+ * of it, and unmapped as soon as it is given back. malloc_usable_size() can't be used on it, so mapped blocks
+ * are also kept in a hash table by address, Free() looks up it first when pool has mapped blocks. All big
+ * blocks are in one doubly linked list, so they are unlinked without search and released when destroy pool.
  */
 
 #ifndef MEMORYPOOL_H_
@@ -42,20 +56,52 @@
 
 #include "../CProjectDfn.h"
 #include <limits.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <sys/mman.h>
 
 /**
  * @brief Max length of string pool can allocate, if bigger than this when creating, down to this size.
+ * Define it when compiling to change it, see LINEAR_SIZE_BITS for how many size lists pool has.
  */
-#ifndef USHRT_MAX
-#define USHRT_MAX 65535
+#ifndef MAX_STRING_LEN
+#define MAX_STRING_LEN (1024 * 1024)
 #endif
-#define MAX_STRING_LEN USHRT_MAX
 
 /**
  * @brief Align size, must be 2^n
  */
 #define ALIGN_SIZE 8
 
+/**
+ * @brief Sizes not bigger than 2^LINEAR_SIZE_BITS have a size list every ALIGN_SIZE bytes.
+ */
+#define LINEAR_SIZE_BITS 10
+
+/**
+ * @brief Every power of two bigger than 2^LINEAR_SIZE_BITS is split into 2^CLASS_BITS size lists.
+ * ALIGN_SIZE << CLASS_BITS must not be bigger than 2^LINEAR_SIZE_BITS.
+ */
+#define CLASS_BITS 2
+
+/**
+ * @brief Number of size lists every ALIGN_SIZE bytes.
+ */
+#define LINEAR_CLASSES ((1 << LINEAR_SIZE_BITS) / ALIGN_SIZE)
+
+/**
+ * @brief Big block not smaller than this, include its information, is mapped from system by mmap().
+ * Define it when compiling to change it, 0 maps every big block.
+ */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (32 * 1024)
+#endif
+
+/**
+ * @brief Initial number of slots in hash table of mapped big blocks, must be 2^n.
+ */
+#define MAPPED_TABLE_SIZE 16
+
 /**
  * @brief Allocate size of memory, if it not used, let the first four block save the pointer pointed to
  * next free allocated memory, if this memory are using, [data] is the first address of this memory.
@@ -74,39 +120,74 @@ typedef Node_t* BlockTable_t;
 /**
  * @brief Memory pool have it's biggest size, if user asked to allocate a big block bigger than memory
  * can be, pool will deliver this command to system and record this, when destroy the pool, all allocated
- * big block will be released.
+ * big block will be released. It is at the end of big block, just before size of string, or at the
+ * beginning of mapping if big block is mapped.
  */
 typedef struct BigBlock
 {
 	void *data;               ///< Start address of allocated big block.
 	struct BigBlock *pNext;   ///< Next allocated big block if this not the last one.
 	struct BigBlock *pPre;    ///< Previous allocated big block if that exists.
+	size_t uLength;           ///< Length got from system for this big block.
 }BigBlock_t;
 
+/**
+ * @brief Size of information in front of mapped big block, keeps block aligned as malloc() does.
+ */
+#define MAPPED_HEAD_SIZE ((sizeof(BigBlock_t) + 15) & ~15)
+
 /**
  * @biref Information about memory pool.
  */
 typedef struct MemoryPoolInf
 {
-	unsigned int uMaxSize;       ///< Longest block memory pool can allocate, if bigger, deliver to system.
+	size_t uMaxSize;             ///< Longest block memory pool can allocate, if bigger, deliver to system.
 	BlockTable_t *pTable;        ///< An array, each pointed to a list which describes the free memory block.
 	BigBlock_t *pFirstBigBlock;  ///< If bigger than pool can allocate, pointed to list which contains them.
+	unsigned int uBigBlocks;     ///< Number of big blocks in pFirstBigBlock.
+	size_t uBigBlockBytes;       ///< Bytes got from system for big blocks in pFirstBigBlock.
+	BigBlock_t **pMappedTable;   ///< Hash table of mapped big blocks by address, open addressing.
+	unsigned int uMappedSlots;   ///< Number of slots in pMappedTable, 2^n.
+	unsigned int uMappedBlocks;  ///< Number of mapped big blocks in pMappedTable.
 }MemoryPool_t;
 
 /**
- * @brief Align function, convert it to aligned size.
+ * @brief Get index from block table by given size.
+ */
+inline unsigned int GetIndex(size_t size)
+{
+	if (size <= (1 << LINEAR_SIZE_BITS))
+	{
+		return (((size) + (ALIGN_SIZE - 1)) / (ALIGN_SIZE) - 1);
+	}
+
+	// Power of two size belongs to, then which part of it.
+	unsigned int uBits = (sizeof(unsigned long) * CHAR_BIT - 1) - __builtin_clzl((unsigned long)size - 1);
+	return LINEAR_CLASSES + ((uBits - LINEAR_SIZE_BITS) << CLASS_BITS)
+			+ (((unsigned long)size - 1) >> (uBits - CLASS_BITS)) - (1 << CLASS_BITS);
+}
+
+/**
+ * @brief Get size of the longest string in a size list.
  */
-inline unsigned short RoundUp(unsigned short size)
+inline size_t GetClassSize(unsigned int uIndex)
 {
-	return (((size) + (ALIGN_SIZE - 1)) & ~(ALIGN_SIZE - 1));
+	if (uIndex < LINEAR_CLASSES)
+	{
+		return ((size_t)uIndex + 1) * ALIGN_SIZE;
+	}
+
+	unsigned int uGroup = uIndex - LINEAR_CLASSES;
+	unsigned int uBits = LINEAR_SIZE_BITS + (uGroup >> CLASS_BITS);
+	return ((size_t)(1 << CLASS_BITS) + (uGroup & ((1 << CLASS_BITS) - 1)) + 1) << (uBits - CLASS_BITS);
 }
 
 /**
- * @brief Get index from block table by given size.
+ * @brief Align function, convert it to size of the longest string in size list it belongs to.
  */
-inline unsigned short GetIndex(unsigned short size)
+inline size_t RoundUp(size_t size)
 {
-	return (((size) + (ALIGN_SIZE - 1)) / (ALIGN_SIZE) - 1);
+	return GetClassSize(GetIndex(size));
 }
 
 /**
@@ -120,7 +201,7 @@ inline unsigned short GetIndex(unsigned short size)
  * @param uMaxStrLen Max length of string this pool can allocate.
  * @return Created memory pool.
  */
-MemoryPool_t *CreateMemoryPool(unsigned short uMaxStrLen);
+MemoryPool_t *CreateMemoryPool(size_t uMaxStrLen);
 
 /**
  * @brief Destroy memory pool, release all idle memory block smaller than max size pool can allocate, and
@@ -137,7 +218,7 @@ void DestroyMemoryPool(MemoryPool_t **pPool);
  * @param uSize Size of string want to allocate.
  * @return Allocated memory.
  */
-void *Malloc(MemoryPool_t *pPool, unsigned short uSize);
+void *Malloc(MemoryPool_t *pPool, size_t uSize);
 
 /**
  * @brief Back a memory block to pool so that it can be use again.
@@ -147,4 +228,39 @@ void *Malloc(MemoryPool_t *pPool, unsigned short uSize);
  */
 void Free(MemoryPool_t *pPool, void *pPtr);
 
+/**
+ * @brief Change size of a memory block. If new size is in the same size list, or big block is not
+ * longer, the same block is returned, otherwise string is moved to a block of new size. Mapped big block
+ * is remapped without copy.
+ *
+ * @param pPool Which pool the block in.
+ * @param pPtr Address of memory block, NULL to allocate a new one.
+ * @param uSize New size of string, 0 to back the block to pool.
+ * @return Address of memory block, NULL if failed and the old one is not changed, or uSize is 0.
+ */
+void *Realloc(MemoryPool_t *pPool, void *pPtr, size_t uSize);
+
+/**
+ * @brief Get many memory blocks of the same size from pool at once, idle blocks are taken from list in one
+ * pass and list is updated once, if not enough, the rest are allocated from system.
+ *
+ * @param pPool From which pool to get.
+ * @param uSize Size of string want to allocate.
+ * @param pPtrs Where to save addresses of allocated memory.
+ * @param uCount Number of memory blocks want to allocate.
+ * @return Number of memory blocks allocated, less than uCount only if failed to malloc from system.
+ */
+unsigned int MallocBatch(MemoryPool_t *pPool, size_t uSize, void **pPtrs, unsigned int uCount);
+
+/**
+ * @brief Back many memory blocks to pool at once. Blocks following each other in the same size list are
+ * linked together and joined to list once, so give back blocks grouped by size, such as in the order
+ * MallocBatch() allocated them.
+ *
+ * @param pPool Back to which pool.
+ * @param pPtrs Addresses of memory blocks to back.
+ * @param uCount Number of memory blocks to back.
+ */
+void FreeBatch(MemoryPool_t *pPool, void **pPtrs, unsigned int uCount);
+
 #endif /* MEMORYPOOL_H_ */